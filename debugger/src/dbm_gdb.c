@@ -57,6 +57,17 @@ typedef enum _result_class {
 	RC_ERROR
 } result_class;
 
+/* callback receiving the result of a pipelined command, the callback
+owns the record which is NULL if GDB didn't answer */
+typedef void (*command_callback)(result_class rc, struct gdb_mi_record *record, gpointer data);
+
+/* pipelined command waiting for a result */
+typedef struct _pending_command {
+	command_callback callback;
+	gpointer data;
+	gchar *command;  /* set while the command waits to be sent */
+} pending_command;
+
 /* structure to keep async command data (command line, messages) */
 typedef struct _queue_item {
 	gchar *message;
@@ -121,12 +132,38 @@ static gboolean file_refresh_needed = FALSE;
 /* current frame number */
 static int active_frame = 0;
 
+/* maximum number of pipelined commands waiting for a result,
+keeps GDB from blocking on a full output pipe */
+#define MAX_PENDING_COMMANDS 64
+
+/* token -> pending_command of the pipelined commands */
+static GHashTable *pending_commands = NULL;
+
+/* pending_command's not sent yet because too many commands wait for a result */
+static GQueue queued_commands = G_QUEUE_INIT;
+
+/* last token used for a pipelined command */
+static guint last_token = 0;
+
+/* "-stack-list-frames" result of the first stack window
+requested together with the stop updates */
+static struct gdb_mi_record *stack_record = NULL;
+
+/* stack depth of the active thread, -1 if not known */
+static int stack_depth = -1;
+
 /* forward declarations */
 static void stop(void);
 static variable* add_watch(gchar* expression);
-static void update_watches(void);
 static void update_autos(void);
 static void update_files(void);
+static void queue_watches_update(void);
+static void queue_files_update(void);
+static void exec_pipelined_command(const gchar *command, command_callback callback, gpointer data);
+static void pipeline_flush(void);
+static void on_stack_listed(result_class rc, struct gdb_mi_record *record, gpointer data);
+static void on_stack_depth(result_class rc, struct gdb_mi_record *record, gpointer data);
+static void reset_stack(void);
 
 /*
  * print message using color, based on message type
@@ -194,6 +231,8 @@ static void on_gdb_exit(GPid pid, gint status, gpointer data)
 	g_source_remove(gdb_src_id);
 	gdb_src_id = 0;
 
+	reset_stack();
+
 	dbg_cbs->set_exited(0);
 }
 
@@ -501,26 +540,33 @@ static gboolean on_read_from_gdb(GIOChannel * src, GIOCondition cond, gpointer d
 		if (SR_BREAKPOINT_HIT == stop_reason || SR_END_STEPPING_RANGE == stop_reason || SR_SIGNAL_RECIEVED == stop_reason)
 		{
 			const gchar *thread_id = gdb_mi_result_var(record->first, "thread-id", GDB_MI_VAL_STRING);
+			gchar command[100];
 
 			active_frame = 0;
 
+			/* the stack is requested right after stopping, send it with the other updates */
+			exec_pipelined_command("-stack-info-depth", on_stack_depth, NULL);
+			g_snprintf(command, sizeof command, "-stack-list-frames 0 %i", STACK_WINDOW_SIZE - 1);
+			exec_pipelined_command(command, on_stack_listed, NULL);
+
 			if (SR_BREAKPOINT_HIT == stop_reason || SR_END_STEPPING_RANGE == stop_reason)
 			{
-				/* update autos */
-				update_autos();
-
-				/* update watches */
-				update_watches();
-
-				/* update files */
+				/* update watches and files, sent ahead of the autos
+				so that all results are read by the autos update */
+				queue_watches_update();
 				if (file_refresh_needed)
 				{
-					update_files();
+					queue_files_update();
 					file_refresh_needed = FALSE;
 				}
+
+				/* update autos */
+				update_autos();
 			}
 			else
 			{
+				pipeline_flush();
+
 				if (!requested_interrupt)
 				{
 					gchar *msg = g_strdup_printf(_("Program received signal %s (%s)"),
@@ -607,6 +653,9 @@ static void exec_async_command(const gchar* command)
 	dbg_cbs->send_message(command, "red");
 #endif
 
+	/* the stack requested on the last stop is outdated now */
+	reset_stack();
+
 	gdb_input_write_line(command);
 
 	/* connect read callback to the output channel */
@@ -614,46 +663,84 @@ static void exec_async_command(const gchar* command)
 }
 
 /*
- * execute "command" synchronously
- * i.e. reading output right
- * after execution
+ * passes the result to the callback of a pipelined command
  */
-static result_class exec_sync_command(const gchar* command, gboolean wait4prompt, struct gdb_mi_record ** command_record)
+static void complete_pending_command(pending_command *pending, result_class rc, struct gdb_mi_record *record)
 {
-	GList *lines, *iter;
-	result_class rc;
+	if (pending->callback)
+		pending->callback(rc, record, pending->data);
+	else
+		gdb_mi_record_free(record);
+	g_free(pending->command);
+	g_free(pending);
+}
 
-#ifdef DEBUG_OUTPUT
-	dbg_cbs->send_message(command, "red");
-#endif
+/*
+ * fails all pipelined commands, called if GDB output can't be read anymore
+ */
+static void fail_pending_commands(void)
+{
+	GHashTable *failed = pending_commands;
+	GQueue failed_queued = queued_commands;
+	GHashTableIter iter;
+	gpointer pending;
 
-	/* write command to gdb input channel */
-	gdb_input_write_line(command);
+	/* callbacks can send new commands, they fail as well on the next read */
+	pending_commands = NULL;
+	g_queue_init(&queued_commands);
 
-	if (!wait4prompt)
-		return RC_DONE;
+	if (failed)
+	{
+		g_hash_table_iter_init(&iter, failed);
+		while (g_hash_table_iter_next(&iter, NULL, &pending))
+			complete_pending_command((pending_command*)pending, RC_ERROR, NULL);
+		g_hash_table_destroy(failed);
+	}
+	while ((pending = g_queue_pop_head(&failed_queued)))
+		complete_pending_command((pending_command*)pending, RC_ERROR, NULL);
+}
 
-	if (command_record)
-		*command_record = NULL;
+/*
+ * reads GDB output until a result of a pipelined command comes
+ * and passes it to the command callback
+ * returns FALSE if GDB output can't be read
+ */
+static gboolean pipeline_read_result(void)
+{
+	gchar *line = NULL;
+	gsize terminator;
 
-	lines = read_until_prompt();
+	while (G_IO_STATUS_NORMAL == g_io_channel_read_line(gdb_ch_out, &line, NULL, &terminator, NULL))
+	{
+		struct gdb_mi_record *record;
+		pending_command *pending = NULL;
 
+		/* prompts follow every result, no need to wait for them */
+		if (!strcmp(GDB_PROMPT, line))
+		{
+			g_free(line);
+			continue;
+		}
+
+		line[terminator] = '\0';
 #ifdef DEBUG_OUTPUT
-	for (iter = lines; iter; iter = iter->next)
-	{
-		dbg_cbs->send_message((gchar*)iter->data, "red");
-	}
+		dbg_cbs->send_message(line, "red");
 #endif
 
-	rc = RC_ERROR;
+		record = gdb_mi_record_parse(line);
+		if (record && '^' == record->type && record->token)
+		{
+			gpointer token = GUINT_TO_POINTER(strtoul(record->token, NULL, 10));
 
-	for (iter = lines; iter; iter = iter->next)
-	{
-		gchar *line = (gchar*)iter->data;
-		struct gdb_mi_record *record = gdb_mi_record_parse(line);
+			pending = g_hash_table_lookup(pending_commands, token);
+			if (pending)
+				g_hash_table_steal(pending_commands, token);
+		}
 
-		if (record && '^' == record->type)
+		if (pending)
 		{
+			result_class rc = RC_ERROR;
+
 			if (gdb_mi_record_matches(record, '^', "done", NULL))
 				rc = RC_DONE;
 			else if (gdb_mi_record_matches(record, '^', "error", NULL))
@@ -661,31 +748,139 @@ static result_class exec_sync_command(const gchar* command, gboolean wait4prompt
 				/* save error message */
 				const gchar *msg = gdb_mi_result_var(record->first, "msg", GDB_MI_VAL_STRING);
 				strncpy(err_message, msg ? msg : "", G_N_ELEMENTS(err_message) - 1);
-
-				rc = RC_ERROR;
 			}
 			else if (gdb_mi_record_matches(record, '^', "exit", NULL))
 				rc = RC_EXIT;
 
-			if (command_record)
-			{
-				*command_record = record;
-				record = NULL;
-			}
-		}
-		else if (! record || '&' != record->type)
-		{
-			colorize_message (line);
+			g_free(line);
+			complete_pending_command(pending, rc, record);
+
+			return TRUE;
 		}
+
+		if (! record || '&' != record->type)
+			colorize_message(line);
+
 		gdb_mi_record_free(record);
+		g_free(line);
 	}
 
-	g_list_foreach(lines, (GFunc)g_free, NULL);
-	g_list_free(lines);
+	fail_pending_commands();
+
+	return FALSE;
+}
+
+/*
+ * sends the queued commands tagged with tokens while fewer than
+ * MAX_PENDING_COMMANDS commands wait for a result
+ */
+static void pipeline_send_queued(void)
+{
+	pending_command *pending;
+
+	/* don't let GDB output fill up while it waits for us */
+	while ((!pending_commands || g_hash_table_size(pending_commands) < MAX_PENDING_COMMANDS) &&
+		(pending = g_queue_pop_head(&queued_commands)))
+	{
+		gchar *tagged;
 
-	return rc;
+		if (!pending_commands)
+			pending_commands = g_hash_table_new(NULL, NULL);
+
+		/* token 0 would be indistinguishable from no token in GDB replies */
+		if (!++last_token)
+			last_token++;
+		g_hash_table_insert(pending_commands, GUINT_TO_POINTER(last_token), pending);
+
+		tagged = g_strdup_printf("%u%s", last_token, pending->command);
+#ifdef DEBUG_OUTPUT
+		dbg_cbs->send_message(tagged, "red");
+#endif
+		gdb_input_write_line(tagged);
+		g_free(tagged);
+		g_free(pending->command);
+		pending->command = NULL;
+	}
 }
 
+/*
+ * sends "command" tagged with a token without waiting for the result,
+ * the result is passed to "callback" (can be NULL) when the pipeline is flushed
+ * callbacks can send further commands which are waited for by the same flush;
+ * the command is queued if too many commands wait for a result, GDB output is
+ * only read by pipeline_flush() so callbacks never run from here
+ */
+static void exec_pipelined_command(const gchar *command, command_callback callback, gpointer data)
+{
+	pending_command *pending = g_new0(pending_command, 1);
+
+	pending->callback = callback;
+	pending->data = data;
+	pending->command = g_strdup(command);
+	g_queue_push_tail(&queued_commands, pending);
+
+	pipeline_send_queued();
+}
+
+/*
+ * waits until all pipelined commands (including the ones sent by the callbacks)
+ * get their results
+ */
+static void pipeline_flush(void)
+{
+	while (pending_commands && g_hash_table_size(pending_commands))
+	{
+		if (!pipeline_read_result())
+			break;
+		/* room for the commands queued meanwhile, including the ones sent by the callback */
+		pipeline_send_queued();
+	}
+}
+
+/* result of a command executed synchronously */
+typedef struct _sync_result {
+	result_class rc;
+	struct gdb_mi_record *record;
+} sync_result;
+
+static void on_sync_command_done(result_class rc, struct gdb_mi_record *record, gpointer data)
+{
+	sync_result *result = (sync_result*)data;
+
+	result->rc = rc;
+	result->record = record;
+}
+
+/*
+ * execute "command" synchronously
+ * i.e. reading output right
+ * after execution
+ */
+static result_class exec_sync_command(const gchar* command, gboolean wait4prompt, struct gdb_mi_record ** command_record)
+{
+	sync_result result = { RC_ERROR, NULL };
+
+	if (!wait4prompt)
+	{
+#ifdef DEBUG_OUTPUT
+		dbg_cbs->send_message(command, "red");
+#endif
+		/* write command to gdb input channel */
+		gdb_input_write_line(command);
+
+		return RC_DONE;
+	}
+
+	exec_pipelined_command(command, on_sync_command_done, &result);
+	pipeline_flush();
+
+	if (command_record)
+		*command_record = result.record;
+	else
+		gdb_mi_record_free(result.record);
+
+	return result.rc;
+}
 
 /* escapes @str so it is valid to put it inside a quoted argument
  * escapes '\' and '"'
@@ -1110,8 +1305,8 @@ static void set_active_frame(int frame_number)
 	if (RC_DONE == exec_sync_command(command, TRUE, NULL))
 	{
 		active_frame = frame_number;
+		queue_watches_update();
 		update_autos();
-		update_watches();
 	}
 	g_free(command);
 }
@@ -1134,7 +1329,12 @@ static int get_active_thread(void)
 static gboolean set_active_thread(int thread_id)
 {
 	gchar *command = g_strdup_printf("-thread-select %i", thread_id);
-	gboolean success = (RC_DONE == exec_sync_command(command, TRUE, NULL));
+	gboolean success;
+
+	/* the stack requested on stop belongs to the previous thread */
+	reset_stack();
+
+	success = (RC_DONE == exec_sync_command(command, TRUE, NULL));
 
 	if (success)
 		set_active_frame(0);
@@ -1144,19 +1344,80 @@ static gboolean set_active_thread(int thread_id)
 	return success;
 }
 
+/*
+ * forgets the stack information of the last stop
+ */
+static void reset_stack(void)
+{
+	gdb_mi_record_free(stack_record);
+	stack_record = NULL;
+	stack_depth = -1;
+}
+
+/*
+ * gets stack depth
+ */
+static void on_stack_depth(result_class rc, struct gdb_mi_record *record, gpointer data)
+{
+	const gchar *depth = NULL;
+
+	if (RC_DONE == rc && record)
+		depth = gdb_mi_result_var(record->first, "depth", GDB_MI_VAL_STRING);
+	stack_depth = depth ? atoi(depth) : -1;
+	gdb_mi_record_free(record);
+}
+
+static int get_stack_depth(void)
+{
+	if (stack_depth < 0)
+	{
+		struct gdb_mi_record *record = NULL;
+		result_class rc = exec_sync_command("-stack-info-depth", TRUE, &record);
+
+		on_stack_depth(rc, record, NULL);
+	}
+	return stack_depth;
+}
+
 /*
  * gets stack
  */
-static GList* get_stack(void)
+static void on_stack_listed(result_class rc, struct gdb_mi_record *record, gpointer data)
+{
+	gdb_mi_record_free(stack_record);
+	stack_record = NULL;
+
+	if (RC_DONE == rc)
+		stack_record = record;
+	else
+		gdb_mi_record_free(record);
+}
+
+/*
+ * gets frames from "low" to "high" levels (inclusive)
+ */
+static GList* get_stack(int low, int high)
 {
 	struct gdb_mi_record *record = NULL;
 	const struct gdb_mi_result *stack_node, *frame_node;
 	GList *stack = NULL;
 
-	if (RC_DONE != exec_sync_command("-stack-list-frames", TRUE, &record) || ! record)
+	if (stack_record && 0 == low && STACK_WINDOW_SIZE - 1 == high)
 	{
-		gdb_mi_record_free(record);
-		return NULL;
+		/* already requested on stop */
+		record = stack_record;
+		stack_record = NULL;
+	}
+	else
+	{
+		gchar command[100];
+
+		g_snprintf(command, sizeof command, "-stack-list-frames %i %i", low, high);
+		if (RC_DONE != exec_sync_command(command, TRUE, &record) || ! record)
+		{
+			gdb_mi_record_free(record);
+			return NULL;
+		}
 	}
 
 	stack_node = gdb_mi_result_var(record->first, "stack", GDB_MI_VAL_LIST);
@@ -1197,74 +1458,115 @@ static GList* get_stack(void)
 }
 
 /*
- * updates variables from vars list
+ * callbacks storing the results of variable queries
  */
-static void get_variables (GList *vars)
+static void on_variable_value(result_class rc, struct gdb_mi_record *record, gpointer data)
 {
-	while (vars)
+	variable *var = (variable*)data;
+	const gchar *value = NULL;
+
+	if (record)
+		value = gdb_mi_result_var(record->first, "value", GDB_MI_VAL_STRING);
+	g_string_assign(var->value, value ? value : "");
+	gdb_mi_record_free(record);
+}
+
+static void on_expression_value(result_class rc, struct gdb_mi_record *record, gpointer data)
+{
+	variable *var = (variable*)data;
+	const gchar *value = NULL;
+
+	if (record)
+		value = gdb_mi_result_var(record->first, "value", GDB_MI_VAL_STRING);
+	if (value)
+		g_string_assign(var->value, value);
+	else
 	{
+		/* evaluate the GDB variable instead */
 		gchar command[1000];
+		g_snprintf(command, sizeof command, "-var-evaluate-expression \"%s\"", var->internal->str);
+		exec_pipelined_command(command, on_variable_value, var);
+	}
+	gdb_mi_record_free(record);
+}
 
-		variable *var = (variable*)vars->data;
+static void on_variable_path_expression(result_class rc, struct gdb_mi_record *record, gpointer data)
+{
+	variable *var = (variable*)data;
+	const gchar *expression = NULL;
+	gchar command[1000];
 
-		gchar *varname = var->internal->str;
-		struct gdb_mi_record *record = NULL;
-		const gchar *expression = NULL;
-		const gchar *numchild = NULL;
-		const gchar *value = NULL;
-		const gchar *type = NULL;
-
-		/* path expression */
-		g_snprintf(command, sizeof command, "-var-info-path-expression \"%s\"", varname);
-		exec_sync_command(command, TRUE, &record);
-		if (record)
-			expression = gdb_mi_result_var(record->first, "path_expr", GDB_MI_VAL_STRING);
-		g_string_assign(var->expression, expression ? expression : "");
-		gdb_mi_record_free(record);
+	if (record)
+		expression = gdb_mi_result_var(record->first, "path_expr", GDB_MI_VAL_STRING);
+	g_string_assign(var->expression, expression ? expression : "");
+	gdb_mi_record_free(record);
 
-		/* children number */
-		g_snprintf(command, sizeof command, "-var-info-num-children \"%s\"", varname);
-		exec_sync_command(command, TRUE, &record);
-		if (record)
-			numchild = gdb_mi_result_var(record->first, "numchild", GDB_MI_VAL_STRING);
-		var->has_children = numchild && atoi(numchild) > 0;
-		gdb_mi_record_free(record);
+	/* value */
+	g_snprintf(command, sizeof command, "-data-evaluate-expression \"%s\"", var->expression->str);
+	exec_pipelined_command(command, on_expression_value, var);
+}
 
-		/* value */
-		g_snprintf(command, sizeof command, "-data-evaluate-expression \"%s\"", var->expression->str);
-		exec_sync_command(command, TRUE, &record);
-		if (record)
-			value = gdb_mi_result_var(record->first, "value", GDB_MI_VAL_STRING);
-		if (!value)
-		{
-			gdb_mi_record_free(record);
-			g_snprintf(command, sizeof command, "-var-evaluate-expression \"%s\"", varname);
-			exec_sync_command(command, TRUE, &record);
-			if (record)
-				value = gdb_mi_result_var(record->first, "value", GDB_MI_VAL_STRING);
-		}
-		g_string_assign(var->value, value ? value : "");
-		gdb_mi_record_free(record);
+static void on_variable_num_children(result_class rc, struct gdb_mi_record *record, gpointer data)
+{
+	variable *var = (variable*)data;
+	const gchar *numchild = NULL;
 
-		/* type */
-		g_snprintf(command, sizeof command, "-var-info-type \"%s\"", varname);
-		exec_sync_command(command, TRUE, &record);
-		if (record)
-			type = gdb_mi_result_var(record->first, "type", GDB_MI_VAL_STRING);
-		g_string_assign(var->type, type ? type : "");
-		gdb_mi_record_free(record);
+	if (record)
+		numchild = gdb_mi_result_var(record->first, "numchild", GDB_MI_VAL_STRING);
+	var->has_children = numchild && atoi(numchild) > 0;
+	gdb_mi_record_free(record);
+}
 
-		vars = vars->next;
-	}
+static void on_variable_type(result_class rc, struct gdb_mi_record *record, gpointer data)
+{
+	variable *var = (variable*)data;
+	const gchar *type = NULL;
+
+	if (record)
+		type = gdb_mi_result_var(record->first, "type", GDB_MI_VAL_STRING);
+	g_string_assign(var->type, type ? type : "");
+	gdb_mi_record_free(record);
+}
+
+/*
+ * sends the queries updating a variable,
+ * the variable is updated when the pipeline is flushed
+ */
+static void queue_variable_update(variable *var)
+{
+	gchar command[1000];
+	gchar *varname = var->internal->str;
+
+	/* path expression, the value is requested when it's known */
+	g_snprintf(command, sizeof command, "-var-info-path-expression \"%s\"", varname);
+	exec_pipelined_command(command, on_variable_path_expression, var);
+
+	/* children number */
+	g_snprintf(command, sizeof command, "-var-info-num-children \"%s\"", varname);
+	exec_pipelined_command(command, on_variable_num_children, var);
+
+	/* type */
+	g_snprintf(command, sizeof command, "-var-info-type \"%s\"", varname);
+	exec_pipelined_command(command, on_variable_type, var);
+}
+
+/*
+ * updates variables from vars list
+ */
+static void get_variables (GList *vars)
+{
+	for (; vars; vars = vars->next)
+		queue_variable_update((variable*)vars->data);
+
+	pipeline_flush();
 }
 
 /*
  * updates files list
  */
-static void update_files(void)
+static void on_files_listed(result_class rc, struct gdb_mi_record *record, gpointer data)
 {
 	GHashTable *ht;
-	struct gdb_mi_record *record = NULL;
 	const struct gdb_mi_result *files_node;
 
 	if (files)
@@ -1275,7 +1577,6 @@ static void update_files(void)
 		files = NULL;
 	}
 
-	exec_sync_command("-file-list-exec-source-files", TRUE, &record);
 	if (! record)
 		return;
 
@@ -1297,13 +1598,48 @@ static void update_files(void)
 	gdb_mi_record_free(record);
 }
 
+static void queue_files_update(void)
+{
+	exec_pipelined_command("-file-list-exec-source-files", on_files_listed, NULL);
+}
+
+static void update_files(void)
+{
+	queue_files_update();
+	pipeline_flush();
+}
+
 /*
  * updates watches list
  */
-static void update_watches(void)
+static void on_watch_created(result_class rc, struct gdb_mi_record *record, gpointer data)
+{
+	variable *var = (variable*)data;
+	const gchar *name;
+
+	if (RC_DONE != rc || !record)
+	{
+		/* do not update, the watch is not valid here */
+		var->evaluated = FALSE;
+		g_string_assign(var->internal, "");
+		gdb_mi_record_free(record);
+
+		return;
+	}
+
+	/* find and assign internal name */
+	name = gdb_mi_result_var(record->first, "name", GDB_MI_VAL_STRING);
+	g_string_assign(var->internal, name ? name : "");
+	gdb_mi_record_free(record);
+
+	var->evaluated = name != NULL;
+
+	queue_variable_update(var);
+}
+
+static void queue_watches_update(void)
 {
 	gchar command[1000];
-	GList *updating = NULL;
 	GList *iter;
 
 	/* delete all GDB variables */
@@ -1314,20 +1650,18 @@ static void update_watches(void)
 		if (var->internal->len)
 		{
 			g_snprintf(command, sizeof command, "-var-delete %s", var->internal->str);
-			exec_sync_command(command, TRUE, NULL);
+			exec_pipelined_command(command, NULL, NULL);
 		}
 
 		/* reset all variables fields */
 		variable_reset(var);
 	}
 
-	/* create GDB variables, adding successfully created
-	variables to the list then passed for updating */
+	/* create GDB variables, successfully created
+	variables are updated from the callback */
 	for (iter = watches; iter; iter = iter->next)
 	{
 		variable *var = (variable*)iter->data;
-		struct gdb_mi_record *record = NULL;
-		const gchar *name;
 		gchar *escaped;
 
 		/* try to create variable */
@@ -1335,62 +1669,18 @@ static void update_watches(void)
 		g_snprintf(command, sizeof command, "-var-create - * \"%s\"", escaped);
 		g_free(escaped);
 
-		if (RC_DONE != exec_sync_command(command, TRUE, &record) || !record)
-		{
-			/* do not include to updating list, move to next watch */
-			var->evaluated = FALSE;
-			g_string_assign(var->internal, "");
-			gdb_mi_record_free(record);
-
-			continue;
-		}
-
-		/* find and assign internal name */
-		name = gdb_mi_result_var(record->first, "name", GDB_MI_VAL_STRING);
-		g_string_assign(var->internal, name ? name : "");
-		gdb_mi_record_free(record);
-
-		var->evaluated = name != NULL;
-
-		/* add to updating list */
-		updating = g_list_prepend(updating, var);
+		exec_pipelined_command(command, on_watch_created, var);
 	}
-	updating = g_list_reverse(updating);
-
-	/* update watches */
-	get_variables(updating);
-
-	/* free updating list */
-	g_list_free(updating);
 }
 
 /*
  * updates autos list
  */
-static void update_autos(void)
+static void on_arguments_listed(result_class rc, struct gdb_mi_record *record, gpointer data)
 {
-	gchar command[1000];
-	GList *unevaluated = NULL, *vars = NULL, *iter;
+	GList **vars = (GList**)data;
 
-	/* remove all previous GDB variables for autos */
-	for (iter = autos; iter; iter = iter->next)
-	{
-		variable *var = (variable*)iter->data;
-
-		g_snprintf(command, sizeof command, "-var-delete %s", var->internal->str);
-		exec_sync_command(command, TRUE, NULL);
-	}
-
-	g_list_foreach(autos, (GFunc)variable_free, NULL);
-	g_list_free(autos);
-	autos = NULL;
-
-	/* add current autos to the list */
-
-	struct gdb_mi_record *record = NULL;
-
-	g_snprintf(command, sizeof command, "-stack-list-arguments 0 %i %i", active_frame, active_frame);
-	if (RC_DONE == exec_sync_command(command, TRUE, &record) && record)
+	if (RC_DONE == rc && record)
 	{
 		const struct gdb_mi_result *stack_args = gdb_mi_result_var(record->first, "stack-args", GDB_MI_VAL_LIST);
 
@@ -1401,58 +1691,102 @@ static void update_autos(void)
 			gdb_mi_result_foreach_matched (args, args, "name", GDB_MI_VAL_STRING)
 			{
 				variable *var = variable_new(args->val->v.string, VT_ARGUMENT);
-				vars = g_list_append(vars, var);
+				*vars = g_list_append(*vars, var);
 			}
 		}
 	}
 	gdb_mi_record_free(record);
+}
+
+static void on_locals_listed(result_class rc, struct gdb_mi_record *record, gpointer data)
+{
+	GList **vars = (GList**)data;
 
-	if (RC_DONE == exec_sync_command("-stack-list-locals 0", TRUE, &record) && record)
+	if (RC_DONE == rc && record)
 	{
 		const struct gdb_mi_result *locals = gdb_mi_result_var(record->first, "locals", GDB_MI_VAL_LIST);
 
 		gdb_mi_result_foreach_matched (locals, locals, "name", GDB_MI_VAL_STRING)
 		{
 			variable *var = variable_new(locals->val->v.string, VT_LOCAL);
-			vars = g_list_append(vars, var);
+			*vars = g_list_append(*vars, var);
 		}
 	}
 	gdb_mi_record_free(record);
+}
+
+static void on_auto_created(result_class rc, struct gdb_mi_record *record, gpointer data)
+{
+	variable *var = (variable*)data;
+	const gchar *intname;
+
+	/* form new variable */
+	if (RC_DONE == rc && record &&
+		(intname = gdb_mi_result_var(record->first, "name", GDB_MI_VAL_STRING)))
+	{
+		var->evaluated = TRUE;
+		g_string_assign(var->internal, intname);
+		queue_variable_update(var);
+	}
+	else
+	{
+		var->evaluated = FALSE;
+		g_string_assign(var->internal, "");
+	}
+	gdb_mi_record_free(record);
+}
 
+static void update_autos(void)
+{
+	gchar command[1000];
+	GList *unevaluated = NULL, *vars = NULL, *iter;
+
+	/* remove all previous GDB variables for autos */
+	for (iter = autos; iter; iter = iter->next)
+	{
+		variable *var = (variable*)iter->data;
+
+		g_snprintf(command, sizeof command, "-var-delete %s", var->internal->str);
+		exec_pipelined_command(command, NULL, NULL);
+	}
+
+	g_list_foreach(autos, (GFunc)variable_free, NULL);
+	g_list_free(autos);
+	autos = NULL;
+
+	/* add current autos to the list, results come in the order
+	the commands were sent so arguments precede locals */
+	g_snprintf(command, sizeof command, "-stack-list-arguments 0 %i %i", active_frame, active_frame);
+	exec_pipelined_command(command, on_arguments_listed, &vars);
+	exec_pipelined_command("-stack-list-locals 0", on_locals_listed, &vars);
+	pipeline_flush();
+
+	/* create new gdb variables, the created ones are updated from the callback */
 	for (iter = vars; iter; iter = iter->next)
 	{
 		variable *var = iter->data;
-		struct gdb_mi_record *create_record = NULL;
 		gchar *escaped;
-		const gchar *intname;
 
-		/* create new gdb variable */
 		escaped = escape_string(var->name->str);
 		g_snprintf(command, sizeof command, "-var-create - * \"%s\"", escaped);
 		g_free(escaped);
 
-		/* form new variable */
-		if (RC_DONE == exec_sync_command(command, TRUE, &create_record) && create_record &&
-			(intname = gdb_mi_result_var(create_record->first, "name", GDB_MI_VAL_STRING)))
-		{
-			var->evaluated = TRUE;
-			g_string_assign(var->internal, intname);
+		exec_pipelined_command(command, on_auto_created, var);
+	}
+	pipeline_flush();
+
+	/* incorrect variables go after the evaluated ones */
+	for (iter = vars; iter; iter = iter->next)
+	{
+		variable *var = iter->data;
+
+		if (var->evaluated)
 			autos = g_list_append(autos, var);
-		}
 		else
-		{
-			var->evaluated = FALSE;
-			g_string_assign(var->internal, "");
 			unevaluated = g_list_append(unevaluated, var);
-		}
-		gdb_mi_record_free(create_record);
 	}
 	g_list_free(vars);
 
-	/* get values for the autos (without incorrect variables) */
-	get_variables(autos);
-
-	/* add incorrect variables */
 	autos = g_list_concat(autos, unevaluated);
 }
 
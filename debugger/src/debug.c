@@ -145,6 +145,21 @@ static GtkWidget **sensitive_widget[] = {&stree, &wtree, &atree, NULL};
  */
 static GList* stack = NULL;
 
+/* depth of the whole stack, only its innermost frames are in "stack" */
+static int stack_depth = 0;
+
+/* 
+ * stack of the previous stop and its thread and depth,
+ * its outer frames that didn't change are reused
+ */
+static GList* previous_stack = NULL;
+static int previous_stack_thread_id = 0;
+static int previous_stack_depth = 0;
+
+/* number of frames at the end of a stack window which have to be the same
+ * as the frames of the previous stop to reuse the rest of them */
+#define STACK_REUSE_MATCHES 4
+
 /*
  * pages which are loaded in debugger and therefore, are set readonly
  */
@@ -189,6 +204,88 @@ static void remove_stack_markers(void)
 	}
 }
 
+/* 
+ * free the stack of the previous stop
+ */
+static void free_previous_stack(void)
+{
+	g_list_free_full(previous_stack, (GDestroyNotify)frame_unref);
+	previous_stack = NULL;
+	previous_stack_depth = 0;
+}
+
+/* 
+ * gets the innermost frames of the stack of the active thread;
+ * the frames aligned from the outermost one with the previous stack are
+ * compared by their addresses, and once a window ends with enough frames
+ * that didn't change, the rest of the previous frames is reused
+ */
+static void load_stack(void)
+{
+	int previous_length = g_list_length(previous_stack);
+	int level = 0;
+	int match_start = -1;
+	int delta, target;
+
+	stack_depth = active_module->get_stack_depth();
+
+	/* stacks of unknown depth can't be aligned */
+	if (stack_depth < 0 || previous_stack_depth == G_MAXINT)
+	{
+		free_previous_stack();
+		previous_length = 0;
+	}
+	if (stack_depth < 0)
+		stack_depth = G_MAXINT;
+
+	/* a frame of the previous stop at level N is at level N + delta now */
+	delta = stack_depth - previous_stack_depth;
+
+	/* as many frames as were loaded on the previous stop, at least a window */
+	target = previous_stack ? MAX(STACK_WINDOW_SIZE, previous_length + delta) : STACK_WINDOW_SIZE;
+
+	while (level < MIN(target, stack_depth))
+	{
+		GList *frames = active_module->get_stack(level, level + STACK_WINDOW_SIZE - 1);
+		GList *previous = level - delta > 0 ? g_list_nth(previous_stack, level - delta) : NULL;
+		GList *iter;
+
+		if (!frames)
+			break;
+
+		for (iter = frames; iter; iter = iter->next, level++)
+		{
+			frame *f = (frame*)iter->data;
+
+			if (level - delta == 0)
+				previous = previous_stack;
+
+			if (previous && !g_strcmp0(((frame*)previous->data)->address, f->address))
+			{
+				if (match_start < 0)
+					match_start = level;
+			}
+			else
+				match_start = -1;
+
+			if (previous)
+				previous = previous->next;
+		}
+		stack = g_list_concat(stack, frames);
+
+		if (previous && match_start >= 0 && level - match_start >= STACK_REUSE_MATCHES)
+		{
+			GList *reused = g_list_copy(previous);
+
+			g_list_foreach(reused, (GFunc)frame_ref, NULL);
+			stack = g_list_concat(stack, reused);
+			break;
+		}
+	}
+
+	free_previous_stack();
+}
+
 /* 
  * add stack margin markers
  */
@@ -636,12 +733,14 @@ static void on_debugger_run (void)
 	/* update debug state */
 	debug_state = DBS_RUNNING;
 
-	/* if current instruction marker was set previously - remove it */
+	/* if current instruction marker was set previously - remove it,
+	the frames are kept to be compared with the next stop */
 	if (stack)
 	{
 		remove_stack_markers();
-		g_list_foreach(stack, (GFunc)frame_unref, NULL);
-		g_list_free(stack);
+		free_previous_stack();
+		previous_stack = stack;
+		previous_stack_depth = stack_depth;
 		stack = NULL;
 
 		stree_remove_frames();
@@ -699,7 +798,10 @@ static void on_debugger_stopped (int thread_id)
 	stree_set_active_thread_id(thread_id);
 
 	/* get current stack trace and put in the tree view */
-	stack = active_module->get_stack();
+	if (thread_id != previous_stack_thread_id)
+		free_previous_stack();
+	previous_stack_thread_id = thread_id;
+	load_stack();
 	stree_add (stack);
 	stree_select_first_frame(TRUE);
 
@@ -799,6 +901,7 @@ static void on_debugger_exited (int code)
 		g_list_free(stack);
 		stack = NULL;
 	}
+	free_previous_stack();
 	
 	/* clear watch page */
 	clear_watch_values(GTK_TREE_VIEW(wtree));
@@ -959,6 +1062,44 @@ static void on_select_frame(int frame_number)
 	}
 }
 
+/*
+ * called when the stack tree has been scrolled or resized,
+ * gets more frames if the last one is visible
+ */
+static void on_stack_scrolled(GtkAdjustment *adjustment, gpointer user_data)
+{
+	GList *frames, *iter;
+	int loaded;
+
+	if (debug_state != DBS_STOPPED || !stack || !stree_last_frame_visible())
+		return;
+
+	loaded = g_list_length(stack);
+	if (loaded >= stack_depth)
+		return;
+
+	frames = active_module->get_stack(loaded, loaded + STACK_WINDOW_SIZE - 1);
+	if (!frames)
+	{
+		/* the depth wasn't known, it's the end of the stack */
+		stack_depth = loaded;
+		return;
+	}
+
+	/* frames are added to the stack first as adding
+	them to the tree view can emit this signal again */
+	stack = g_list_concat(stack, g_list_copy(frames));
+	stree_add(frames);
+
+	for (iter = frames; iter; iter = iter->next)
+	{
+		frame *f = (frame*)iter->data;
+		if (f->have_source)
+			markers_add_frame(f->file, f->line);
+	}
+	g_list_free(frames);
+}
+
 /*
  * called when a thread has been selected
  */
@@ -976,7 +1117,10 @@ static void on_select_thread(int thread_id)
 	if ((success = active_module->set_active_thread(thread_id)))
 	{
 		g_list_free_full(stack, (GDestroyNotify)frame_unref);
-		stack = active_module->get_stack();
+		stack = NULL;
+		free_previous_stack();
+		previous_stack_thread_id = thread_id;
+		load_stack();
 
 		/* update the stack tree */
 		stree_remove_frames();
@@ -1039,6 +1183,10 @@ void debug_init(void)
 		GTK_POLICY_AUTOMATIC,
 		GTK_POLICY_AUTOMATIC);
 	gtk_container_add(GTK_CONTAINER(tab_call_stack), stree);
+	g_signal_connect(gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(tab_call_stack)),
+		"value-changed", G_CALLBACK(on_stack_scrolled), NULL);
+	g_signal_connect(gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(tab_call_stack)),
+		"changed", G_CALLBACK(on_stack_scrolled), NULL);
 	
 	/* create debug terminal page */
 	terminal = vte_terminal_new();
@@ -1126,6 +1274,7 @@ void debug_destroy(void)
 		g_list_free(stack);
 		stack = NULL;
 	}
+	free_previous_stack();
 	
 	stree_destroy();
 }
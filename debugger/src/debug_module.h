@@ -87,6 +87,10 @@ typedef struct _frame {
 	gboolean have_source;
 } frame;
 
+/* number of frames requested at once, further frames are requested
+ * when the stack view is scrolled to them */
+#define STACK_WINDOW_SIZE 64
+
 /* enumeration for module features */
 typedef enum _module_features
 {
@@ -117,7 +121,8 @@ typedef struct _dbg_module {
 	gboolean (*set_break) (breakpoint* bp, break_set_activity bsa);
 	gboolean (*remove_break) (breakpoint* bp);
 
-	GList* (*get_stack) (void);
+	GList* (*get_stack) (int low, int high);
+	int (*get_stack_depth) (void);
 
 	void (*set_active_frame)(int frame_number);
 	int (*get_active_frame)(void);
@@ -156,6 +161,7 @@ typedef struct _dbg_module {
 	set_break, \
 	remove_break, \
 	get_stack, \
+	get_stack_depth, \
 	set_active_frame, \
 	get_active_frame, \
 	set_active_thread, \
@@ -36,46 +36,161 @@
 
 #define ascii_isodigit(c) (((guchar) (c)) >= '0' && ((guchar) (c)) <= '7')
 
+/* alignment of the memory returned by arena_alloc() */
+#define ARENA_ALIGN(n) (((n) + 2 * sizeof(gpointer) - 1) & ~(2 * sizeof(gpointer) - 1))
+#define ARENA_MIN_BLOCK_SIZE 1024
+#define ARENA_MAX_BLOCK_SIZE (1024 * 1024)
 
-static struct gdb_mi_value *parse_value(const gchar **p);
+/* smallest tuple for which a name index is built, smaller ones are faster to
+ * search linearly */
+#define INDEX_MIN_RESULTS 8
 
 
-void gdb_mi_value_free(struct gdb_mi_value *val)
+/* All memory of a record comes from an arena: a list of blocks that are only
+ * ever bumped and are freed together with the record.  The line is copied
+ * into the arena and the strings are unescaped and terminated in place. */
+struct gdb_mi_arena_block
 {
-	if (! val)
-		return;
-	switch (val->type)
+	struct gdb_mi_arena_block *prev;
+	gsize size;
+	gsize used;
+};
+
+struct gdb_mi_arena
+{
+	struct gdb_mi_arena_block *block; /*< the block allocations are made from */
+};
+
+/* open addressing hash table of the results of a tuple by name; only the first
+ * result of each name is stored as gdb_mi_result_var() returns the first one */
+struct gdb_mi_index
+{
+	gsize mask;
+	const struct gdb_mi_result **slots;
+};
+
+
+static struct gdb_mi_value *parse_value(struct gdb_mi_arena *arena, gchar **p);
+
+
+static struct gdb_mi_arena_block *arena_block_new(gsize size)
+{
+	struct gdb_mi_arena_block *block = g_malloc(ARENA_ALIGN(sizeof *block) + size);
+
+	block->prev = NULL;
+	block->size = size;
+	block->used = 0;
+	return block;
+}
+
+static struct gdb_mi_arena *arena_new(gsize size_hint)
+{
+	struct gdb_mi_arena *arena = g_malloc(sizeof *arena);
+
+	arena->block = arena_block_new(MAX(ARENA_ALIGN(size_hint), ARENA_MIN_BLOCK_SIZE));
+	return arena;
+}
+
+static void arena_free(struct gdb_mi_arena *arena)
+{
+	while (arena->block)
 	{
-		case GDB_MI_VAL_STRING:
-			g_free(val->v.string);
-			break;
+		struct gdb_mi_arena_block *prev = arena->block->prev;
 
-		case GDB_MI_VAL_LIST:
-			gdb_mi_result_free(val->v.list, TRUE);
-			break;
+		g_free(arena->block);
+		arena->block = prev;
 	}
-	g_free(val);
+	g_free(arena);
 }
 
-void gdb_mi_result_free(struct gdb_mi_result *res, gboolean next)
+static gpointer arena_alloc(struct gdb_mi_arena *arena, gsize size)
 {
-	if (! res)
-		return;
-	g_free(res->var);
-	gdb_mi_value_free(res->val);
-	if (next)
-		gdb_mi_result_free(res->next, next);
-	g_free(res);
+	struct gdb_mi_arena_block *block = arena->block;
+	gpointer mem;
+
+	size = ARENA_ALIGN(size);
+	if (block->size - block->used < size)
+	{
+		/* blocks grow so that huge records only need a few of them */
+		gsize block_size = MIN(block->size * 2, ARENA_MAX_BLOCK_SIZE);
+
+		block = arena_block_new(MAX(block_size, size));
+		block->prev = arena->block;
+		arena->block = block;
+	}
+
+	mem = (gchar *) block + ARENA_ALIGN(sizeof *block) + block->used;
+	block->used += size;
+	return mem;
+}
+
+static gpointer arena_alloc0(struct gdb_mi_arena *arena, gsize size)
+{
+	return memset(arena_alloc(arena, size), 0, size);
+}
+
+static gchar *arena_strndup(struct gdb_mi_arena *arena, const gchar *str, gsize len)
+{
+	gchar *dup = arena_alloc(arena, len + 1);
+
+	memcpy(dup, str, len);
+	dup[len] = 0;
+	return dup;
 }
 
 void gdb_mi_record_free(struct gdb_mi_record *record)
 {
 	if (! record)
 		return;
-	g_free(record->token);
-	g_free(record->klass);
-	gdb_mi_result_free(record->first, TRUE);
-	g_free(record);
+	/* the record itself is in the arena */
+	arena_free(record->arena);
+}
+
+/* builds the name index of a tuple if it is big enough */
+static void index_results(struct gdb_mi_arena *arena, struct gdb_mi_result *first, gsize count)
+{
+	struct gdb_mi_index *index;
+	const struct gdb_mi_result *res;
+	gsize size;
+
+	if (count < INDEX_MIN_RESULTS)
+		return;
+
+	/* keep the table at most half full */
+	for (size = INDEX_MIN_RESULTS * 2; size < count * 2; size *= 2)
+		;
+	index = arena_alloc(arena, sizeof *index);
+	index->mask = size - 1;
+	index->slots = arena_alloc0(arena, size * sizeof *index->slots);
+
+	for (res = first; res; res = res->next)
+	{
+		gsize i;
+
+		if (! res->var)
+			continue;
+		for (i = g_str_hash(res->var) & index->mask; index->slots[i]; i = (i + 1) & index->mask)
+		{
+			if (strcmp(index->slots[i]->var, res->var) == 0)
+				break;
+		}
+		if (! index->slots[i])
+			index->slots[i] = res;
+	}
+
+	first->index = index;
+}
+
+static const struct gdb_mi_result *index_lookup(const struct gdb_mi_index *index, const gchar *name)
+{
+	gsize i;
+
+	for (i = g_str_hash(name) & index->mask; index->slots[i]; i = (i + 1) & index->mask)
+	{
+		if (strcmp(index->slots[i]->var, name) == 0)
+			return index->slots[i];
+	}
+	return NULL;
 }
 
 /* parses: cstring
@@ -90,23 +205,27 @@ void gdb_mi_record_free(struct gdb_mi_record *record)
  *        encoded as \NNN (most likely octal), but that's not really clear --
  *        although it parses everything I encountered
  * FIXME: this does NOT convert to UTF-8.  should it? */
-static gchar *parse_cstring(const gchar **p)
+static gchar *parse_cstring(gchar **p)
 {
-	GString *str = g_string_new(NULL);
+	gchar *str = (gchar *) "";
 
 	if (**p == '"')
 	{
-		const gchar *base;
+		gchar *base, *out;
 
 		(*p)++;
-		base = *p;
+		str = out = base = *p;
+		/* the unescaped string is never longer than the escaped one, so it is
+		 * written over it.  Without escapes nothing is moved. */
 		while (**p != '"')
 		{
 			gchar c = **p;
 			/* TODO: check expansions here */
 			if (c == '\\')
 			{
-				g_string_append_len(str, base, (*p) - base);
+				if (out != base)
+					memmove(out, base, (gsize) ((*p) - base));
+				out += (*p) - base;
 				(*p)++;
 				c = **p;
 				switch (g_ascii_tolower(c))
@@ -161,26 +280,32 @@ static gchar *parse_cstring(const gchar **p)
 						}
 						break;
 				}
-				g_string_append_c(str, c);
+				*out++ = c;
 				base = (*p) + 1;
 			}
 			else if (**p == '\0')
 				break;
 			(*p)++;
 		}
-		g_string_append_len(str, base, (*p) - base);
+		if (out != base)
+			memmove(out, base, (gsize) ((*p) - base));
+		out += (*p) - base;
 		if (**p == '"')
 			(*p)++;
+		/* after the closing quote was passed, as it may be overwritten */
+		*out = 0;
 	}
-	return g_string_free(str, FALSE);
+	return str;
 }
 
 /* parses: string
  * FIXME: what really is a string?  here it uses [a-zA-Z_-.][a-zA-Z0-9_-.]* but
- *        the docs aren't clear on this */
-static gchar *parse_string(const gchar **p)
+ *        the docs aren't clear on this
+ * note: the string is not terminated as the next character still has to be
+ *       parsed, the caller has to terminate it at the returned position of @p */
+static gchar *parse_string(gchar **p)
 {
-	const gchar *base = *p;
+	gchar *base = *p;
 
 	if (g_ascii_isalpha(**p) || strchr("-_.", **p))
 	{
@@ -188,65 +313,73 @@ static gchar *parse_string(const gchar **p)
 			;
 	}
 
-	return g_strndup (base, *p - base);
+	return base;
 }
 
 /* parses: string "=" value */
-static gboolean parse_result(struct gdb_mi_result *result, const gchar **p)
+static gboolean parse_result(struct gdb_mi_arena *arena, struct gdb_mi_result *result, gchar **p)
 {
+	gchar *var_end;
+
 	result->var = parse_string(p);
+	var_end = *p;
 	while (g_ascii_isspace(**p)) (*p)++;
 	if (**p == '=')
 	{
 		(*p)++;
 		while (g_ascii_isspace(**p)) (*p)++;
-		result->val = parse_value(p);
+		result->val = parse_value(arena, p);
+		/* the '=' is parsed, the name can be terminated */
+		*var_end = 0;
 	}
 	return result->var && result->val;
 }
 
 /* parses: cstring | list | tuple
  * Actually, this is more permissive and allows mixed tuples/lists */
-static struct gdb_mi_value *parse_value(const gchar **p)
+static struct gdb_mi_value *parse_value(struct gdb_mi_arena *arena, gchar **p)
 {
 	struct gdb_mi_value *val = NULL;
 	if (**p == '"')
 	{
-		val = g_malloc0(sizeof *val);
+		val = arena_alloc0(arena, sizeof *val);
 		val->type = GDB_MI_VAL_STRING;
 		val->v.string = parse_cstring(p);
 	}
 	else if (**p == '{' || **p == '[')
 	{
 		struct gdb_mi_result *prev = NULL;
-		val = g_malloc0(sizeof *val);
+		gsize count = 0;
+		gchar start = **p;
+		gchar end = start == '{' ? '}' : ']';
+		val = arena_alloc0(arena, sizeof *val);
 		val->type = GDB_MI_VAL_LIST;
-		gchar end = **p == '{' ? '}' : ']';
 		(*p)++;
 		while (**p && **p != end)
 		{
-			struct gdb_mi_result *item = g_malloc0(sizeof *item);
+			struct gdb_mi_result *item = arena_alloc0(arena, sizeof *item);
 			while (g_ascii_isspace(**p)) (*p)++;
-			if ((item->val = parse_value(p)) ||
-				parse_result(item, p))
+			if ((item->val = parse_value(arena, p)) ||
+				parse_result(arena, item, p))
 			{
 				if (prev)
 					prev->next = item;
 				else
 					val->v.list = item;
 				prev = item;
+				count++;
 			}
 			else
-			{
-				gdb_mi_result_free(item, TRUE);
 				break;
-			}
 			while (g_ascii_isspace(**p)) (*p)++;
 			if (**p != ',') break;
 			(*p)++;
 		}
 		if (**p == end)
 			(*p)++;
+		/* lists are iterated rather than looked up */
+		if (start == '{')
+			index_results(arena, val->v.list, count);
 	}
 	return val;
 }
@@ -288,29 +421,34 @@ static gboolean is_prompt(const gchar *p)
  */
 struct gdb_mi_record *gdb_mi_record_parse(const gchar *line)
 {
-	struct gdb_mi_record *record = g_malloc0(sizeof *record);
+	gsize len = strlen(line);
+	struct gdb_mi_arena *arena = arena_new(sizeof(struct gdb_mi_record) + len * 2);
+	struct gdb_mi_record *record = arena_alloc0(arena, sizeof *record);
+	gchar *p = arena_strndup(arena, line, len);
+
+	record->arena = arena;
 
 	/* FIXME: prompt detection should not really be useful, especially not as a
 	 * special case, as the prompt should always follow an (optional) record */
-	if (is_prompt(line))
+	if (is_prompt(p))
 		record->type = GDB_MI_TYPE_PROMPT;
 	else
 	{
 		/* extract token */
-		const gchar *token_end = line;
-		for (token_end = line; g_ascii_isdigit(*token_end); token_end++)
+		gchar *token_end = p;
+		for (token_end = p; g_ascii_isdigit(*token_end); token_end++)
 			;
-		if (token_end > line)
+		if (token_end > p)
 		{
-			record->token = g_strndup(line, (gsize)(token_end - line));
-			line = token_end;
-			while (g_ascii_isspace(*line)) line++;
+			record->token = arena_strndup(arena, p, (gsize)(token_end - p));
+			p = token_end;
+			while (g_ascii_isspace(*p)) p++;
 		}
 
 		/* extract record */
-		record->type = *line;
-		if (*line) ++line;
-		while (g_ascii_isspace(*line)) line++;
+		record->type = *p;
+		if (*p) ++p;
+		while (g_ascii_isspace(*p)) p++;
 		switch (record->type)
 		{
 			case '~':
@@ -325,7 +463,7 @@ struct gdb_mi_record *gdb_mi_record_parse(const gchar *line)
 				 * > implicit newline).
 				 * 
 				 * This adds "raw text" to "c-string"... so? */
-				record->klass = parse_cstring(&line);
+				record->klass = parse_cstring(&p);
 				break;
 			case '^':
 			case '*':
@@ -333,21 +471,23 @@ struct gdb_mi_record *gdb_mi_record_parse(const gchar *line)
 			case '=':
 			{
 				struct gdb_mi_result *prev = NULL;
-				record->klass = parse_string(&line);
-				while (*line)
+				gsize count = 0;
+				gchar *klass_end;
+				record->klass = parse_string(&p);
+				klass_end = p;
+				while (*p)
 				{
-					while (g_ascii_isspace(*line)) line++;
-					if (*line != ',')
+					while (g_ascii_isspace(*p)) p++;
+					if (*p != ',')
 						break;
 					else
 					{
-						struct gdb_mi_result *res = g_malloc0(sizeof *res);
-						line++;
-						while (g_ascii_isspace(*line)) line++;
-						if (!parse_result(res, &line))
+						struct gdb_mi_result *res = arena_alloc0(arena, sizeof *res);
+						p++;
+						while (g_ascii_isspace(*p)) p++;
+						if (!parse_result(arena, res, &p))
 						{
 							g_warning("failed to parse result");
-							gdb_mi_result_free(res, TRUE);
 							break;
 						}
 						if (prev)
@@ -355,8 +495,11 @@ struct gdb_mi_record *gdb_mi_record_parse(const gchar *line)
 						else
 							record->first = res;
 						prev = res;
+						count++;
 					}
 				}
+				*klass_end = 0;
+				index_results(arena, record->first, count);
 				break;
 			}
 			default:
@@ -374,6 +517,13 @@ static const struct gdb_mi_value *gdb_mi_result_var_value(const struct gdb_mi_re
 {
 	g_return_val_if_fail(name != NULL, NULL);
 
+	/* only the first result of a tuple has an index */
+	if (result && result->index)
+	{
+		result = index_lookup(result->index, name);
+		return result ? result->val : NULL;
+	}
+
 	for (; result; result = result->next)
 	{
 		if (result->var && strcmp(result->var, name) == 0)
@@ -495,15 +645,94 @@ static gchar *read_line(FILE *fp)
 	return g_string_free(line, line->len < 1);
 }
 
+/* checks that the indexed lookups find the same results as linear search */
+static void gdb_mi_result_check_index(const struct gdb_mi_result *first)
+{
+	const struct gdb_mi_result *r, *l;
+
+	for (r = first; r; r = r->next)
+	{
+		if (first->index && r->var)
+		{
+			for (l = first; l && (! l->var || strcmp(l->var, r->var) != 0); l = l->next)
+				;
+			if (index_lookup(first->index, r->var) != l)
+				g_error("index lookup of \"%s\" failed", r->var);
+		}
+		if (r->val->type == GDB_MI_VAL_LIST)
+			gdb_mi_result_check_index(r->val->v.list);
+	}
+	if (first && first->index && index_lookup(first->index, "-no-such-var-") != NULL)
+		g_error("index lookup of a missing variable succeeded");
+}
+
+/* parses the GDB/MI transcripts (lines starting with # are skipped as in the
+ * test input) repeatedly for about a second each and reports the speed */
+static int benchmark(int n_files, char **filenames)
+{
+	int i;
+
+	for (i = 0; i < n_files; i++)
+	{
+		GError *error = NULL;
+		gchar *contents;
+		gchar **lines;
+		guint64 records = 0, bytes = 0;
+		guint iterations = 0;
+		GTimer *timer;
+		gdouble elapsed;
+
+		if (! g_file_get_contents(filenames[i], &contents, NULL, &error))
+		{
+			fprintf(stderr, "%s\n", error->message);
+			g_error_free(error);
+			return 1;
+		}
+		lines = g_strsplit(contents, "\n", -1);
+		g_free(contents);
+
+		timer = g_timer_new();
+		do
+		{
+			gchar **line;
+
+			for (line = lines; *line; line++)
+			{
+				if (**line == '#' || **line == 0)
+					continue;
+				gdb_mi_record_free(gdb_mi_record_parse(*line));
+				records++;
+				bytes += strlen(*line);
+			}
+			iterations++;
+		}
+		while ((elapsed = g_timer_elapsed(timer, NULL)) < 1.0);
+		g_timer_destroy(timer);
+		g_strfreev(lines);
+
+		printf("%s: %u iterations, %" G_GUINT64_FORMAT " records in %.3f s: %.0f records/s, %.2f MiB/s\n",
+			filenames[i], iterations, records, elapsed,
+			records / elapsed, bytes / elapsed / (1024 * 1024));
+	}
+
+	return 0;
+}
+
+/* without arguments, dumps the records read from stdin;
+ * with --benchmark FILE..., measures the parsing speed of the transcripts */
 int main(int argc, char **argv)
 {
 	gchar *line;
 
+	if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+		return benchmark(argc - 2, argv + 2);
+
 	while ((line = read_line(stdin)) != NULL)
 	{
 		struct gdb_mi_record *record = gdb_mi_record_parse(line);
 
 		gdb_mi_record_dump(record);
+		gdb_mi_result_check_index(record->first);
 		gdb_mi_record_free(record);
 
 		g_free(line);
@@ -31,6 +31,8 @@ enum gdb_mi_value_type
 };
 
 struct gdb_mi_result;
+struct gdb_mi_index;
+struct gdb_mi_arena;
 struct gdb_mi_value
 {
 	enum gdb_mi_value_type type;
@@ -45,6 +47,7 @@ struct gdb_mi_result
 	gchar *var;
 	struct gdb_mi_value *val;
 	struct gdb_mi_result *next;
+	const struct gdb_mi_index *index; /*< name lookup table if first result of a big tuple */
 };
 
 enum gdb_mi_record_type
@@ -65,11 +68,10 @@ struct gdb_mi_record
 	gchar *token;
 	gchar *klass; /*< contains the async record class or the stream output */
 	struct gdb_mi_result *first; /*< pointer to the first result (if any) */
+	struct gdb_mi_arena *arena; /*< memory of the record, its results and strings */
 };
 
 
-void gdb_mi_value_free(struct gdb_mi_value *val);
-void gdb_mi_result_free(struct gdb_mi_result *res, gboolean next);
 void gdb_mi_record_free(struct gdb_mi_record *record);
 struct gdb_mi_record *gdb_mi_record_parse(const gchar *line);
 const void *gdb_mi_result_var(const struct gdb_mi_result *result, const gchar *name, enum gdb_mi_value_type type);
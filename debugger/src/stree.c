@@ -441,17 +441,35 @@ GtkWidget* stree_init(move_to_line_cb ml, select_thread_cb st, select_frame_cb s
 }
 
 /*
- *	add frames to the tree view
+ *	add frames to the tree view after the frames already there
  */
 void stree_add(GList *frames)
 {
-	GtkTreeIter thread_iter;
+	GtkTreeIter thread_iter, last_iter;
 	GList *item;
+	gint n;
+
+	find_thread_iter (active_thread_id, &thread_iter);
+
+	n = gtk_tree_model_iter_n_children(model, &thread_iter);
+	if (n && gtk_tree_model_iter_nth_child(model, &last_iter, &thread_iter, n - 1))
+	{
+		/* frames loaded on scrolling, the model is kept to keep the scroll position;
+		 * inserting after a known sibling doesn't have to look for the end */
+		for (item = frames; item; item = item->next)
+		{
+			GtkTreeIter iter;
+
+			gtk_tree_store_insert_after (store, &iter, &thread_iter, &last_iter);
+			gtk_tree_store_set (store, &iter, S_FRAME, item->data, -1);
+			last_iter = iter;
+		}
+		return;
+	}
 
 	g_object_ref (model);
 	gtk_tree_view_set_model (GTK_TREE_VIEW (tree), NULL);
 
-	find_thread_iter (active_thread_id, &thread_iter);
 	/* prepending is a *lot* faster than appending, so prepend with a reversed data set */
 	for (item = g_list_last (frames); item; item = item->prev)
 	{
@@ -463,6 +481,34 @@ void stree_add(GList *frames)
 	g_object_unref (model);
 }
 
+/*
+ *	checks whether the last frame of the active thread is scrolled into view
+ */
+gboolean stree_last_frame_visible(void)
+{
+	GtkTreeIter thread_iter;
+	GtkTreePath *start, *end, *last;
+	gboolean visible;
+	gint n;
+
+	if (! find_thread_iter (active_thread_id, &thread_iter) ||
+	    ! (n = gtk_tree_model_iter_n_children(model, &thread_iter)) ||
+	    ! gtk_tree_view_get_visible_range(GTK_TREE_VIEW(tree), &start, &end))
+	{
+		return FALSE;
+	}
+
+	last = gtk_tree_model_get_path(model, &thread_iter);
+	gtk_tree_path_append_index(last, n - 1);
+	visible = gtk_tree_path_compare(end, last) >= 0;
+
+	gtk_tree_path_free(last);
+	gtk_tree_path_free(start);
+	gtk_tree_path_free(end);
+
+	return visible;
+}
+
 /*
  *	clear tree view completely
  */
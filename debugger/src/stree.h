@@ -32,6 +32,7 @@ GtkWidget*		stree_init(move_to_line_cb ml, select_thread_cb st, select_frame_cb
 void			stree_destroy(void);
 
 void 			stree_add(GList *frames);
+gboolean		stree_last_frame_visible(void);
 void 			stree_clear(void);
 
 void 			stree_add_thread(int thread_id);
@@ -17,6 +17,10 @@ trap 'rm -f "$TMPOUT" "$TMPEXCPT";
       rmdir "$SUBDIR" 2>/dev/null || :' EXIT QUIT TERM INT
 
 test -d "$SUBDIR" || mkdir "$SUBDIR"
-strip_comments < "$srcdir/tests/gdb_mi_test.input" | ./gdb_mi_test 2> "$TMPOUT"
-strip_comments < "$srcdir/tests/gdb_mi_test.expected" > "$TMPEXCPT"
-diff -u "$TMPEXCPT" "$TMPOUT"
+# gdb_mi_test_large has tuples big enough to be indexed, some with duplicate
+# keys, records needing several arena blocks and deep nesting
+for test in gdb_mi_test gdb_mi_test_large; do
+  strip_comments < "$srcdir/tests/$test.input" | ./gdb_mi_test 2> "$TMPOUT"
+  strip_comments < "$srcdir/tests/$test.expected" > "$TMPEXCPT"
+  diff -u "$TMPEXCPT" "$TMPOUT"
+done
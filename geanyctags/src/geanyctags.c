@@ -26,6 +26,8 @@
 #include <geanyplugin.h>
 
 #include "readtags.h"
+#include "nameindex.h"
+#include "tagfiles.h"
 
 #include <errno.h>
 #include <glib/gstdio.h>
@@ -51,7 +53,7 @@ static GeanyData *geany_data = NULL;
 
 
 static GtkWidget *s_context_fdec_item, *s_context_fdef_item, *s_context_sep_item,
-	*s_gt_item, *s_sep_item, *s_ft_item;
+	*s_gt_item, *s_ut_item, *s_sep_item, *s_ft_item;
 
 static struct
 {
@@ -63,11 +65,94 @@ static struct
 	GtkWidget *declaration;
 } s_ft_dialog = {NULL, NULL, NULL, NULL, NULL};
 
+/* the tag file of the open project as seen by the last search, and its name
+ * index which is kept until the tag file changes */
+static struct
+{
+	gchar *filename;
+	GStatBuf stat;
+	gboolean foldsorted;
+	NameIndex *name_index;
+	gboolean name_index_failed;  /* don't retry generating the index */
+} s_tag_file = {NULL};
+
+/* generation of a missing name index in the background, see get_name_index() */
+static struct
+{
+	gchar *tag_filename;
+	GThread *thread;
+	gint finished;
+	gint cancelled;
+	NameIndex *name_index;  /* the result */
+	guint poll_source;
+} s_index_job = {NULL};
+
+/* pattern search whose results are added to the message window in batches */
+static struct
+{
+	guint source_id;
+	tagFile *file;
+	GPtrArray *names;  /* strings owned by s_tag_file.name_index */
+	guint next_name;
+	GPatternSpec *name_pat;
+	gboolean declaration;
+	gboolean case_sensitive;
+	gchar *base_path;
+	gchar *path;
+	gint num;
+	gint last_line_number;
+} s_search = {0, NULL};
+
+/* tag generation is split between this many ctags processes at most... */
+#define MAX_SHARDS 8
+/* ...each tagging at least this many files */
+#define MIN_SHARD_FILES 500
+/* how often the end of a background thread is checked (ms) */
+#define THREAD_POLL_INTERVAL 50
+
+static const gchar *s_ctags_options[] = {"--fields=fKsSt", "--extra=-fq", "--c-kinds=+p",
+	"--sort=foldcase", "--excmd=number", NULL};
+
+typedef struct TagGeneration TagGeneration;
+
+/* the running tag generation, see generate_tags() */
+struct TagGeneration
+{
+	gchar *tag_filename;
+	gchar *tmp_tag_filename;  /* replaces tag_filename when complete */
+	gchar *base_path;
+	gchar *locale_base_path;
+	gchar *tmp_dir;  /* contains the file lists and tag files of the shards */
+	gboolean incremental;
+
+	GPtrArray *files;  /* paths printed by find, relative to base_path */
+	GHashTable *mtimes;  /* path -> gint64 modification time */
+	GHashTable *stale_files;  /* files whose tags are removed from the old tag file */
+	guint tagged_files_num;
+	GPtrArray *shard_lists;
+	GPtrArray *shard_tags;
+	guint shards_finished;
+
+	GArray *pids;
+	guint children_running;
+	gboolean failed;
+
+	GThread *thread;
+	gint thread_finished;
+	gboolean thread_success;
+	void (*thread_done_cb)(TagGeneration *gen);
+	guint poll_source;
+	gint cancelled;
+};
+
+static TagGeneration *s_generation = NULL;
+
 
 enum
 {
 	KB_FIND_TAG,
 	KB_GENERATE_TAGS,
+	KB_UPDATE_TAGS,
 	KB_COUNT
 };
 
@@ -76,18 +161,74 @@ enum
 static void set_widgets_sensitive(gboolean sensitive)
 {
 	gtk_widget_set_sensitive(GTK_WIDGET(s_gt_item), sensitive);
+	gtk_widget_set_sensitive(GTK_WIDGET(s_ut_item), sensitive);
 	gtk_widget_set_sensitive(GTK_WIDGET(s_ft_item), sensitive);
 	gtk_widget_set_sensitive(GTK_WIDGET(s_context_fdec_item), sensitive);
 	gtk_widget_set_sensitive(GTK_WIDGET(s_context_fdef_item), sensitive);
 }
 
+static void cancel_search(void)
+{
+	if (s_search.source_id != 0)
+		g_source_remove(s_search.source_id);
+	s_search.source_id = 0;
+	if (s_search.file)
+		tagsClose(s_search.file);
+	s_search.file = NULL;
+	if (s_search.names)
+		g_ptr_array_free(s_search.names, TRUE);
+	s_search.names = NULL;
+	if (s_search.name_pat)
+		g_pattern_spec_free(s_search.name_pat);
+	s_search.name_pat = NULL;
+	g_free(s_search.base_path);
+	s_search.base_path = NULL;
+	g_free(s_search.path);
+	s_search.path = NULL;
+}
+
+static void cancel_index_job(void)
+{
+	if (!s_index_job.thread)
+		return;
+
+	g_atomic_int_set(&s_index_job.cancelled, TRUE);
+	g_thread_join(s_index_job.thread);
+	s_index_job.thread = NULL;
+	if (s_index_job.poll_source != 0)
+		g_source_remove(s_index_job.poll_source);
+	s_index_job.poll_source = 0;
+	name_index_free(s_index_job.name_index);
+	s_index_job.name_index = NULL;
+	g_free(s_index_job.tag_filename);
+	s_index_job.tag_filename = NULL;
+}
+
+static void close_tag_file(void)
+{
+	/* the running search reads the tag file and the name index */
+	cancel_search();
+	cancel_index_job();
+	g_free(s_tag_file.filename);
+	s_tag_file.filename = NULL;
+	name_index_free(s_tag_file.name_index);
+	s_tag_file.name_index = NULL;
+	s_tag_file.name_index_failed = FALSE;
+}
+
+static void cancel_generation(void);
+
 static void on_project_open(G_GNUC_UNUSED GObject * obj, GKeyFile * config, G_GNUC_UNUSED gpointer user_data)
 {
+	cancel_generation();
+	close_tag_file();
 	set_widgets_sensitive(TRUE);
 }
 
 static void on_project_close(G_GNUC_UNUSED GObject * obj, G_GNUC_UNUSED gpointer user_data)
 {
+	cancel_generation();
+	close_tag_file();
 	set_widgets_sensitive(FALSE);
 }
 
@@ -108,97 +249,146 @@ static void plugin_geanyctags_help (G_GNUC_UNUSED GeanyPlugin *plugin, G_GNUC_UN
 	utils_open_browser("https://plugins.geany.org/geanyctags.html");
 }
 
-static void spawn_cmd(const gchar *cmd, const gchar *dir)
+static gchar *get_tags_filename(void)
 {
-	GError *error = NULL;
-	gchar **argv = NULL;
-	gchar *working_dir;
-	gchar *utf8_working_dir;
-	gchar *utf8_cmd_string;
-	gchar *out;
-	gint exitcode;
-	gboolean success;
-	GString *output;
+	gchar *ret = NULL;
 
-#ifndef G_OS_WIN32
-	/* run within shell so we can use pipes */
-	argv = g_new0(gchar *, 4);
-	argv[0] = g_strdup("/bin/sh");
-	argv[1] = g_strdup("-c");
-	argv[2] = g_strdup(cmd);
-	argv[3] = NULL;
-#endif
+	if (geany_data->app->project)
+	{
+		ret = utils_remove_ext_from_filename(geany_data->app->project->file_name);
+		SETPTR(ret, g_strconcat(ret, ".tags", NULL));
+	}
+	return ret;
+}
 
-	utf8_cmd_string = utils_get_utf8_from_locale(cmd);
-	utf8_working_dir = g_strdup(dir);
-	working_dir = utils_get_locale_from_utf8(utf8_working_dir);
+/* Opens the tag file of the project for a single search, dropping the name
+ * index if the file changed since the last search. readtags maps the file into
+ * memory, so the file is only kept open while being searched: a mapping kept
+ * between searches would crash on access once the file gets truncated or
+ * rewritten in place by another program. The returned file must be closed
+ * with tagsClose(). */
+static tagFile *open_tag_file(void)
+{
+	gchar *tag_filename = get_tags_filename();
+	tagFileInfo info;
+	tagFile *tf;
+	GStatBuf st;
 
-	msgwin_clear_tab(MSG_MESSAGE);
-	msgwin_switch_tab(MSG_MESSAGE, TRUE);
-	msgwin_msg_add(COLOR_BLUE, -1, NULL, _("%s (in directory: %s)"), utf8_cmd_string, utf8_working_dir);
-	g_free(utf8_working_dir);
-	g_free(utf8_cmd_string);
+	if (!tag_filename || g_stat(tag_filename, &st) != 0)
+	{
+		close_tag_file();
+		g_free(tag_filename);
+		return NULL;
+	}
 
-	output = g_string_new(NULL);
-#ifndef G_OS_WIN32
-	success = spawn_sync(working_dir, NULL, argv, NULL,
-			NULL, NULL, output, &exitcode, &error);
-#else
-	success = spawn_sync(working_dir, cmd, NULL, NULL,
-			NULL, output, NULL, &exitcode, &error);
-#endif
-	out = g_string_free(output, FALSE);
-	if (!success || exitcode != 0)
+	if (!s_tag_file.filename || g_strcmp0(tag_filename, s_tag_file.filename) != 0 ||
+		st.st_mtime != s_tag_file.stat.st_mtime || st.st_size != s_tag_file.stat.st_size ||
+		st.st_ino != s_tag_file.stat.st_ino)
 	{
-		if (error != NULL)
-		{
-			msgwin_msg_add(COLOR_RED, -1, NULL, _("Process execution failed (%s)"), error->message);
-			g_error_free(error);
-		}
-		msgwin_msg_add(COLOR_RED, -1, NULL, "%s", out);
+		close_tag_file();
+	}
+
+	tf = tagsOpen(tag_filename, &info);
+	if (tf && !s_tag_file.filename)
+	{
+		s_tag_file.filename = tag_filename;
+		s_tag_file.stat = st;
+		s_tag_file.foldsorted = info.file.sort == TAG_FOLDSORTED;
 	}
 	else
+		g_free(tag_filename);
+
+	return tf;
+}
+
+static gpointer index_thread(gpointer user_data)
+{
+	if (name_index_generate(s_index_job.tag_filename, &s_index_job.cancelled) &&
+		!g_atomic_int_get(&s_index_job.cancelled))
 	{
-		msgwin_msg_add(COLOR_BLACK, -1, NULL, "%s", out);
+		s_index_job.name_index = name_index_load(s_index_job.tag_filename);
 	}
 
-	/* cppcheck-suppress mismatchAllocDealloc symbolName=argv
-	 * argv is built manually, but is a valid GStrv */
-	g_strfreev(argv);
-	g_free(working_dir);
-	g_free(out);
+	g_atomic_int_set(&s_index_job.finished, TRUE);
+	return NULL;
 }
 
-static gchar *get_tags_filename(void)
+static gboolean poll_index_thread(gpointer user_data)
 {
-	gchar *ret = NULL;
+	if (!g_atomic_int_get(&s_index_job.finished))
+		return TRUE;
 
-	if (geany_data->app->project)
+	g_thread_join(s_index_job.thread);
+	s_index_job.thread = NULL;
+	s_index_job.poll_source = 0;
+
+	/* the job is cancelled when the tag file changes so the index is current */
+	s_tag_file.name_index = s_index_job.name_index;
+	s_tag_file.name_index_failed = s_index_job.name_index == NULL;
+	s_index_job.name_index = NULL;
+	g_free(s_index_job.tag_filename);
+	s_index_job.tag_filename = NULL;
+
+	return FALSE;
+}
+
+/* Returns the name index of the tag file opened by open_tag_file(), or NULL
+ * if the index doesn't exist yet, in which case it is generated in the
+ * background and the tag file has to be searched sequentially until it is
+ * ready. The index is only usable with foldcase-sorted tag files where all
+ * variants of a name can be found using binary search. */
+static NameIndex *get_name_index(void)
+{
+	if (!s_tag_file.filename || !s_tag_file.foldsorted)
+		return NULL;
+
+	if (!s_tag_file.name_index)
+		s_tag_file.name_index = name_index_load(s_tag_file.filename);
+
+	if (!s_tag_file.name_index && !s_tag_file.name_index_failed && !s_index_job.thread)
 	{
-		ret = utils_remove_ext_from_filename(geany_data->app->project->file_name);
-		SETPTR(ret, g_strconcat(ret, ".tags", NULL));
+		s_index_job.tag_filename = g_strdup(s_tag_file.filename);
+		s_index_job.finished = FALSE;
+		s_index_job.cancelled = FALSE;
+		s_index_job.thread = g_thread_new("geanyctags", index_thread, NULL);
+		s_index_job.poll_source = plugin_timeout_add(geany_plugin, THREAD_POLL_INTERVAL,
+			poll_index_thread, NULL);
 	}
-	return ret;
+
+	return s_tag_file.name_index;
 }
 
-static gchar *generate_find_string(GeanyProject *prj)
+static gchar **get_find_argv(GeanyProject *prj)
 {
-	gchar *ret;
+	GPtrArray *argv = g_ptr_array_new();
 
-	ret = g_strdup("find -L . -not -path '*/\\.*' -type f");
+	g_ptr_array_add(argv, g_strdup("find"));
+	g_ptr_array_add(argv, g_strdup("-L"));
+	g_ptr_array_add(argv, g_strdup("."));
+	g_ptr_array_add(argv, g_strdup("-not"));
+	g_ptr_array_add(argv, g_strdup("-path"));
+	g_ptr_array_add(argv, g_strdup("*/.*"));
+	g_ptr_array_add(argv, g_strdup("-type"));
+	g_ptr_array_add(argv, g_strdup("f"));
 
 	if (!EMPTY(prj->file_patterns))
 	{
 		guint i;
 
-		SETPTR(ret, g_strconcat(ret, " \\( -name \"", prj->file_patterns[0], "\"", NULL));
-		for (i = 1; prj->file_patterns[i]; i++)
-			SETPTR(ret, g_strconcat(ret, " -o -name \"", prj->file_patterns[i], "\"", NULL));
-		SETPTR(ret, g_strconcat(ret, " \\)", NULL));
+		g_ptr_array_add(argv, g_strdup("("));
+		for (i = 0; prj->file_patterns[i]; i++)
+		{
+			if (i > 0)
+				g_ptr_array_add(argv, g_strdup("-o"));
+			g_ptr_array_add(argv, g_strdup("-name"));
+			g_ptr_array_add(argv, g_strdup(prj->file_patterns[i]));
+		}
+		g_ptr_array_add(argv, g_strdup(")"));
 	}
-	return ret;
-}
+	g_ptr_array_add(argv, NULL);
 
+	return (gchar **)g_ptr_array_free(argv, FALSE);
+}
 
 static gchar *get_base_path(void)
 {
@@ -218,46 +408,495 @@ static gchar *get_base_path(void)
 	return ret;
 }
 
+static gint get_shards_num(guint files_num)
+{
+	gint max_shards = CLAMP(g_get_num_processors(), 1, MAX_SHARDS);
+
+	return CLAMP((files_num + MIN_SHARD_FILES - 1) / MIN_SHARD_FILES, 1, max_shards);
+}
+
+static void generation_free(TagGeneration *gen)
+{
+	guint i;
+
+	for (i = 0; i < gen->shard_lists->len; i++)
+		g_unlink(gen->shard_lists->pdata[i]);
+	for (i = 0; i < gen->shard_tags->len; i++)
+		g_unlink(gen->shard_tags->pdata[i]);
+	if (gen->tmp_dir)
+		g_rmdir(gen->tmp_dir);
+	tag_files_remove(gen->tmp_tag_filename);
+
+	g_ptr_array_free(gen->files, TRUE);
+	g_ptr_array_free(gen->shard_lists, TRUE);
+	g_ptr_array_free(gen->shard_tags, TRUE);
+	g_array_free(gen->pids, TRUE);
+	if (gen->mtimes)
+		g_hash_table_destroy(gen->mtimes);
+	if (gen->stale_files)
+		g_hash_table_destroy(gen->stale_files);
+	g_free(gen->tag_filename);
+	g_free(gen->tmp_tag_filename);
+	g_free(gen->base_path);
+	g_free(gen->locale_base_path);
+	g_free(gen->tmp_dir);
+	g_free(gen);
+}
+
+/* must only be called when no process or thread of the generation runs */
+static void finish_generation(TagGeneration *gen, gboolean success)
+{
+	if (!success)
+		msgwin_msg_add(COLOR_RED, -1, NULL, _("Tag generation failed"));
+
+	ui_progress_bar_stop();
+	s_generation = NULL;
+	generation_free(gen);
+}
+
+static void cancel_generation(void)
+{
+	TagGeneration *gen = s_generation;
+	guint i;
+
+	if (!gen)
+		return;
+
+	s_generation = NULL;
+	g_atomic_int_set(&gen->cancelled, TRUE);
+	if (gen->thread)
+		g_thread_join(gen->thread);
+	gen->thread = NULL;
+	if (gen->poll_source != 0)
+		g_source_remove(gen->poll_source);
+	gen->poll_source = 0;
+	for (i = 0; i < gen->pids->len; i++)
+		spawn_kill_process(g_array_index(gen->pids, GPid, i), NULL);
+	ui_progress_bar_stop();
+
+	/* otherwise freed once the last process exits */
+	if (gen->children_running == 0)
+		generation_free(gen);
+}
+
+static gboolean poll_thread(gpointer user_data)
+{
+	TagGeneration *gen = user_data;
+
+	if (!g_atomic_int_get(&gen->thread_finished))
+		return TRUE;
+
+	g_thread_join(gen->thread);
+	gen->thread = NULL;
+	gen->poll_source = 0;
+	gen->thread_done_cb(gen);
+
+	return FALSE;
+}
+
+static void start_thread(TagGeneration *gen, GThreadFunc func, void (*done_cb)(TagGeneration *gen))
+{
+	gen->thread_finished = FALSE;
+	gen->thread_done_cb = done_cb;
+	gen->thread = g_thread_new("geanyctags", func, gen);
+	gen->poll_source = plugin_timeout_add(geany_plugin, THREAD_POLL_INTERVAL, poll_thread, gen);
+}
+
+/* Returns FALSE if the generation was cancelled and must not continue */
+static gboolean child_exited(TagGeneration *gen, GPid pid)
+{
+	guint i;
+
+	for (i = 0; i < gen->pids->len; i++)
+	{
+		if (g_array_index(gen->pids, GPid, i) == pid)
+		{
+			g_array_remove_index_fast(gen->pids, i);
+			break;
+		}
+	}
+	gen->children_running--;
+
+	if (g_atomic_int_get(&gen->cancelled))
+	{
+		if (gen->children_running == 0)
+			generation_free(gen);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static gchar *get_output_line(GString *string)
+{
+	gsize len = string->len;
+
+	while (len > 0 && (string->str[len - 1] == '\n' || string->str[len - 1] == '\r'))
+		len--;
+	return len > 0 ? g_strndup(string->str, len) : NULL;
+}
+
+static void on_child_error_output(GString *string, GIOCondition condition, gpointer user_data)
+{
+	TagGeneration *gen = user_data;
+	gchar *line;
+
+	if (!(condition & (G_IO_IN | G_IO_PRI)) || g_atomic_int_get(&gen->cancelled))
+		return;
+
+	line = get_output_line(string);
+	if (line)
+	{
+		SETPTR(line, utils_get_utf8_from_locale(line));
+		msgwin_msg_add(COLOR_BLACK, -1, NULL, "%s", line);
+	}
+	g_free(line);
+}
+
+static gboolean spawn_child(TagGeneration *gen, const gchar *command_line, gchar **argv,
+	SpawnReadFunc stdout_cb, GChildWatchFunc exit_cb)
+{
+	GError *error = NULL;
+	GPid pid;
+
+	if (!spawn_with_callbacks(gen->locale_base_path, command_line, argv, NULL,
+			SPAWN_STDOUT_RECURSIVE | SPAWN_STDERR_RECURSIVE, NULL, NULL,
+			stdout_cb, gen, 0, on_child_error_output, gen, 0, exit_cb, gen, &pid, &error))
+	{
+		msgwin_msg_add(COLOR_RED, -1, NULL, _("Process execution failed (%s)"), error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	g_array_append_val(gen->pids, pid);
+	gen->children_running++;
+	return TRUE;
+}
+
+static void on_merge_done(TagGeneration *gen)
+{
+	if (!gen->thread_success)
+	{
+		finish_generation(gen, FALSE);
+		return;
+	}
+
+	/* the old tag file must not be searched while replaced */
+	close_tag_file();
+	if (!tag_files_rename(gen->tmp_tag_filename, gen->tag_filename))
+	{
+		msgwin_msg_add(COLOR_RED, -1, NULL, _("Cannot write %s"), gen->tag_filename);
+		finish_generation(gen, FALSE);
+		return;
+	}
+
+	if (gen->incremental)
+		msgwin_msg_add(COLOR_BLUE, -1, NULL,
+			g_dngettext(GETTEXT_PACKAGE, "Tags updated (%u changed file)",
+				"Tags updated (%u changed files)", gen->tagged_files_num),
+			gen->tagged_files_num);
+	else
+		msgwin_msg_add(COLOR_BLUE, -1, NULL, _("Tags generated"));
+	finish_generation(gen, TRUE);
+}
 
-static void
-on_generate_tags(GtkMenuItem *menuitem, gpointer user_data)
+static gpointer merge_thread(gpointer user_data)
 {
+	TagGeneration *gen = user_data;
+	gboolean success;
+
+	success = tag_files_merge(gen->tmp_tag_filename, gen->incremental ? gen->tag_filename : NULL,
+		gen->stale_files, gen->shard_tags, &gen->cancelled);
+	if (success && gen->mtimes && !g_atomic_int_get(&gen->cancelled))
+		success = tag_files_save_mtimes(gen->tmp_tag_filename, gen->mtimes);
+	if (success && !g_atomic_int_get(&gen->cancelled))
+		success = name_index_generate(gen->tmp_tag_filename, &gen->cancelled);
+
+	gen->thread_success = success;
+	g_atomic_int_set(&gen->thread_finished, TRUE);
+	return NULL;
+}
+
+static void on_ctags_exit(GPid pid, gint status, gpointer user_data)
+{
+	TagGeneration *gen = user_data;
+
+	if (!child_exited(gen, pid))
+		return;
+
+	if (!SPAWN_WIFEXITED(status) || SPAWN_WEXITSTATUS(status) != 0)
+		gen->failed = TRUE;
+	gen->shards_finished++;
+	msgwin_msg_add(COLOR_BLACK, -1, NULL, _("ctags process %u of %u finished"),
+		gen->shards_finished, gen->shard_tags->len);
+
+	if (gen->children_running > 0)
+		return;
+
+	if (gen->failed)
+		finish_generation(gen, FALSE);
+	else
+	{
+		msgwin_msg_add(COLOR_BLACK, -1, NULL, _("Merging tags"));
+		start_thread(gen, merge_thread, on_merge_done);
+	}
+}
+
+static void on_prepare_done(TagGeneration *gen)
+{
+	guint i;
+
+	if (!gen->thread_success)
+	{
+		finish_generation(gen, FALSE);
+		return;
+	}
+
+	if (gen->incremental && gen->shard_lists->len == 0 && g_hash_table_size(gen->stale_files) == 0)
+	{
+		msgwin_msg_add(COLOR_BLUE, -1, NULL, _("Tags are up to date"));
+		finish_generation(gen, TRUE);
+		return;
+	}
+
+	if (!gen->incremental && gen->tagged_files_num == 0)
+	{
+		msgwin_msg_add(COLOR_RED, -1, NULL, _("No project files found"));
+		finish_generation(gen, FALSE);
+		return;
+	}
+
+	msgwin_msg_add(COLOR_BLACK, -1, NULL,
+		g_dngettext(GETTEXT_PACKAGE, "Tagging %u file using %u ctags processes",
+			"Tagging %u files using %u ctags processes", gen->tagged_files_num),
+		gen->tagged_files_num, gen->shard_lists->len);
+
+	for (i = 0; i < gen->shard_lists->len; i++)
+	{
+		GPtrArray *argv = g_ptr_array_new();
+		guint j;
+
+		g_ptr_array_add(argv, "ctags");
+		for (j = 0; s_ctags_options[j]; j++)
+			g_ptr_array_add(argv, (gpointer)s_ctags_options[j]);
+		g_ptr_array_add(argv, "-L");
+		g_ptr_array_add(argv, gen->shard_lists->pdata[i]);
+		g_ptr_array_add(argv, "-f");
+		g_ptr_array_add(argv, gen->shard_tags->pdata[i]);
+		g_ptr_array_add(argv, NULL);
+
+		if (!spawn_child(gen, NULL, (gchar **)argv->pdata, NULL, on_ctags_exit))
+			gen->failed = TRUE;
+		g_ptr_array_free(argv, TRUE);
+	}
+
+	if (gen->children_running == 0)
+	{
+		if (gen->failed)
+			finish_generation(gen, FALSE);
+		else  /* only removed files */
+			start_thread(gen, merge_thread, on_merge_done);
+	}
+}
+
+/* Splits the files into lists used by the separate ctags processes */
+static gboolean write_shard_lists(TagGeneration *gen, GPtrArray *files)
+{
+	gint shards_num = files->len > 0 ? get_shards_num(files->len) : 0;
+	guint first = 0;
+	gint i;
+
+	for (i = 0; i < shards_num; i++)
+	{
+		guint last = files->len * (i + 1) / shards_num;
+		gchar *name = g_strdup_printf("%d.list", i);
+		gchar *list_filename = g_build_filename(gen->tmp_dir, name, NULL);
+		GString *contents = g_string_new(NULL);
+		guint j;
+
+		for (j = first; j < last; j++)
+		{
+			g_string_append(contents, files->pdata[j]);
+			g_string_append_c(contents, '\n');
+		}
+		first = last;
+
+		g_ptr_array_add(gen->shard_lists, list_filename);
+		SETPTR(name, g_strdup_printf("%d.tags", i));
+		g_ptr_array_add(gen->shard_tags, g_build_filename(gen->tmp_dir, name, NULL));
+		g_free(name);
+
+		if (!g_file_set_contents(list_filename, contents->str, contents->len, NULL))
+		{
+			g_string_free(contents, TRUE);
+			return FALSE;
+		}
+		g_string_free(contents, TRUE);
+	}
+
+	return TRUE;
+}
+
+static gpointer prepare_thread(gpointer user_data)
+{
+	TagGeneration *gen = user_data;
+	GHashTable *old_mtimes = NULL;
+	GPtrArray *files;
+
+	gen->mtimes = tag_files_get_mtimes(gen->locale_base_path, gen->files, &gen->cancelled);
+	if (g_atomic_int_get(&gen->cancelled))
+	{
+		g_atomic_int_set(&gen->thread_finished, TRUE);
+		return NULL;
+	}
+
+	if (gen->incremental && g_file_test(gen->tag_filename, G_FILE_TEST_IS_REGULAR))
+		old_mtimes = tag_files_load_mtimes(gen->tag_filename);
+
+	if (old_mtimes)
+	{
+		gen->stale_files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+		files = tag_files_get_changed(gen->files, gen->mtimes, old_mtimes, gen->stale_files);
+		g_hash_table_destroy(old_mtimes);
+	}
+	else
+	{
+		guint i;
+
+		gen->incremental = FALSE;
+		files = g_ptr_array_new();
+		for (i = 0; i < gen->files->len; i++)
+		{
+			if (g_hash_table_contains(gen->mtimes, gen->files->pdata[i]))
+				g_ptr_array_add(files, gen->files->pdata[i]);
+		}
+	}
+
+	gen->tagged_files_num = files->len;
+	gen->thread_success = write_shard_lists(gen, files);
+	g_ptr_array_free(files, TRUE);
+
+	g_atomic_int_set(&gen->thread_finished, TRUE);
+	return NULL;
+}
+
+static void on_find_output(GString *string, GIOCondition condition, gpointer user_data)
+{
+	TagGeneration *gen = user_data;
+	gchar *path;
+
+	if (!(condition & (G_IO_IN | G_IO_PRI)))
+		return;
+
+	path = get_output_line(string);
+	if (path)
+		g_ptr_array_add(gen->files, path);
+}
+
+static void on_find_exit(GPid pid, gint status, gpointer user_data)
+{
+	TagGeneration *gen = user_data;
+
+	if (!child_exited(gen, pid))
+		return;
+
+	/* find also fails because of unreadable directories or broken links which
+	 * are reported in the message window and don't prevent tag generation */
+	if (!SPAWN_WIFEXITED(status))
+	{
+		finish_generation(gen, FALSE);
+		return;
+	}
+
+	if (gen->incremental)
+		msgwin_msg_add(COLOR_BLACK, -1, NULL, _("Checking %u files for changes"), gen->files->len);
+	start_thread(gen, prepare_thread, on_prepare_done);
+}
+
+/* Tags are generated asynchronously in several steps:
+ *  1. find lists the project files
+ *  2. a thread compares their modification times with the previous run (when
+ *     only updating tags of changed files) and splits them into shards
+ *  3. the shards are tagged by parallel ctags processes
+ *  4. a thread merges the sorted outputs (and the tags of unchanged files)
+ *     into a new tag file which then replaces the old one */
+static void generate_tags(gboolean incremental)
+{
+	TagGeneration *gen;
 	GeanyProject *prj;
+	GError *error = NULL;
+	gchar *tmp_dir;
 
 	prj = geany_data->app->project;
-	if (prj)
+	if (!prj)
+		return;
+
+	if (s_generation)
+	{
+		ui_set_statusbar(FALSE, _("Tags are being generated"));
+		return;
+	}
+
+	tmp_dir = g_dir_make_tmp("geanyctags-XXXXXX", &error);
+	if (!tmp_dir)
 	{
-		gchar *cmd;
-		gchar *tag_filename;
-		gchar *base_path;
+		msgwin_msg_add(COLOR_RED, -1, NULL, _("Cannot create temporary directory (%s)"), error->message);
+		g_error_free(error);
+		return;
+	}
+
+	gen = g_new0(TagGeneration, 1);
+	gen->tag_filename = get_tags_filename();
+	gen->tmp_tag_filename = g_strconcat(gen->tag_filename, ".tmp", NULL);
+	gen->base_path = get_base_path();
+	gen->locale_base_path = utils_get_locale_from_utf8(gen->base_path);
+	gen->tmp_dir = tmp_dir;
+	gen->incremental = incremental;
+	gen->files = g_ptr_array_new_with_free_func(g_free);
+	gen->shard_lists = g_ptr_array_new_with_free_func(g_free);
+	gen->shard_tags = g_ptr_array_new_with_free_func(g_free);
+	gen->pids = g_array_new(FALSE, FALSE, sizeof(GPid));
+	s_generation = gen;
 
-		tag_filename = get_tags_filename();
+	msgwin_clear_tab(MSG_MESSAGE);
+	msgwin_switch_tab(MSG_MESSAGE, TRUE);
+	ui_progress_bar_start(_("Generating tags"));
 
 #ifndef G_OS_WIN32
-		gchar *find_string = generate_find_string(prj);
-		cmd = g_strconcat(find_string,
-			" | ctags --totals --fields=fKsSt --extra=-fq --c-kinds=+p --sort=foldcase --excmd=number -L - -f '",
-			tag_filename, "'", NULL);
-		g_free(find_string);
+	{
+		gchar **argv = get_find_argv(prj);
+
+		msgwin_msg_add(COLOR_BLUE, -1, NULL, _("Listing project files (in directory: %s)"), gen->base_path);
+		if (!spawn_child(gen, NULL, argv, on_find_output, on_find_exit))
+			finish_generation(gen, FALSE);
+		g_strfreev(argv);
+	}
 #else
-		/* We don't have find and | on windows, generate tags for all files in the project (-R recursively) */
-		
-		/* Unfortunately, there's a bug in ctags - when run with -R, the first line is
-		 * empty, ctags doesn't recognize the tags file as a valid ctags file and
-		 * refuses to overwrite it. Therefore, we need to delete the tags file manually. */
-		g_unlink(tag_filename);
-
-		cmd = g_strconcat("ctags.exe -R --totals --fields=fKsSt --extra=-fq --c-kinds=+p --sort=foldcase --excmd=number -f \"",
-			tag_filename, "\"", NULL);
+	{
+		/* We don't have find on windows, generate tags for all files in the
+		 * project (-R recursively) using a single ctags process */
+		gchar *options = g_strjoinv(" ", (gchar **)s_ctags_options);
+		gchar *shard_tags = g_build_filename(gen->tmp_dir, "0.tags", NULL);
+		gchar *cmd = g_strconcat("ctags.exe -R ", options, " -f \"", shard_tags, "\"", NULL);
+
+		gen->incremental = FALSE;
+		g_ptr_array_add(gen->shard_tags, shard_tags);
+		msgwin_msg_add(COLOR_BLUE, -1, NULL, _("%s (in directory: %s)"), cmd, gen->base_path);
+		if (!spawn_child(gen, cmd, NULL, NULL, on_ctags_exit))
+			finish_generation(gen, FALSE);
+		g_free(options);
+		g_free(cmd);
+	}
 #endif
+}
 
-		base_path = get_base_path();
-		spawn_cmd(cmd, base_path);
+static void on_generate_tags(GtkMenuItem *menuitem, gpointer user_data)
+{
+	generate_tags(FALSE);
+}
 
-		g_free(cmd);
-		g_free(tag_filename);
-		g_free(base_path);
-	}
+static void on_update_tags(GtkMenuItem *menuitem, gpointer user_data)
+{
+	generate_tags(TRUE);
 }
 
 static void show_entry(tagEntry *entry)
@@ -428,87 +1067,124 @@ static gboolean filter_tag(tagEntry *entry, GPatternSpec *name, gboolean declara
 	return filter;
 }
 
+static GPatternSpec *create_name_pattern(const gchar *name, gboolean case_sensitive)
+{
+	GPatternSpec *name_pat;
+	gchar *name_case;
+
+	if (case_sensitive)
+		name_case = g_strdup(name);
+	else
+		name_case = g_utf8_strdown(name, -1);
+
+	SETPTR(name_case, g_strconcat("*", name_case, "*", NULL));
+	name_pat = g_pattern_spec_new(name_case);
+	g_free(name_case);
+
+	return name_pat;
+}
+
+static void add_search_result(tagEntry *entry)
+{
+	if (filter_tag(entry, s_search.name_pat, s_search.declaration, s_search.case_sensitive))
+		return;
+
+	if (!s_search.path)
+		s_search.path = g_build_filename(s_search.base_path, entry->file, NULL);
+	show_entry(entry);
+	s_search.last_line_number = entry->address.lineNumber;
+	s_search.num++;
+}
+
+static void finish_search(void)
+{
+	if (s_search.num == 1)
+	{
+		GeanyDocument *old_doc = document_get_current();
+		GeanyDocument *doc = document_open_file(s_search.path, FALSE, NULL, NULL);
+		if (doc != NULL)
+		{
+			navqueue_goto_line(old_doc, doc, s_search.last_line_number);
+			gtk_widget_grab_focus(GTK_WIDGET(doc->editor->sci));
+		}
+	}
+
+	cancel_search();
+}
+
+/* Looks up the entries of the names found in the name index for a while and
+ * returns so the results appear while the search is still running */
+static gboolean search_names(gpointer user_data)
+{
+	gint64 end_time = g_get_monotonic_time() + 20 * G_TIME_SPAN_MILLISECOND;
+	tagEntry entry;
+
+	while (s_search.next_name < s_search.names->len && g_get_monotonic_time() < end_time)
+	{
+		const gchar *name = s_search.names->pdata[s_search.next_name++];
+
+		if (tagsFind(s_search.file, &entry, name, TAG_FULLMATCH | TAG_IGNORECASE) != TagSuccess)
+			continue;
+		do
+			add_search_result(&entry);
+		while (tagsFindNext(s_search.file, &entry) == TagSuccess);
+	}
+
+	if (s_search.next_name < s_search.names->len)
+		return TRUE;
+
+	s_search.source_id = 0;
+	finish_search();
+	return FALSE;
+}
+
 static void find_tags(const gchar *name, gboolean declaration, gboolean case_sensitive, MatchType match_type)
 {
 	tagFile *tf;
+	NameIndex *index;
 	GeanyProject *prj;
-	gchar *tag_filename = NULL;
-	gchar *base_path;
 	tagEntry entry;
-	tagFileInfo info;
-	int last_line_number = 0;
 
 	prj = geany_data->app->project;
 	if (!prj)
 		return;
 
-	base_path = get_base_path();
-	msgwin_clear_tab(MSG_MESSAGE);
-	msgwin_set_messages_dir(base_path);
+	cancel_search();
+	tf = open_tag_file();
 
-	tag_filename = get_tags_filename();
-	tf = tagsOpen(tag_filename, &info);
+	s_search.base_path = get_base_path();
+	s_search.name_pat = create_name_pattern(name, case_sensitive);
+	s_search.declaration = declaration;
+	s_search.case_sensitive = case_sensitive;
+	s_search.num = 0;
+	s_search.last_line_number = 0;
+
+	msgwin_clear_tab(MSG_MESSAGE);
+	msgwin_set_messages_dir(s_search.base_path);
 
-	if (tf)
+	if (tf && match_type == MATCH_PATTERN && (index = get_name_index()) != NULL)
 	{
-		if (find_first(tf, &entry, name, match_type))
+		/* instead of checking every entry of the tag file, only the entries
+		 * of names matching the pattern are looked up */
+		s_search.file = tf;
+		s_search.names = name_index_find(index, name);
+		s_search.next_name = 0;
+		s_search.source_id = plugin_idle_add(geany_plugin, search_names, NULL);
+	}
+	else
+	{
+		if (tf && find_first(tf, &entry, name, match_type))
 		{
-			GPatternSpec *name_pat;
-			gchar *name_case;
-			gchar *path = NULL; 
-			gint num = 0;
-
-			if (case_sensitive)
-				name_case = g_strdup(name);
-			else
-				name_case = g_utf8_strdown(name, -1);
-
-			SETPTR(name_case, g_strconcat("*", name_case, "*", NULL));
-			name_pat = g_pattern_spec_new(name_case);
-
-			if (!filter_tag(&entry, name_pat, declaration, case_sensitive))
-			{
-				path = g_build_filename(base_path, entry.file, NULL);
-				show_entry(&entry);
-				last_line_number = entry.address.lineNumber;
-				num++;
-			}
-			
-			while (find_next(tf, &entry, match_type))
-			{
-				if (!filter_tag(&entry, name_pat, declaration, case_sensitive))
-				{
-					if (!path)
-						path = g_build_filename(base_path, entry.file, NULL);
-					show_entry(&entry);
-					last_line_number = entry.address.lineNumber;
-					num++;
-				}
-			}
-			
-			if (num == 1)
-			{
-				GeanyDocument *old_doc = document_get_current();
-				GeanyDocument *doc = document_open_file(path, FALSE, NULL, NULL);
-				if (doc != NULL)
-				{
-					navqueue_goto_line(old_doc, doc, last_line_number);
-					gtk_widget_grab_focus(GTK_WIDGET(doc->editor->sci));
-				}
-			}
-
-			g_pattern_spec_free(name_pat);
-			g_free(name_case);
-			g_free(path);
+			do
+				add_search_result(&entry);
+			while (find_next(tf, &entry, match_type));
 		}
-
-		tagsClose(tf);
+		if (tf)
+			tagsClose(tf);
+		finish_search();
 	}
 
 	msgwin_switch_tab(MSG_MESSAGE, TRUE);
-
-	g_free(tag_filename);
-	g_free(base_path);
 }
 
 static void on_find_declaration(GtkMenuItem *menuitem, gpointer user_data)
@@ -643,6 +1319,9 @@ static gboolean kb_callback(guint key_id)
 		case KB_GENERATE_TAGS:
 			on_generate_tags(NULL, NULL);
 			return TRUE;
+		case KB_UPDATE_TAGS:
+			on_update_tags(NULL, NULL);
+			return TRUE;
 	}
 	return FALSE;
 }
@@ -654,6 +1333,9 @@ static gboolean plugin_geanyctags_init(GeanyPlugin *plugin, G_GNUC_UNUSED gpoint
 	geany_plugin = plugin;
 	geany_data = plugin->geany_data;
 
+	/* callbacks of ctags processes running during unload must stay valid */
+	plugin_module_make_resident(geany_plugin);
+
 	key_group = plugin_set_key_group(geany_plugin, "GeanyCtags", KB_COUNT, kb_callback);
 
 	s_context_sep_item = gtk_separator_menu_item_new();
@@ -681,6 +1363,13 @@ static gboolean plugin_geanyctags_init(GeanyPlugin *plugin, G_GNUC_UNUSED gpoint
 	keybindings_set_item(key_group, KB_GENERATE_TAGS, NULL,
 		0, 0, "generate_tags", _("Generate tags"), s_gt_item);
 
+	s_ut_item = gtk_menu_item_new_with_mnemonic(_("Update tags of changed files"));
+	gtk_widget_show(s_ut_item);
+	gtk_container_add(GTK_CONTAINER(geany->main_widgets->project_menu), s_ut_item);
+	g_signal_connect((gpointer) s_ut_item, "activate", G_CALLBACK(on_update_tags), NULL);
+	keybindings_set_item(key_group, KB_UPDATE_TAGS, NULL,
+		0, 0, "update_tags", _("Update tags of changed files"), s_ut_item);
+
 	s_ft_item = gtk_menu_item_new_with_mnemonic(_("Find tag..."));
 	gtk_widget_show(s_ft_item);
 	gtk_container_add(GTK_CONTAINER(geany->main_widgets->project_menu), s_ft_item);
@@ -701,11 +1390,15 @@ static void plugin_geanyctags_cleanup(G_GNUC_UNUSED GeanyPlugin *plugin, G_GNUC_
 
 	gtk_widget_destroy(s_ft_item);
 	gtk_widget_destroy(s_gt_item);
+	gtk_widget_destroy(s_ut_item);
 	gtk_widget_destroy(s_sep_item);
 
 	if (s_ft_dialog.widget)
 		gtk_widget_destroy(s_ft_dialog.widget);
 	s_ft_dialog.widget = NULL;
+
+	cancel_generation();
+	close_tag_file();
 }
 
 
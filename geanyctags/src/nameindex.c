@@ -0,0 +1,373 @@
+/*
+ *	  Copyright 2026 The Geany contributors
+ *
+ *	  This program is free software; you can redistribute it and/or modify
+ *	  it under the terms of the GNU General Public License as published by
+ *	  the Free Software Foundation; either version 2 of the License, or
+ *	  (at your option) any later version.
+ *
+ *	  This program is distributed in the hope that it will be useful,
+ *	  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	  GNU General Public License for more details.
+ *
+ *	  You should have received a copy of the GNU General Public License
+ *	  along with this program; if not, write to the Free Software
+ *	  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * The name index file stores the sorted distinct names of a tag file, one per
+ * line, after a header containing the size and modification time of the tag
+ * file it was generated from. The names are lowercased the same way readtags
+ * folds case (ASCII only) so every name can be looked up in the tag file.
+ * When loaded, a map from every trigram of the UTF-8 lowercased names to the
+ * names containing it is built so substring searches only have to check names
+ * containing all trigrams of the searched string.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "readtags.h"
+#include "nameindex.h"
+#include "tagfiles.h"
+
+#if ! GLIB_CHECK_VERSION(2, 70, 0)
+# define g_pattern_spec_match_string g_pattern_match_string
+#endif
+
+#define NAME_INDEX_HEADER "!_GEANYCTAGS_NAMES\t1\t"
+
+#define TRIGRAM(s) GUINT_TO_POINTER(((guint)(guchar)(s)[0] << 16) | \
+	((guint)(guchar)(s)[1] << 8) | (guint)(guchar)(s)[2])
+
+struct NameIndex
+{
+	gchar *contents;  /* the index file with names terminated by NULs */
+	GPtrArray *names;  /* pointers into contents */
+	GHashTable *trigrams;  /* trigram -> GArray of ascending name indices */
+};
+
+
+gchar *name_index_get_filename(const gchar *tag_filename)
+{
+	return g_strconcat(tag_filename, ".names", NULL);
+}
+
+
+static gint compare_names(gconstpointer a, gconstpointer b)
+{
+	return strcmp(*(const gchar **)a, *(const gchar **)b);
+}
+
+
+gboolean name_index_generate(const gchar *tag_filename, gint *cancelled)
+{
+	GHashTable *name_set;
+	GHashTableIter iter;
+	GPtrArray *names;
+	GString *contents;
+	gpointer name;
+	gchar *index_filename;
+	tagFile *tf;
+	tagEntry entry;
+	GStatBuf st;
+	gboolean success;
+	gulong tags = 0;
+	guint i;
+
+	if (g_stat(tag_filename, &st) != 0)
+		return FALSE;
+
+	tf = tagsOpen(tag_filename, NULL);
+	if (!tf)
+		return FALSE;
+
+	name_set = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	if (tagsFirst(tf, &entry) == TagSuccess)
+	{
+		do
+		{
+			if (entry.name && !strchr(entry.name, '\n'))
+				g_hash_table_add(name_set, g_ascii_strdown(entry.name, -1));
+
+			if (cancelled && ++tags % CANCEL_CHECK_INTERVAL == 0 && g_atomic_int_get(cancelled))
+			{
+				tagsClose(tf);
+				g_hash_table_destroy(name_set);
+				return FALSE;
+			}
+		}
+		while (tagsNext(tf, &entry) == TagSuccess);
+	}
+	tagsClose(tf);
+
+	names = g_ptr_array_sized_new(g_hash_table_size(name_set));
+	g_hash_table_iter_init(&iter, name_set);
+	while (g_hash_table_iter_next(&iter, &name, NULL))
+		g_ptr_array_add(names, name);
+	g_ptr_array_sort(names, compare_names);
+
+	contents = g_string_new(NULL);
+	g_string_append_printf(contents, NAME_INDEX_HEADER "%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT "\n",
+		(guint64)st.st_size, (gint64)st.st_mtime);
+	for (i = 0; i < names->len; i++)
+	{
+		g_string_append(contents, names->pdata[i]);
+		g_string_append_c(contents, '\n');
+	}
+
+	index_filename = name_index_get_filename(tag_filename);
+	success = g_file_set_contents(index_filename, contents->str, contents->len, NULL);
+
+	g_free(index_filename);
+	g_string_free(contents, TRUE);
+	g_ptr_array_free(names, TRUE);
+	g_hash_table_destroy(name_set);
+
+	return success;
+}
+
+
+static gboolean is_ascii(const gchar *str)
+{
+	for (; *str; str++)
+	{
+		if ((guchar)*str >= 0x80)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+
+static void add_trigrams(NameIndex *index, const gchar *index_name, guint name_index)
+{
+	gchar *name = is_ascii(index_name) ? (gchar *)index_name : g_utf8_strdown(index_name, -1);
+	gsize len = strlen(name);
+	gsize i;
+
+	for (i = 0; i + 3 <= len; i++)
+	{
+		GArray *postings = g_hash_table_lookup(index->trigrams, TRIGRAM(name + i));
+
+		if (!postings)
+		{
+			postings = g_array_new(FALSE, FALSE, sizeof(guint));
+			g_hash_table_insert(index->trigrams, TRIGRAM(name + i), postings);
+		}
+		/* names are added in order, so only the trigram repeating within the
+		 * current name can create duplicates */
+		if (postings->len == 0 || g_array_index(postings, guint, postings->len - 1) != name_index)
+			g_array_append_val(postings, name_index);
+	}
+
+	if (name != index_name)
+		g_free(name);
+}
+
+
+static void free_postings(gpointer postings)
+{
+	g_array_free(postings, TRUE);
+}
+
+
+NameIndex *name_index_load(const gchar *tag_filename)
+{
+	NameIndex *index;
+	gchar *index_filename;
+	gchar *contents;
+	gchar *line, *end;
+	guint64 size;
+	gint64 mtime;
+	GStatBuf st;
+
+	if (g_stat(tag_filename, &st) != 0)
+		return NULL;
+
+	index_filename = name_index_get_filename(tag_filename);
+	if (!g_file_get_contents(index_filename, &contents, NULL, NULL))
+	{
+		g_free(index_filename);
+		return NULL;
+	}
+	g_free(index_filename);
+
+	if (!g_str_has_prefix(contents, NAME_INDEX_HEADER))
+	{
+		g_free(contents);
+		return NULL;
+	}
+	line = contents + strlen(NAME_INDEX_HEADER);
+	size = g_ascii_strtoull(line, &end, 10);
+	mtime = *end == '\t' ? g_ascii_strtoll(end + 1, &end, 10) : -1;
+	if (*end != '\n' || size != (guint64)st.st_size || mtime != (gint64)st.st_mtime)
+	{
+		g_free(contents);
+		return NULL;
+	}
+
+	index = g_new0(NameIndex, 1);
+	index->contents = contents;
+	index->names = g_ptr_array_new();
+	index->trigrams = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_postings);
+
+	for (line = end + 1; *line; line = end + 1)
+	{
+		end = strchr(line, '\n');
+		if (!end)
+			break;
+		*end = '\0';
+		add_trigrams(index, line, index->names->len);
+		g_ptr_array_add(index->names, line);
+	}
+
+	return index;
+}
+
+
+void name_index_free(NameIndex *index)
+{
+	if (!index)
+		return;
+
+	g_hash_table_destroy(index->trigrams);
+	g_ptr_array_free(index->names, TRUE);
+	g_free(index->contents);
+	g_free(index);
+}
+
+
+static gboolean name_matches(GPatternSpec *name_pat, const gchar *index_name)
+{
+	gboolean ret;
+	gchar *name;
+
+	if (is_ascii(index_name))
+		return g_pattern_spec_match_string(name_pat, index_name);
+
+	name = g_utf8_strdown(index_name, -1);
+	ret = g_pattern_spec_match_string(name_pat, name);
+	g_free(name);
+	return ret;
+}
+
+
+/* both arrays are sorted ascending */
+static GArray *intersect_postings(GArray *a, GArray *b)
+{
+	GArray *ret = g_array_new(FALSE, FALSE, sizeof(guint));
+	guint i = 0, j = 0;
+
+	while (i < a->len && j < b->len)
+	{
+		guint x = g_array_index(a, guint, i);
+		guint y = g_array_index(b, guint, j);
+
+		if (x < y)
+			i++;
+		else if (x > y)
+			j++;
+		else
+		{
+			g_array_append_val(ret, x);
+			i++;
+			j++;
+		}
+	}
+	return ret;
+}
+
+
+/* Returns the indices of the names containing all trigrams of the literal
+ * parts of pattern, NULL if pattern has no trigrams and all names have to be
+ * checked */
+static GArray *get_candidates(NameIndex *index, const gchar *pattern)
+{
+	GArray *candidates = NULL;
+	gsize literal_len = 0;
+	const gchar *p;
+
+	for (p = pattern; *p; p++)
+	{
+		GArray *postings;
+
+		if (*p == '*' || *p == '?')
+		{
+			literal_len = 0;
+			continue;
+		}
+		if (++literal_len < 3)
+			continue;
+
+		postings = g_hash_table_lookup(index->trigrams, TRIGRAM(p - 2));
+		if (!postings)
+		{
+			if (candidates)
+				g_array_free(candidates, TRUE);
+			return g_array_new(FALSE, FALSE, sizeof(guint));
+		}
+
+		if (candidates)
+		{
+			GArray *intersection = intersect_postings(candidates, postings);
+
+			g_array_free(candidates, TRUE);
+			candidates = intersection;
+		}
+		else
+		{
+			candidates = g_array_sized_new(FALSE, FALSE, sizeof(guint), postings->len);
+			g_array_append_vals(candidates, postings->data, postings->len);
+		}
+	}
+
+	return candidates;
+}
+
+
+GPtrArray *name_index_find(NameIndex *index, const gchar *pattern)
+{
+	GPtrArray *ret = g_ptr_array_new();
+	GPatternSpec *name_pat;
+	GArray *candidates;
+	gchar *lower_pattern;
+	gchar *glob;
+	guint i;
+
+	lower_pattern = g_utf8_strdown(pattern, -1);
+	glob = g_strconcat("*", lower_pattern, "*", NULL);
+	name_pat = g_pattern_spec_new(glob);
+
+	candidates = get_candidates(index, lower_pattern);
+	if (candidates)
+	{
+		for (i = 0; i < candidates->len; i++)
+		{
+			gchar *name = index->names->pdata[g_array_index(candidates, guint, i)];
+
+			if (name_matches(name_pat, name))
+				g_ptr_array_add(ret, name);
+		}
+		g_array_free(candidates, TRUE);
+	}
+	else
+	{
+		for (i = 0; i < index->names->len; i++)
+		{
+			gchar *name = index->names->pdata[i];
+
+			if (name_matches(name_pat, name))
+				g_ptr_array_add(ret, name);
+		}
+	}
+
+	g_pattern_spec_free(name_pat);
+	g_free(glob);
+	g_free(lower_pattern);
+
+	return ret;
+}
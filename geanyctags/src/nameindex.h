@@ -0,0 +1,42 @@
+/*
+ *	  Copyright 2026 The Geany contributors
+ *
+ *	  This program is free software; you can redistribute it and/or modify
+ *	  it under the terms of the GNU General Public License as published by
+ *	  the Free Software Foundation; either version 2 of the License, or
+ *	  (at your option) any later version.
+ *
+ *	  This program is distributed in the hope that it will be useful,
+ *	  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	  GNU General Public License for more details.
+ *
+ *	  You should have received a copy of the GNU General Public License
+ *	  along with this program; if not, write to the Free Software
+ *	  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GEANYCTAGS_NAMEINDEX_H__
+#define __GEANYCTAGS_NAMEINDEX_H__
+
+#include <glib.h>
+
+/* Index of the distinct tag names of a tag file, stored in a file next to the
+ * tag file and used for pattern searches */
+typedef struct NameIndex NameIndex;
+
+gchar *name_index_get_filename(const gchar *tag_filename);
+
+/* Writes the name index of tag_filename; reads the whole tag file. Returns
+ * FALSE on error or when cancelled (which may be NULL) becomes non-zero. */
+gboolean name_index_generate(const gchar *tag_filename, gint *cancelled);
+
+/* Returns NULL if the index doesn't exist or is older than the tag file */
+NameIndex *name_index_load(const gchar *tag_filename);
+void name_index_free(NameIndex *index);
+
+/* Returns the names matching the glob pattern *pattern* ignoring case, with
+ * ASCII letters lowercased; the strings are owned by the index */
+GPtrArray *name_index_find(NameIndex *index, const gchar *pattern);
+
+#endif
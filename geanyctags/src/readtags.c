@@ -14,7 +14,14 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <errno.h>
+#include <stdint.h>
 #include <sys/types.h>  /* to declare off_t */
+#ifndef _WIN32
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
 
 #include "readtags.h"
 
@@ -23,6 +30,14 @@
 */
 #define TAB '\t'
 
+/* Tag files are memory mapped where possible, which avoids seeking and
+ * copying every line while searching. Accessing the mapping crashes with
+ * SIGBUS once the file gets truncated, so files which may be rewritten in
+ * place should only be kept open for the duration of a search. */
+#if !defined(_WIN32) && !defined(READTAGS_NO_MMAP)
+# define USE_MMAP 1
+#endif
+
 
 /*
 *   DATA DECLARATIONS
@@ -51,8 +66,21 @@ struct sTagFile {
 	unsigned char inputUCtagsMode;
 		/* how is the tag file sorted? */
 	tagSortType sortMethod;
-		/* pointer to file structure */
+		/* pointer to file structure (NULL if the file is memory mapped) */
 	FILE* fp;
+		/* contents of the memory mapped tag file, or NULL */
+	const char *map;
+		/* position of the next line to read from `map' */
+	rt_off_t mapPos;
+		/* start offsets of all lines of `map' */
+	struct {
+				/* number of lines */
+			size_t count;
+				/* offsets for files smaller than 4 GiB, to save memory */
+			uint32_t *offsets32;
+				/* offsets for larger files */
+			rt_off_t *offsets;
+	} lines;
 		/* file position of first character of `line' */
 	rt_off_t pos;
 		/* size of tag file in seekable positions */
@@ -134,6 +162,29 @@ static int readtags_fseek(FILE *fp, rt_off_t pos, int whence)
 	return ret;
 }
 
+static rt_off_t tagFileTell (tagFile *const file)
+{
+	if (file->map != NULL)
+		return file->mapPos;
+	return readtags_ftell (file->fp);
+}
+
+/* Moves to the absolute position pos. Returns 0 on success. */
+static int tagFileSeek (tagFile *const file, rt_off_t pos)
+{
+	if (file->map != NULL)
+	{
+		if (pos < 0 || pos > file->size)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		file->mapPos = pos;
+		return 0;
+	}
+	return readtags_fseek (file->fp, pos, SEEK_SET);
+}
+
 /* Converts a hexadecimal digit to its value */
 static int xdigitValue (unsigned char digit)
 {
@@ -253,6 +304,51 @@ static int tagncmp (const char *s1, const char *s2, size_t n)
 	return result;
 }
 
+#ifdef USE_MMAP
+/*
+ * Like readTagCharacter(), for strings which aren't NUL-terminated but end at
+ * `end'. Returns '\0' at the end of the string.
+ */
+static int readMappedTagCharacter (const char **const s, const char *const end)
+{
+	const char *p = *s;
+
+	if (p >= end)
+		return '\0';
+	/* don't let escape sequences reach past the end */
+	if (*p == '\\'  &&  end - p >= 2  &&  (p[1] != 'x'  ||  end - p >= 4))
+		return readTagCharacter (s);
+
+	*s = p + 1;
+	return (unsigned char) *p;
+}
+
+/*
+ * Compares the name searched for with the name starting at s2 and ending at
+ * `end', like nameComparison() does with the name of the last line read.
+ */
+static int mappedNameComparison (tagFile *const file, const char *s2,
+								 const char *const end)
+{
+	const char *s1 = file->search.name;
+	size_t n = file->search.nameLength;
+	int result;
+	int c1, c2;
+	do
+	{
+		c1 = (unsigned char)*s1++;
+		c2 = readMappedTagCharacter (&s2, end);
+
+		if (file->search.ignorecase)
+			result = toupper (c1) - toupper (c2);
+		else
+			result = c1 - c2;
+	} while (result == 0  &&  (! file->search.partial  ||  --n > 0)  &&
+			 c1 != '\0'  &&  c2 != '\0');
+	return result;
+}
+#endif
+
 static tagResult growString (vstring *s)
 {
 	tagResult result = TagFailure;
@@ -306,6 +402,45 @@ static tagResult copyName (tagFile *const file)
 	return TagSuccess;
 }
 
+/* Copies the next line of the memory mapped file to `line'.
+ * Return 1 on success.
+ * Return 0 on failure or EOF.
+ */
+static int readTagLineMapped (tagFile *const file, int *err)
+{
+	const char *line;
+	const char *end;
+	size_t length;
+
+	file->pos = file->mapPos;
+	if (file->pos >= file->size)
+	{
+		*err = 0;
+		return 0;
+	}
+
+	line = file->map + file->pos;
+	end = memchr (line, '\n', (size_t) (file->size - file->pos));
+	if (end == NULL)
+		end = file->map + file->size;
+	file->mapPos = (end - file->map) + (end < file->map + file->size ? 1 : 0);
+
+	length = (size_t) (end - line);
+	while (length > 0  &&  (line [length - 1] == '\n' || line [length - 1] == '\r'))
+		--length;
+	while (length >= file->line.size)
+	{
+		if (growString (&file->line) != TagSuccess)
+		{
+			*err = ENOMEM;
+			return 0;
+		}
+	}
+	memcpy (file->line.buffer, line, length);
+	file->line.buffer [length] = '\0';
+	return 1;
+}
+
 /* Return 1 on success.
  * Return 0 on failure or EOF.
  * errno is set to *err unless EOF.
@@ -320,7 +455,9 @@ static int readTagLineRaw (tagFile *const file, int *err)
 	 *  the buffer size), then we must resize the buffer and reattempt to read
 	 *  the line.
 	 */
-	do
+	if (file->map != NULL)
+		result = readTagLineMapped (file, err);
+	else do
 	{
 		char *const pLastChar = file->line.buffer + file->line.size - 2;
 		char *line;
@@ -691,7 +828,7 @@ static int isPseudoTagLine (const char *buffer)
 
 static tagResult readPseudoTags (tagFile *const file, tagFileInfo *const info)
 {
-	fpos_t startOfLine;
+	rt_off_t startOfLine = 0;
 	int err = 0;
 	tagResult result = TagSuccess;
 	const size_t prefixLength = strlen (PseudoTagPrefix);
@@ -707,7 +844,7 @@ static tagResult readPseudoTags (tagFile *const file, tagFileInfo *const info)
 
 	while (1)
 	{
-		if (fgetpos (file->fp, &startOfLine) < 0)
+		if ((startOfLine = tagFileTell (file)) < 0)
 		{
 			err = errno;
 			break;
@@ -805,7 +942,7 @@ static tagResult readPseudoTags (tagFile *const file, tagFileInfo *const info)
 	if (tag_output_mode_u_ctags && tag_output_filesep_slash)
 		file->inputUCtagsMode = 1;
 
-	if (fsetpos (file->fp, &startOfLine) < 0)
+	if (startOfLine < 0  ||  tagFileSeek (file, startOfLine) < 0)
 		err = errno;
 
 	info->status.error_number = err;
@@ -821,9 +958,9 @@ static int doesFilePointPseudoTag (tagFile *const file, void *unused)
 
 static tagResult gotoFirstLogicalTag (tagFile *const file)
 {
-	fpos_t startOfLine;
+	rt_off_t startOfLine;
 
-	if (readtags_fseek(file->fp, 0, SEEK_SET) == -1)
+	if (tagFileSeek (file, 0) == -1)
 	{
 		file->err = errno;
 		return TagFailure;
@@ -831,7 +968,7 @@ static tagResult gotoFirstLogicalTag (tagFile *const file)
 
 	while (1)
 	{
-		if (fgetpos (file->fp, &startOfLine) < 0)
+		if ((startOfLine = tagFileTell (file)) < 0)
 		{
 			file->err = errno;
 			return TagFailure;
@@ -845,7 +982,7 @@ static tagResult gotoFirstLogicalTag (tagFile *const file)
 		if (!isPseudoTagLine (file->line.buffer))
 			break;
 	}
-	if (fsetpos (file->fp, &startOfLine) < 0)
+	if (tagFileSeek (file, startOfLine) < 0)
 	{
 		file->err = errno;
 		return TagFailure;
@@ -853,6 +990,117 @@ static tagResult gotoFirstLogicalTag (tagFile *const file)
 	return TagSuccess;
 }
 
+#ifdef USE_MMAP
+static rt_off_t lineStart (tagFile *const file, size_t i)
+{
+	if (file->lines.offsets32 != NULL)
+		return (rt_off_t) file->lines.offsets32 [i];
+	return file->lines.offsets [i];
+}
+
+/* Returns the start of the name of line i, and its end in *end */
+static const char *mappedLineName (tagFile *const file, size_t i, const char **end)
+{
+	const char *line = file->map + lineStart (file, i);
+	const char *lineEnd = file->map + ((i + 1 < file->lines.count)
+									   ? lineStart (file, i + 1) : file->size);
+	const char *tab = memchr (line, TAB, (size_t) (lineEnd - line));
+
+	if (tab != NULL)
+		lineEnd = tab;
+	while (lineEnd > line  &&  (lineEnd [-1] == '\n' || lineEnd [-1] == '\r'))
+		--lineEnd;
+	*end = lineEnd;
+	return line;
+}
+
+/* Records the start offsets of all lines, once, for searching them directly */
+static tagResult indexLines (tagFile *const file)
+{
+	const char *p = file->map;
+	const char *const end = file->map + file->size;
+	size_t count = 0;
+	size_t i = 0;
+
+	while (p < end)
+	{
+		const char *nl = memchr (p, '\n', (size_t) (end - p));
+		++count;
+		p = (nl != NULL) ? nl + 1 : end;
+	}
+
+	if ((uintmax_t) file->size <= UINT32_MAX)
+		file->lines.offsets32 = (uint32_t*) malloc (count * sizeof (uint32_t));
+	else
+		file->lines.offsets = (rt_off_t*) malloc (count * sizeof (rt_off_t));
+	if (file->lines.offsets32 == NULL  &&  file->lines.offsets == NULL)
+		return TagFailure;
+
+	for (p = file->map; p < end; ++i)
+	{
+		const char *nl = memchr (p, '\n', (size_t) (end - p));
+		if (file->lines.offsets32 != NULL)
+			file->lines.offsets32 [i] = (uint32_t) (p - file->map);
+		else
+			file->lines.offsets [i] = (rt_off_t) (p - file->map);
+		p = (nl != NULL) ? nl + 1 : end;
+	}
+	file->lines.count = count;
+
+	return TagSuccess;
+}
+
+/* Maps the tag file into memory. Returns 0 if it isn't possible, in which
+ * case the file is read using stdio. */
+static int mapFile (tagFile *const file, const char *const filePath)
+{
+	struct stat st;
+	void *map;
+	int fd = open (filePath, O_RDONLY);
+
+	if (fd < 0)
+		return 0;
+	/* empty files cannot be mapped */
+	if (fstat (fd, &st) < 0  ||  st.st_size <= 0  ||
+		(uintmax_t) st.st_size > (uintmax_t) SIZE_MAX)
+	{
+		close (fd);
+		return 0;
+	}
+	map = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd);
+	if (map == MAP_FAILED)
+		return 0;
+
+	file->map = (const char *) map;
+	file->mapPos = 0;
+	file->size = (rt_off_t) st.st_size;
+
+#ifdef MADV_SEQUENTIAL
+	madvise (map, (size_t) st.st_size, MADV_SEQUENTIAL);
+#endif
+	if (indexLines (file) != TagSuccess)
+	{
+		munmap (map, (size_t) st.st_size);
+		file->map = NULL;
+		return 0;
+	}
+	/* from now on, the file is mostly accessed by binary searches */
+#ifdef MADV_RANDOM
+	madvise (map, (size_t) st.st_size, MADV_RANDOM);
+#endif
+
+	return 1;
+}
+
+static void unmapFile (tagFile *const file)
+{
+	munmap ((void *) file->map, (size_t) file->size);
+	free (file->lines.offsets32);
+	free (file->lines.offsets);
+}
+#endif
+
 static tagFile *initialize (const char *const filePath, tagFileInfo *const info)
 {
 	tagFile *result = (tagFile*) calloc ((size_t) 1, sizeof (tagFile));
@@ -874,6 +1122,11 @@ static tagFile *initialize (const char *const filePath, tagFileInfo *const info)
 	if (result->fields.list == NULL)
 		goto mem_error;
 
+#ifdef USE_MMAP
+	if (mapFile (result, filePath))
+		goto pseudo_tags;
+#endif
+
 #if defined(__GLIBC__) && (__GLIBC__ >= 2) \
 	&& defined(__GLIBC_MINOR__) && (__GLIBC_MINOR__ >= 3)
 	result->fp = fopen (filePath, "rbm");
@@ -916,6 +1169,9 @@ static tagFile *initialize (const char *const filePath, tagFileInfo *const info)
 		goto file_error;
 	}
 
+#ifdef USE_MMAP
+ pseudo_tags:
+#endif
 	if (readPseudoTags (result, info) == TagFailure)
 		goto file_error;
 
@@ -931,6 +1187,10 @@ static tagFile *initialize (const char *const filePath, tagFileInfo *const info)
 	free (result->fields.list);
 	if (result->fp)
 		fclose (result->fp);
+#ifdef USE_MMAP
+	if (result->map)
+		unmapFile (result);
+#endif
 	free (result);
 	info->status.opened = 0;
 	return NULL;
@@ -938,7 +1198,12 @@ static tagFile *initialize (const char *const filePath, tagFileInfo *const info)
 
 static void terminate (tagFile *const file)
 {
-	fclose (file->fp);
+	if (file->fp != NULL)
+		fclose (file->fp);
+#ifdef USE_MMAP
+	if (file->map != NULL)
+		unmapFile (file);
+#endif
 
 	free (file->line.buffer);
 	free (file->name.buffer);
@@ -1000,7 +1265,7 @@ static const char *readFieldValue (
 
 static int readTagLineSeek (tagFile *const file, const rt_off_t pos)
 {
-	if (readtags_fseek (file->fp, pos, SEEK_SET) < 0)
+	if (tagFileSeek (file, pos) < 0)
 	{
 		file->err = errno;
 		return 0;
@@ -1127,6 +1392,69 @@ static tagResult findBinary (tagFile *const file)
 	return result;
 }
 
+#ifdef USE_MMAP
+/* Binary search over the lines of the mapped file, comparing the names in
+ * place. Finds the first matching line, also for partial matches. */
+static tagResult findBinaryMapped (tagFile *const file)
+{
+	size_t lower = 0;
+	size_t upper = file->lines.count;
+	const char *name;
+	const char *end;
+
+	while (lower < upper)
+	{
+		const size_t middle = lower + (upper - lower) / 2;
+
+		name = mappedLineName (file, middle, &end);
+		if (mappedNameComparison (file, name, end) > 0)
+			lower = middle + 1;
+		else
+			upper = middle;
+	}
+	if (lower >= file->lines.count)
+		return TagFailure;
+
+	name = mappedLineName (file, lower, &end);
+	if (name == end  ||  mappedNameComparison (file, name, end) != 0)
+		return TagFailure;
+
+	file->mapPos = lineStart (file, lower);
+	if (! readTagLine (file, &file->err))
+		return TagFailure;
+	return TagSuccess;
+}
+
+/* Finds the next matching line of the mapped file from the current position,
+ * copying only the matching line. */
+static tagResult findSequentialMapped (tagFile *const file)
+{
+	while (file->mapPos < file->size)
+	{
+		const char *line = file->map + file->mapPos;
+		const char *lineEnd = memchr (line, '\n', (size_t) (file->size - file->mapPos));
+		const char *nameEnd;
+
+		if (lineEnd == NULL)
+			lineEnd = file->map + file->size;
+		nameEnd = memchr (line, TAB, (size_t) (lineEnd - line));
+		if (nameEnd == NULL)
+			nameEnd = lineEnd;
+		while (nameEnd > line  &&  (nameEnd [-1] == '\n' || nameEnd [-1] == '\r'))
+			--nameEnd;
+
+		if (nameEnd > line  &&  mappedNameComparison (file, line, nameEnd) == 0)
+		{
+			if (! readTagLine (file, &file->err))
+				return TagFailure;
+			return TagSuccess;
+		}
+		file->mapPos = (lineEnd - file->map) + (lineEnd < file->map + file->size ? 1 : 0);
+	}
+	return TagFailure;
+}
+#endif
+
 static tagResult findSequentialFull (tagFile *const file,
 									 int (* isAcceptable) (tagFile *const, void *),
 									 void *data)
@@ -1158,6 +1486,17 @@ static int nameAcceptable (tagFile *const file, void *unused)
 
 static tagResult findSequential (tagFile *const file)
 {
+#ifdef USE_MMAP
+	if (file->map != NULL)
+	{
+		if (!file->initialized || file->err)
+		{
+			file->err = TagErrnoInvalidArgument;
+			return TagFailure;
+		}
+		return findSequentialMapped (file);
+	}
+#endif
 	return findSequentialFull (file, nameAcceptable, NULL);
 }
 
@@ -1176,18 +1515,22 @@ static tagResult find (tagFile *const file, tagEntry *const entry,
 	file->search.nameLength = strlen (name);
 	file->search.partial = (options & TAG_PARTIALMATCH) != 0;
 	file->search.ignorecase = (options & TAG_IGNORECASE) != 0;
-	if (readtags_fseek (file->fp, 0, SEEK_END) < 0)
+	if (file->map == NULL)
 	{
-		file->err = errno;
-		return TagFailure;
-	}
-	file->size = readtags_ftell (file->fp);
-	if (file->size == -1)
-	{
-		file->err = errno;
-		return TagFailure;
+		/* the file might have grown since it was opened */
+		if (readtags_fseek (file->fp, 0, SEEK_END) < 0)
+		{
+			file->err = errno;
+			return TagFailure;
+		}
+		file->size = readtags_ftell (file->fp);
+		if (file->size == -1)
+		{
+			file->err = errno;
+			return TagFailure;
+		}
 	}
-	if (readtags_fseek(file->fp, 0, SEEK_SET) == -1)
+	if (tagFileSeek (file, 0) == -1)
 	{
 		file->err = errno;
 		return TagFailure;
@@ -1195,6 +1538,11 @@ static tagResult find (tagFile *const file, tagEntry *const entry,
 	if ((file->sortMethod == TAG_SORTED      && !file->search.ignorecase) ||
 		(file->sortMethod == TAG_FOLDSORTED  &&  file->search.ignorecase))
 	{
+#ifdef USE_MMAP
+		if (file->map != NULL)
+			result = findBinaryMapped (file);
+		else
+#endif
 		result = findBinary (file);
 		if (result == TagFailure && file->err)
 			return TagFailure;
@@ -1241,6 +1589,17 @@ static tagResult findNextFull (tagFile *const file, tagEntry *const entry,
 
 static tagResult findNext (tagFile *const file, tagEntry *const entry)
 {
+#ifdef USE_MMAP
+	if (file->map != NULL  &&
+		! ((file->sortMethod == TAG_SORTED      && !file->search.ignorecase) ||
+		   (file->sortMethod == TAG_FOLDSORTED  &&  file->search.ignorecase)))
+	{
+		tagResult result = findSequentialMapped (file);
+		if (result == TagSuccess  &&  entry != NULL)
+			result = parseTagLine (file, entry, &file->err);
+		return result;
+	}
+#endif
 	return findNextFull (file, entry,
 						 (file->sortMethod == TAG_SORTED      && !file->search.ignorecase) ||
 						 (file->sortMethod == TAG_FOLDSORTED  &&  file->search.ignorecase),
@@ -1260,7 +1619,7 @@ static tagResult findPseudoTag (tagFile *const file, int rewindBeforeFinding, ta
 
 	if (rewindBeforeFinding)
 	{
-		if (readtags_fseek(file->fp, 0, SEEK_SET) == -1)
+		if (tagFileSeek (file, 0) == -1)
 		{
 			file->err = errno;
 			return TagFailure;
@@ -0,0 +1,401 @@
+/*
+ *	  Copyright 2026 The Geany contributors
+ *
+ *	  This program is free software; you can redistribute it and/or modify
+ *	  it under the terms of the GNU General Public License as published by
+ *	  the Free Software Foundation; either version 2 of the License, or
+ *	  (at your option) any later version.
+ *
+ *	  This program is distributed in the hope that it will be useful,
+ *	  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	  GNU General Public License for more details.
+ *
+ *	  You should have received a copy of the GNU General Public License
+ *	  along with this program; if not, write to the Free Software
+ *	  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Helpers for generating the tag file in parts: tracking which files changed
+ * since the last generation and merging the tag files generated by separate
+ * ctags processes. These functions are called from a background thread and
+ * only use GLib.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "nameindex.h"
+#include "tagfiles.h"
+
+#define MTIMES_HEADER "!_GEANYCTAGS_FILES\t1\n"
+
+typedef struct
+{
+	FILE *fp;
+	GString *line;
+	gboolean filtered;  /* tags of stale files are left out */
+	gboolean has_entry;  /* line contains the next entry */
+} MergeInput;
+
+
+static gchar *get_mtimes_filename(const gchar *tag_filename)
+{
+	return g_strconcat(tag_filename, ".files", NULL);
+}
+
+
+GHashTable *tag_files_get_mtimes(const gchar *base_dir, GPtrArray *files, gint *cancelled)
+{
+	GHashTable *mtimes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	guint i;
+
+	for (i = 0; i < files->len && !g_atomic_int_get(cancelled); i++)
+	{
+		const gchar *path = files->pdata[i];
+		gchar *full_path = g_build_filename(base_dir, path, NULL);
+		GStatBuf st;
+
+		if (g_stat(full_path, &st) == 0)
+		{
+			gint64 *mtime = g_new(gint64, 1);
+
+			*mtime = st.st_mtime;
+			g_hash_table_insert(mtimes, g_strdup(path), mtime);
+		}
+		g_free(full_path);
+	}
+
+	return mtimes;
+}
+
+
+GHashTable *tag_files_load_mtimes(const gchar *tag_filename)
+{
+	GHashTable *mtimes;
+	gchar *filename;
+	gchar *contents;
+	gchar *line, *end;
+
+	filename = get_mtimes_filename(tag_filename);
+	if (!g_file_get_contents(filename, &contents, NULL, NULL))
+	{
+		g_free(filename);
+		return NULL;
+	}
+	g_free(filename);
+
+	if (!g_str_has_prefix(contents, MTIMES_HEADER))
+	{
+		g_free(contents);
+		return NULL;
+	}
+
+	mtimes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	for (line = contents + strlen(MTIMES_HEADER); *line; line = end + 1)
+	{
+		gint64 *mtime;
+		gchar *path;
+
+		end = strchr(line, '\n');
+		if (!end)
+			break;
+		*end = '\0';
+
+		mtime = g_new(gint64, 1);
+		*mtime = g_ascii_strtoll(line, &path, 10);
+		if (*path == '\t')
+			g_hash_table_insert(mtimes, g_strdup(path + 1), mtime);
+		else
+			g_free(mtime);
+	}
+
+	g_free(contents);
+	return mtimes;
+}
+
+
+gboolean tag_files_save_mtimes(const gchar *tag_filename, GHashTable *mtimes)
+{
+	GHashTableIter iter;
+	gpointer path, mtime;
+	GString *contents;
+	gchar *filename;
+	gboolean success;
+
+	contents = g_string_new(MTIMES_HEADER);
+	g_hash_table_iter_init(&iter, mtimes);
+	while (g_hash_table_iter_next(&iter, &path, &mtime))
+		g_string_append_printf(contents, "%" G_GINT64_FORMAT "\t%s\n", *(gint64 *)mtime, (gchar *)path);
+
+	filename = get_mtimes_filename(tag_filename);
+	success = g_file_set_contents(filename, contents->str, contents->len, NULL);
+
+	g_free(filename);
+	g_string_free(contents, TRUE);
+
+	return success;
+}
+
+
+GPtrArray *tag_files_get_changed(GPtrArray *files, GHashTable *mtimes, GHashTable *old_mtimes,
+	GHashTable *stale_files)
+{
+	GPtrArray *changed = g_ptr_array_new();
+	GHashTableIter iter;
+	gpointer path;
+	guint i;
+
+	for (i = 0; i < files->len; i++)
+	{
+		gint64 *mtime = g_hash_table_lookup(mtimes, files->pdata[i]);
+		gint64 *old_mtime = g_hash_table_lookup(old_mtimes, files->pdata[i]);
+
+		if (mtime && (!old_mtime || *mtime != *old_mtime))
+		{
+			g_ptr_array_add(changed, files->pdata[i]);
+			if (old_mtime)
+				g_hash_table_add(stale_files, g_strdup(files->pdata[i]));
+		}
+	}
+
+	/* removed files */
+	g_hash_table_iter_init(&iter, old_mtimes);
+	while (g_hash_table_iter_next(&iter, &path, NULL))
+	{
+		if (!g_hash_table_contains(mtimes, path))
+			g_hash_table_add(stale_files, g_strdup(path));
+	}
+
+	return changed;
+}
+
+
+/* ctags --sort=foldcase compares whole lines with ASCII letters uppercased */
+static gint compare_folded(const gchar *a, const gchar *b)
+{
+	while (*a && g_ascii_toupper(*a) == g_ascii_toupper(*b))
+	{
+		a++;
+		b++;
+	}
+	return (gint)(guchar)g_ascii_toupper(*a) - (gint)(guchar)g_ascii_toupper(*b);
+}
+
+
+/* reads a line without the line terminator */
+static gboolean read_line(FILE *fp, GString *line)
+{
+	gchar buf[4096];
+
+	g_string_truncate(line, 0);
+	while (fgets(buf, sizeof(buf), fp))
+	{
+		g_string_append(line, buf);
+		if (line->str[line->len - 1] == '\n')
+			break;
+	}
+
+	if (line->len == 0)
+		return FALSE;
+
+	if (line->str[line->len - 1] == '\n')
+		g_string_truncate(line, line->len - 1);
+	if (line->len > 0 && line->str[line->len - 1] == '\r')
+		g_string_truncate(line, line->len - 1);
+	return TRUE;
+}
+
+
+static gboolean is_stale(GString *line, GHashTable *stale_files)
+{
+	gchar *file = strchr(line->str, '\t');
+	gchar *file_end;
+	gboolean stale;
+
+	if (!file)
+		return FALSE;
+	file++;
+	file_end = strchr(file, '\t');
+	if (!file_end)
+		return FALSE;
+
+	*file_end = '\0';
+	stale = g_hash_table_contains(stale_files, file);
+	*file_end = '\t';
+
+	return stale;
+}
+
+
+/* Reads the next entry into input->line; pseudo-tags preceding it are
+ * appended to header if not NULL */
+static void read_entry(MergeInput *input, GHashTable *stale_files, GString *header)
+{
+	input->has_entry = FALSE;
+	while (read_line(input->fp, input->line))
+	{
+		if (g_str_has_prefix(input->line->str, "!_"))
+		{
+			if (header)
+			{
+				g_string_append_len(header, input->line->str, input->line->len);
+				g_string_append_c(header, '\n');
+			}
+			continue;
+		}
+		if (input->filtered && stale_files && is_stale(input->line, stale_files))
+			continue;
+
+		input->has_entry = TRUE;
+		return;
+	}
+}
+
+
+static gboolean open_input(MergeInput *input, const gchar *filename, gboolean filtered)
+{
+	input->fp = g_fopen(filename, "rb");
+	input->line = g_string_new(NULL);
+	input->filtered = filtered;
+	input->has_entry = FALSE;
+	return input->fp != NULL;
+}
+
+
+gboolean tag_files_merge(const gchar *output_filename, const gchar *existing_filename,
+	GHashTable *stale_files, GPtrArray *new_filenames, gint *cancelled)
+{
+	MergeInput *inputs;
+	guint inputs_num = 0;
+	GString *header;
+	gboolean success = TRUE;
+	gulong lines = 0;
+	FILE *out;
+	guint i;
+
+	inputs = g_new0(MergeInput, new_filenames->len + 1);
+	if (existing_filename)
+		success = open_input(&inputs[inputs_num++], existing_filename, TRUE);
+	for (i = 0; i < new_filenames->len && success; i++)
+		success = open_input(&inputs[inputs_num++], new_filenames->pdata[i], FALSE);
+
+	out = success ? g_fopen(output_filename, "wb") : NULL;
+	if (out)
+	{
+		/* the pseudo-tags describing the tag file are the same in all inputs */
+		header = g_string_new(NULL);
+		for (i = 0; i < inputs_num; i++)
+		{
+			GString *input_header = g_string_new(NULL);
+
+			read_entry(&inputs[i], stale_files, input_header);
+			if (header->len == 0)
+				g_string_assign(header, input_header->str);
+			g_string_free(input_header, TRUE);
+		}
+		fputs(header->str, out);
+		g_string_free(header, TRUE);
+
+		while (TRUE)
+		{
+			MergeInput *next = NULL;
+
+			for (i = 0; i < inputs_num; i++)
+			{
+				if (inputs[i].has_entry &&
+					(!next || compare_folded(inputs[i].line->str, next->line->str) < 0))
+				{
+					next = &inputs[i];
+				}
+			}
+			if (!next)
+				break;
+
+			fwrite(next->line->str, 1, next->line->len, out);
+			fputc('\n', out);
+			read_entry(next, stale_files, NULL);
+
+			if (++lines % CANCEL_CHECK_INTERVAL == 0 && g_atomic_int_get(cancelled))
+			{
+				success = FALSE;
+				break;
+			}
+		}
+
+		if (ferror(out))
+			success = FALSE;
+		if (fclose(out) != 0)
+			success = FALSE;
+	}
+	else
+		success = FALSE;
+
+	for (i = 0; i < inputs_num; i++)
+	{
+		if (inputs[i].fp)
+		{
+			if (ferror(inputs[i].fp))
+				success = FALSE;
+			fclose(inputs[i].fp);
+		}
+		g_string_free(inputs[i].line, TRUE);
+	}
+	g_free(inputs);
+
+	if (!success)
+		g_unlink(output_filename);
+
+	return success;
+}
+
+
+gboolean tag_files_rename(const gchar *old_tag_filename, const gchar *new_tag_filename)
+{
+	gchar *old_sidecars[2], *new_sidecars[2];
+	gboolean success;
+	guint i;
+
+	if (g_rename(old_tag_filename, new_tag_filename) != 0)
+		return FALSE;
+
+	old_sidecars[0] = name_index_get_filename(old_tag_filename);
+	old_sidecars[1] = get_mtimes_filename(old_tag_filename);
+	new_sidecars[0] = name_index_get_filename(new_tag_filename);
+	new_sidecars[1] = get_mtimes_filename(new_tag_filename);
+
+	/* files missing next to the old tag file would be out of date next to the
+	 * new one */
+	success = TRUE;
+	for (i = 0; i < G_N_ELEMENTS(old_sidecars); i++)
+	{
+		if (g_file_test(old_sidecars[i], G_FILE_TEST_EXISTS))
+			success = g_rename(old_sidecars[i], new_sidecars[i]) == 0 && success;
+		else
+			g_unlink(new_sidecars[i]);
+		g_free(old_sidecars[i]);
+		g_free(new_sidecars[i]);
+	}
+
+	return success;
+}
+
+
+void tag_files_remove(const gchar *tag_filename)
+{
+	gchar *filename;
+
+	g_unlink(tag_filename);
+
+	filename = name_index_get_filename(tag_filename);
+	g_unlink(filename);
+	g_free(filename);
+
+	filename = get_mtimes_filename(tag_filename);
+	g_unlink(filename);
+	g_free(filename);
+}
@@ -0,0 +1,54 @@
+/*
+ *	  Copyright 2026 The Geany contributors
+ *
+ *	  This program is free software; you can redistribute it and/or modify
+ *	  it under the terms of the GNU General Public License as published by
+ *	  the Free Software Foundation; either version 2 of the License, or
+ *	  (at your option) any later version.
+ *
+ *	  This program is distributed in the hope that it will be useful,
+ *	  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	  GNU General Public License for more details.
+ *
+ *	  You should have received a copy of the GNU General Public License
+ *	  along with this program; if not, write to the Free Software
+ *	  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GEANYCTAGS_TAGFILES_H__
+#define __GEANYCTAGS_TAGFILES_H__
+
+#include <glib.h>
+
+/* how many lines or tags of a tag file are read between checks for
+ * cancellation */
+#define CANCEL_CHECK_INTERVAL 4096
+
+/* Returns path -> gint64 modification time of the files (relative to base_dir)
+ * which exist; the files are only partially checked when cancelled becomes
+ * non-zero */
+GHashTable *tag_files_get_mtimes(const gchar *base_dir, GPtrArray *files, gint *cancelled);
+
+/* The modification times of the tagged files are stored next to the tag file;
+ * returns NULL if they are not available */
+GHashTable *tag_files_load_mtimes(const gchar *tag_filename);
+gboolean tag_files_save_mtimes(const gchar *tag_filename, GHashTable *mtimes);
+
+/* Returns the files whose modification time changed since old_mtimes was
+ * recorded; these and the removed files are added to stale_files. The strings
+ * are owned by files. */
+GPtrArray *tag_files_get_changed(GPtrArray *files, GHashTable *mtimes, GHashTable *old_mtimes,
+	GHashTable *stale_files);
+
+/* Merges the foldcase-sorted tag files into output_filename. Tags of
+ * stale_files are left out from existing_filename (which may be NULL). Returns
+ * FALSE on error or when cancelled becomes non-zero. */
+gboolean tag_files_merge(const gchar *output_filename, const gchar *existing_filename,
+	GHashTable *stale_files, GPtrArray *new_filenames, gint *cancelled);
+
+/* Renames the tag file together with the files stored next to it */
+gboolean tag_files_rename(const gchar *old_tag_filename, const gchar *new_tag_filename);
+void tag_files_remove(const gchar *tag_filename);
+
+#endif
@@ -52,6 +52,8 @@
   git_diff_buffers (old_buffer, old_len, old_as_path, \
                     new_buffer, new_len, new_as_path, options, \
                     file_cb, hunk_cb, line_cb, payload)
+# define git_diff_foreach(diff, file_cb, binary_cb, hunk_cb, line_cb, payload) \
+  git_diff_foreach (diff, file_cb, hunk_cb, line_cb, payload)
 #endif
 #if ! CHECK_LIBGIT2_VERSION(0, 28)
 # define git_buf_dispose  git_buf_free
@@ -79,7 +81,7 @@ PLUGIN_SET_TRANSLATABLE_INFO (
 
 /* g_async_queue_push() doesn't allow for NULL data, so use a non-NULL fake
  * data that we know cannot ever be a valid job */
-#define QUIT_THREAD_JOB ((AsyncBlobContentsJob *) (&G_queue))
+#define QUIT_THREAD_JOB ((gpointer) (&G_queue))
 
 #define RESOURCES_ALLOCATED_QTAG \
   (g_quark_from_string (PLUGIN"/git-resources-allocated"))
@@ -87,6 +89,13 @@ PLUGIN_SET_TRANSLATABLE_INFO (
   (g_quark_from_string (PLUGIN"/git-undo-line"))
 #define DOC_ID_QTAG \
   (g_quark_from_string (PLUGIN"/git-doc-id"))
+#define DIFF_STATE_QTAG \
+  (g_quark_from_string (PLUGIN"/git-diff-state"))
+
+/* unchanged lines re-diffed around edited lines */
+#define DIFF_WINDOW_CONTEXT   3
+/* re-diff the whole document when the edited region gets larger than this */
+#define DIFF_WINDOW_MAX_LINES 2000
 
 #define REMOVED_MARKER_POS(pos) \
     ((pos) == 0 ? 0 : (pos) - 1)
@@ -102,29 +111,114 @@ enum {
   KB_GOTO_PREV_HUNK,
   KB_GOTO_NEXT_HUNK,
   KB_UNDO_HUNK,
+  KB_GOTO_PREV_CHANGED_FILE,
+  KB_GOTO_NEXT_CHANGED_FILE,
+  KB_SHOW_CHANGES,
   KB_COUNT
 };
 
 typedef void (*BlobContentsReadyFunc) (const gchar *path,
-                                       git_buf     *buf,
+                                       GBytes      *contents,
                                        gpointer     data);
 
+/* jobs for the worker thread all start with their type */
+typedef enum {
+  JOB_BLOB_CONTENTS,
+  JOB_DIFF,
+  JOB_INDEX,
+  JOB_REPO_CHANGED
+} AsyncJobType;
+
 typedef struct AsyncBlobContentsJob AsyncBlobContentsJob;
 struct AsyncBlobContentsJob {
+  AsyncJobType          type;
   gboolean              force;
   guint                 tag;
   gchar                *path;
-  git_buf               buf;
+  GBytes               *contents;
   BlobContentsReadyFunc callback;
   gpointer              user_data;
 };
 
+typedef struct DiffHunk DiffHunk;
+struct DiffHunk {
+  gint old_start;
+  gint old_lines;
+  gint new_start;
+  gint new_lines;
+};
+
+/* diffs a snapshot of the document (or of a range of its lines) against its
+ * HEAD blob */
+typedef struct AsyncDiffJob AsyncDiffJob;
+struct AsyncDiffJob {
+  AsyncJobType  type;
+  guint         doc_id;
+  gint          serial;
+  GBytes       *old_contents;
+  gsize         old_offset;   /* diffed range of old_contents */
+  gsize         old_len;
+  gchar        *new_buf;      /* UTF-8 snapshot of the document */
+  gsize         new_len;
+  gboolean      has_bom;
+  gchar        *encoding;
+  /* for windowed diffs, the re-diffed lines as of the last diff (1-based
+   * and inclusive, like hunk lines) and the number of lines added since */
+  gboolean      windowed;
+  gint          start;
+  gint          end;
+  gint          old_start;
+  gint          lines_delta;
+  GArray       *hunks;        /* of DiffHunk */
+  GArray       *line_starts;  /* of gsize, offsets of the lines in
+                               * old_contents, only for full diffs */
+};
+
+/* a file of the working tree differing from HEAD */
+typedef struct ChangedFile ChangedFile;
+struct ChangedFile {
+  gchar  *path;   /* absolute, in locale encoding */
+  GArray *hunks;  /* of DiffHunk */
+};
+
+/* computes the working tree changes in the repositories of @paths */
+typedef struct AsyncIndexJob AsyncIndexJob;
+struct AsyncIndexJob {
+  AsyncJobType  type;
+  /* whether to re-index the whole repositories, or only @paths (and the
+   * repositories not indexed yet) */
+  gboolean      full;
+  GPtrArray    *paths;  /* of gchar*, locale encoding */
+  GPtrArray    *files;  /* of ChangedFile */
+};
+
+/* the HEAD of a repository changed, so its open instance is stale */
+typedef struct AsyncRepoChangedJob AsyncRepoChangedJob;
+struct AsyncRepoChangedJob {
+  AsyncJobType  type;
+  gchar        *repo_path;  /* as returned by git_repository_path() */
+};
+
+/* the last diff applied to a document and what changed since */
+typedef struct DiffState DiffState;
+struct DiffState {
+  GBytes   *contents;     /* the blob the hunks are relative to */
+  GArray   *line_starts;  /* of gsize, offsets of the lines in contents */
+  GArray   *hunks;        /* of DiffHunk, ordered */
+  /* edited region since the last diff, in current document lines
+   * (0-based and inclusive) */
+  gboolean  dirty;
+  gint      dirty_first;
+  gint      dirty_last;
+  gint      lines_delta;  /* number of lines added since the last diff */
+};
+
 typedef struct TooltipHunkData TooltipHunkData;
 struct TooltipHunkData {
   gint            line;
   gboolean        found;
   GeanyDocument  *doc;
-  const git_buf  *buf;
+  GBytes         *buf;
   GtkTooltip     *tooltip;
 };
 
@@ -177,17 +271,36 @@ static void         write_setting_boolean       (GKeyFile      *kf,
                                                  const gchar   *group,
                                                  const gchar   *key,
                                                  gconstpointer  value);
+static int          diff_buffers                (const gchar     *old_buf,
+                                                 gsize            old_len,
+                                                 const gchar     *new_buf,
+                                                 gsize            new_len,
+                                                 gboolean         has_bom,
+                                                 const gchar     *encoding,
+                                                 git_diff_hunk_cb hunk_cb,
+                                                 void            *payload);
+static gboolean     report_diff_in_idle         (gpointer data);
+static gboolean     report_index_in_idle        (gpointer data);
+static gboolean     encoding_needs_conversion   (const gchar *encoding);
 
 
 /* cache */
-static git_buf          G_blob_contents       = { 0 };
+static GBytes          *G_blob_contents       = NULL;
 static guint            G_blob_contents_tag   = 0;
+/* incremented for each diff update request, so results of diffs started
+ * before the last request can be discarded */
+static gint             G_diff_serial         = 0;
 /* global state */
 static GAsyncQueue     *G_queue               = NULL;
 static GThread         *G_thread              = NULL;
 static gulong           G_source_id           = 0;
 static gboolean         G_monitoring_enabled  = TRUE;
 static GtkWidget       *G_undo_menu_item      = NULL;
+static GtkWidget       *G_changes_menu_item   = NULL;
+/* working tree changes of the repositories of open documents:
+ * locale path -> ChangedFile */
+static GHashTable      *G_change_index        = NULL;
+static guint            G_index_source_id     = 0;
 static struct {
   gint    num;
   gint    style;
@@ -238,12 +351,35 @@ buf_zero (git_buf *buf)
   }
 }
 
+static void
+free_git_buf (gpointer data)
+{
+  git_buf *buf = data;
+  
+  git_buf_dispose (buf);
+  g_slice_free1 (sizeof *buf, buf);
+}
+
+/* creates a GBytes taking ownership of the contents of @buf, which is
+ * zeroed */
+static GBytes *
+bytes_new_take_git_buf (git_buf *buf)
+{
+  git_buf *owned = g_slice_alloc (sizeof *owned);
+  
+  *owned = *buf;
+  buf_zero (buf);
+  
+  return g_bytes_new_with_free_func (owned->ptr, owned->size,
+                                     free_git_buf, owned);
+}
+
 static void
 clear_cached_blob_contents (void)
 {
-  if (G_blob_contents.ptr) {
-    git_buf_dispose (&G_blob_contents);
-    buf_zero (&G_blob_contents);
+  if (G_blob_contents) {
+    g_bytes_unref (G_blob_contents);
+    G_blob_contents = NULL;
   }
   G_blob_contents_tag = 0;
 }
@@ -296,40 +432,36 @@ get_blob_contents (git_buf     *out,
 #endif
 }
 
-/* get the file blob for @relpath at HEAD */
+/* get the file blob for @relpath at commit @commit_id (usually HEAD) */
 static gboolean
 repo_get_file_blob_contents (git_repository  *repo,
+                             const git_oid   *commit_id,
                              const gchar     *relpath,
                              git_buf         *contents,
                              int              check_for_binary_data)
 {
-  git_reference  *head    = NULL;
-  gboolean        success = FALSE;
+  git_commit *commit  = NULL;
+  gboolean    success = FALSE;
   
-  if (git_repository_head (&head, repo) == 0) {
-    git_commit *commit = NULL;
+  if (git_commit_lookup (&commit, repo, commit_id) == 0) {
+    git_tree *tree = NULL;
     
-    if (git_commit_lookup (&commit, repo, git_reference_target (head)) == 0) {
-      git_tree *tree = NULL;
+    if (git_commit_tree (&tree, commit) == 0) {
+      git_tree_entry *entry = NULL;
       
-      if (git_commit_tree (&tree, commit) == 0) {
-        git_tree_entry *entry = NULL;
+      if (git_tree_entry_bypath (&entry, tree, relpath) == 0) {
+        git_blob *blob;
         
-        if (git_tree_entry_bypath (&entry, tree, relpath) == 0) {
-          git_blob *blob;
-          
-          if (git_blob_lookup (&blob, repo, git_tree_entry_id (entry)) == 0) {
-            success = get_blob_contents (contents, blob, relpath,
-                                         check_for_binary_data);
-            git_blob_free (blob);
-          }
-          git_tree_entry_free (entry);
+        if (git_blob_lookup (&blob, repo, git_tree_entry_id (entry)) == 0) {
+          success = get_blob_contents (contents, blob, relpath,
+                                       check_for_binary_data);
+          git_blob_free (blob);
         }
-        git_tree_free (tree);
+        git_tree_entry_free (entry);
       }
-      git_commit_free (commit);
+      git_tree_free (tree);
     }
-    git_reference_free (head);
+    git_commit_free (commit);
   }
   
   return success;
@@ -340,9 +472,9 @@ free_job (gpointer data)
 {
   AsyncBlobContentsJob *job = data;
   
-  /* unlikely, but if we still have the buffer, free it */
-  if (job->buf.ptr) {
-    git_buf_dispose (&job->buf);
+  /* unlikely, but if we still have the contents, free them */
+  if (job->contents) {
+    g_bytes_unref (job->contents);
   }
   g_free (job->path);
   g_slice_free1 (sizeof *job, job);
@@ -355,12 +487,11 @@ report_work_in_idle (gpointer data)
   
   /* update cached blob */
   clear_cached_blob_contents ();
-  G_blob_contents = job->buf;
-  G_blob_contents_tag = job->buf.ptr ? job->tag : 0;
+  G_blob_contents = job->contents;
+  G_blob_contents_tag = job->contents ? job->tag : 0;
+  job->contents = NULL;
   
-  job->callback (job->path, job->buf.ptr ? &job->buf : NULL, job->user_data);
-  
-  buf_zero (&job->buf);
+  job->callback (job->path, G_blob_contents, job->user_data);
   
   return FALSE;
 }
@@ -462,112 +593,782 @@ get_path_in_repository (git_repository *repo,
 #endif
 }
 
-static gpointer
-worker_thread (gpointer data)
+static void
+free_diff_job (gpointer data)
+{
+  AsyncDiffJob *job = data;
+  
+  g_bytes_unref (job->old_contents);
+  g_free (job->new_buf);
+  g_free (job->encoding);
+  if (job->hunks) {
+    g_array_free (job->hunks, TRUE);
+  }
+  if (job->line_starts) {
+    g_array_free (job->line_starts, TRUE);
+  }
+  g_slice_free1 (sizeof *job, job);
+}
+
+static int
+collect_diff_hunk_cb (const git_diff_delta *delta,
+                      const git_diff_hunk  *hunk,
+                      void                 *data)
 {
-  GAsyncQueue          *queue       = data;
-  git_repository       *repo        = NULL;
-  GFileMonitor         *monitors[2] = { NULL, NULL };
-  AsyncBlobContentsJob *job;
-  guint                 i;
+  AsyncDiffJob *job = data;
+  DiffHunk      h;
   
-  while ((job = g_async_queue_pop (queue)) != QUIT_THREAD_JOB) {
-    const gchar *path = job->path;
+  /* windowed diffs see line 1 as the first line of the window */
+  h.old_start = hunk->old_start + (job->windowed ? job->old_start - 1 : 0);
+  h.old_lines = hunk->old_lines;
+  h.new_start = hunk->new_start + (job->windowed ? job->start - 1 : 0);
+  h.new_lines = hunk->new_lines;
+  g_array_append_val (job->hunks, h);
+  
+  return 0;
+}
+
+/* the offsets at which the lines start, as counted by Git */
+static GArray *
+get_line_starts (GBytes *contents)
+{
+  GArray       *line_starts = g_array_new (FALSE, FALSE, sizeof (gsize));
+  gsize         len;
+  const gchar  *buf = g_bytes_get_data (contents, &len);
+  const gchar  *p   = buf;
+  const gchar  *end = buf + len;
+  
+  while (p < end) {
+    gsize offset = (gsize) (p - buf);
+    
+    g_array_append_val (line_starts, offset);
+    p = memchr (p, '\n', (gsize) (end - p));
+    if (! p) {
+      break;
+    }
+    p++;
+  }
+  
+  return line_starts;
+}
+
+static void
+run_diff_job (AsyncDiffJob *job)
+{
+  /* don't bother if the document changed again in the meantime, a new diff
+   * job is coming */
+  if (job->serial == g_atomic_int_get (&G_diff_serial)) {
+    const gchar *old_buf = g_bytes_get_data (job->old_contents, NULL);
     
-    if (repo && (job->force ||
-                 ! path_dir_contains (path, git_repository_workdir (repo)))) {
-      /* FIXME: this can fail with nested repositories */
+    job->hunks = g_array_new (FALSE, FALSE, sizeof (DiffHunk));
+    diff_buffers (old_buf ? old_buf + job->old_offset : NULL, job->old_len,
+                  job->new_buf, job->new_len,
+                  /* the BOM is part of the first line */
+                  job->has_bom && (! job->windowed || job->start == 1),
+                  job->encoding, collect_diff_hunk_cb, job);
+    if (! job->windowed) {
+      job->line_starts = get_line_starts (job->old_contents);
+    }
+  }
+  /* the snapshot is not needed anymore */
+  g_free (job->new_buf);
+  job->new_buf = NULL;
+  
+  g_idle_add_full (G_PRIORITY_LOW, report_diff_in_idle, job, free_diff_job);
+}
+
+/* --- state of the worker thread --- */
+
+/* maximum number of repositories kept open */
+#define MAX_OPEN_REPOS          8
+/* memory budget for cached HEAD blobs */
+#define BLOB_CACHE_MAX_SIZE     (64 * 1024 * 1024)
+
+typedef struct RepoEntry RepoEntry;
+struct RepoEntry {
+  git_repository *repo;
+  GFileMonitor   *monitors[2];
+  gboolean        indexed;  /* whether it was part of a change index job */
+};
+
+typedef struct BlobCacheEntry BlobCacheEntry;
+struct BlobCacheEntry {
+  gchar  *key;
+  GBytes *contents;
+  GList  *link;       /* in WorkerState::blob_lru */
+};
+
+/* only ever accessed from the worker thread */
+typedef struct WorkerState WorkerState;
+struct WorkerState {
+  GQueue      repos;        /* of RepoEntry, most recently used first */
+  GHashTable *dir_repos;    /* directory -> RepoEntry containing it */
+  GHashTable *blobs;        /* key -> BlobCacheEntry */
+  GQueue      blob_lru;     /* of BlobCacheEntry, most recently used first */
+  gsize       blob_cache_size;
+};
+
+static void
+repo_entry_free (RepoEntry *entry)
+{
+  guint i;
+  
+  for (i = 0; i < G_N_ELEMENTS (entry->monitors); i++) {
+    if (entry->monitors[i]) {
+      g_object_unref (entry->monitors[i]);
+    }
+  }
+  git_repository_free (entry->repo);
+  g_slice_free1 (sizeof *entry, entry);
+}
+
+static void
+blob_cache_entry_free (gpointer data)
+{
+  BlobCacheEntry *entry = data;
+  
+  g_free (entry->key);
+  g_bytes_unref (entry->contents);
+  g_slice_free1 (sizeof *entry, entry);
+}
+
+static void
+worker_state_init (WorkerState *ws)
+{
+  g_queue_init (&ws->repos);
+  ws->dir_repos = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  ws->blobs = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                     blob_cache_entry_free);
+  g_queue_init (&ws->blob_lru);
+  ws->blob_cache_size = 0;
+}
+
+static void
+worker_state_clear (WorkerState *ws)
+{
+  g_hash_table_destroy (ws->dir_repos);
+  g_queue_foreach (&ws->repos, (GFunc) repo_entry_free, NULL);
+  g_queue_clear (&ws->repos);
+  g_queue_clear (&ws->blob_lru);
+  g_hash_table_destroy (ws->blobs);
+}
+
+static void
+close_repo (WorkerState *ws,
+            RepoEntry   *entry)
+{
+  GHashTableIter  iter;
+  gpointer        value;
+  
+  g_hash_table_iter_init (&iter, ws->dir_repos);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    if (value == entry) {
+      g_hash_table_iter_remove (&iter);
+    }
+  }
+  g_queue_remove (&ws->repos, entry);
+  repo_entry_free (entry);
+}
+
+static RepoEntry *
+open_repo (WorkerState *ws,
+           const gchar *dirname,
+           gboolean     force)
+{
+  git_repository *repo  = NULL;
+  RepoEntry      *entry = NULL;
+  GList          *item;
+  
+  if (git_repository_open_ext (&repo, dirname, 0, NULL) != 0) {
+    return NULL;
+  }
+  if (git_repository_is_bare (repo)) {
+    git_repository_free (repo);
+    return NULL;
+  }
+  
+  /* another directory of an already open repository */
+  for (item = ws->repos.head; item; item = item->next) {
+    RepoEntry *open_entry = item->data;
+    
+    if (strcmp (git_repository_path (open_entry->repo),
+                git_repository_path (repo)) == 0) {
+      if (force) {
+        close_repo (ws, open_entry);
+        break;
+      }
       git_repository_free (repo);
-      repo = NULL;
-      for (i = 0; i < G_N_ELEMENTS (monitors); i++) {
-        if (monitors[i]) {
-          g_object_unref (monitors[i]);
-          monitors[i] = NULL;
-        }
+      g_queue_unlink (&ws->repos, item);
+      g_queue_push_head_link (&ws->repos, item);
+      return open_entry;
+    }
+  }
+  
+  entry = g_slice_alloc0 (sizeof *entry);
+  entry->repo = repo;
+  if (G_monitoring_enabled) {
+    /* we need to monitor HEAD, in case of e.g. branch switch (e.g.
+     * git checkout -b will switch the ref we need to watch) */
+    entry->monitors[0] = monitor_repo_file (repo, "HEAD",
+                                            G_CALLBACK (on_git_repo_changed),
+                                            GINT_TO_POINTER (TRUE));
+    if (entry->monitors[0]) {
+      /* to know which repository to reopen when HEAD changes */
+      g_object_set_data_full (G_OBJECT (entry->monitors[0]), "repo-path",
+                              g_strdup (git_repository_path (repo)), g_free);
+    }
+    /* and of course the real ref (branch) for when changes get committed */
+    entry->monitors[1] = monitor_head_ref (repo, G_CALLBACK (on_git_repo_changed),
+                                           GINT_TO_POINTER (FALSE));
+  }
+  
+  g_queue_push_head (&ws->repos, entry);
+  while (ws->repos.length > MAX_OPEN_REPOS) {
+    close_repo (ws, g_queue_peek_tail (&ws->repos));
+  }
+  
+  return entry;
+}
+
+/* gets the (possibly already open) repository containing @path.  @force
+ * reopens it, e.g. to update the monitors after a branch switch */
+static RepoEntry *
+get_repo_for_path (WorkerState *ws,
+                   const gchar *path,
+                   gboolean     force)
+{
+  gchar     *dirname  = g_path_get_dirname (path);
+  RepoEntry *entry    = g_hash_table_lookup (ws->dir_repos, dirname);
+  
+  if (entry && force) {
+    close_repo (ws, entry);
+    entry = NULL;
+  }
+  
+  if (entry) {
+    /* move to the front of the LRU list */
+    g_queue_remove (&ws->repos, entry);
+    g_queue_push_head (&ws->repos, entry);
+    g_free (dirname);
+  } else {
+    entry = open_repo (ws, dirname, force);
+    if (entry) {
+      g_hash_table_insert (ws->dir_repos, dirname, entry);
+    } else {
+      g_free (dirname);
+    }
+  }
+  
+  return entry;
+}
+
+/* closes the open repository whose HEAD changed, it gets reopened with
+ * up-to-date monitors on its next use */
+static void
+run_repo_changed_job (WorkerState         *ws,
+                      AsyncRepoChangedJob *job)
+{
+  GList *item;
+  
+  for (item = ws->repos.head; item; item = item->next) {
+    RepoEntry *entry = item->data;
+    
+    if (strcmp (git_repository_path (entry->repo), job->repo_path) == 0) {
+      close_repo (ws, entry);
+      break;
+    }
+  }
+  
+  g_free (job->repo_path);
+  g_slice_free1 (sizeof *job, job);
+}
+
+static GBytes *
+blob_cache_lookup (WorkerState *ws,
+                   const gchar *key)
+{
+  BlobCacheEntry *entry = g_hash_table_lookup (ws->blobs, key);
+  
+  if (! entry) {
+    return NULL;
+  }
+  
+  g_queue_unlink (&ws->blob_lru, entry->link);
+  g_queue_push_head_link (&ws->blob_lru, entry->link);
+  
+  return g_bytes_ref (entry->contents);
+}
+
+static void
+blob_cache_insert (WorkerState *ws,
+                   gchar       *key,
+                   GBytes      *contents)
+{
+  BlobCacheEntry *entry = g_slice_alloc (sizeof *entry);
+  
+  entry->key      = key;
+  entry->contents = g_bytes_ref (contents);
+  g_queue_push_head (&ws->blob_lru, entry);
+  entry->link     = ws->blob_lru.head;
+  g_hash_table_insert (ws->blobs, key, entry);
+  ws->blob_cache_size += g_bytes_get_size (contents);
+  
+  /* evict the least recently used blobs, but always keep the new one */
+  while (ws->blob_cache_size > BLOB_CACHE_MAX_SIZE && ws->blob_lru.length > 1) {
+    BlobCacheEntry *old = g_queue_pop_tail (&ws->blob_lru);
+    
+    ws->blob_cache_size -= g_bytes_get_size (old->contents);
+    g_hash_table_remove (ws->blobs, old->key);
+  }
+}
+
+/* gets the contents of @path at HEAD, from the cache if possible */
+static GBytes *
+get_head_blob_contents (WorkerState *ws,
+                        const gchar *path,
+                        gboolean     force)
+{
+  RepoEntry *entry    = get_repo_for_path (ws, path, force);
+  GBytes    *contents = NULL;
+  gchar     *relpath;
+  git_oid    head_id;
+  
+  if (! entry ||
+      ! (relpath = get_path_in_repository (entry->repo, path))) {
+    return NULL;
+  }
+  
+  if (git_reference_name_to_id (&head_id, entry->repo, "HEAD") == 0) {
+    gchar   oid_str[GIT_OID_HEXSZ + 1];
+    gchar  *key;
+    
+    git_oid_tostr (oid_str, sizeof oid_str, &head_id);
+    key = g_strconcat (git_repository_path (entry->repo), "\n",
+                       relpath, "\n", oid_str, NULL);
+    contents = blob_cache_lookup (ws, key);
+    if (contents) {
+      g_free (key);
+    } else {
+      git_buf buf;
+      
+      buf_zero (&buf);
+      if (repo_get_file_blob_contents (entry->repo, &head_id, relpath, &buf, 0)) {
+        contents = bytes_new_take_git_buf (&buf);
+        blob_cache_insert (ws, key, contents);
+      } else {
+        git_buf_dispose (&buf);
+        g_free (key);
       }
     }
-    if (! repo) {
-      gchar *dirname = g_path_get_dirname (path);
-      if (git_repository_open_ext (&repo, dirname, 0, NULL) == 0) {
-        if (git_repository_is_bare (repo)) {
-          git_repository_free (repo);
-          repo = NULL;
-        } else if (G_monitoring_enabled) {
-          /* we need to monitor HEAD, in case of e.g. branch switch (e.g.
-           * git checkout -b will switch the ref we need to watch) */
-          monitors[0] = monitor_repo_file (repo, "HEAD",
-                                           G_CALLBACK (on_git_repo_changed),
-                                           GINT_TO_POINTER (TRUE));
-          /* and of course the real ref (branch) for when changes get committed */
-          monitors[1] = monitor_head_ref (repo, G_CALLBACK (on_git_repo_changed),
-                                          GINT_TO_POINTER (FALSE));
-        }
+  }
+  
+  g_free (relpath);
+  
+  return contents;
+}
+
+static void
+changed_file_free (gpointer data)
+{
+  ChangedFile *file = data;
+  
+  g_free (file->path);
+  g_array_free (file->hunks, TRUE);
+  g_slice_free1 (sizeof *file, file);
+}
+
+static void
+free_index_job (gpointer data)
+{
+  AsyncIndexJob *job = data;
+  
+  g_ptr_array_free (job->paths, TRUE);
+  g_ptr_array_free (job->files, TRUE);
+  g_slice_free1 (sizeof *job, job);
+}
+
+typedef struct IndexDiffData IndexDiffData;
+struct IndexDiffData {
+  git_repository *repo;
+  GPtrArray      *files;
+  ChangedFile    *file;  /* file receiving the hunks, if any */
+};
+
+static int
+index_diff_file_cb (const git_diff_delta *delta,
+                    float                 progress,
+                    void                 *payload)
+{
+  IndexDiffData *data = payload;
+  
+  data->file = NULL;
+  /* deleted files cannot be opened, so they are not interesting */
+  if (delta->status != GIT_DELTA_DELETED) {
+    data->file = g_slice_alloc (sizeof *data->file);
+    data->file->path = g_build_filename (git_repository_workdir (data->repo),
+                                         delta->new_file.path, NULL);
+    data->file->hunks = g_array_new (FALSE, FALSE, sizeof (DiffHunk));
+    g_ptr_array_add (data->files, data->file);
+  }
+  
+  return 0;
+}
+
+static int
+index_diff_hunk_cb (const git_diff_delta *delta,
+                    const git_diff_hunk  *hunk,
+                    void                 *payload)
+{
+  IndexDiffData *data = payload;
+  
+  if (data->file) {
+    DiffHunk h;
+    
+    h.old_start = hunk->old_start;
+    h.old_lines = hunk->old_lines;
+    h.new_start = hunk->new_start;
+    h.new_lines = hunk->new_lines;
+    g_array_append_val (data->file->hunks, h);
+  }
+  
+  return 0;
+}
+
+/* diffs HEAD against the working tree of @repo, or only @relpath if not
+ * %NULL, adding files with changes to @files */
+static void
+index_repo_changes (git_repository *repo,
+                    const gchar    *relpath,
+                    GPtrArray      *files)
+{
+  git_diff_options  opts;
+  git_diff         *diff  = NULL;
+  git_tree         *tree  = NULL;
+  git_oid           head_id;
+  IndexDiffData     data  = { repo, files, NULL };
+  guint             first = files->len;
+  guint             i;
+  
+  /* without HEAD (e.g. no commit yet), diff against an empty tree */
+  if (git_reference_name_to_id (&head_id, repo, "HEAD") == 0) {
+    git_commit *commit = NULL;
+    
+    if (git_commit_lookup (&commit, repo, &head_id) == 0) {
+      git_commit_tree (&tree, commit);
+      git_commit_free (commit);
+    }
+  }
+  
+  git_diff_options_init (&opts, GIT_DIFF_OPTIONS_VERSION);
+  opts.context_lines = 0;
+  if (relpath) {
+    opts.pathspec.strings = (char **) &relpath;
+    opts.pathspec.count = 1;
+    opts.flags |= GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+  }
+  
+  if (git_diff_tree_to_workdir (&diff, repo, tree, &opts) == 0) {
+    git_diff_foreach (diff, index_diff_file_cb, NULL, index_diff_hunk_cb,
+                      NULL, &data);
+    git_diff_free (diff);
+  }
+  if (tree) {
+    git_tree_free (tree);
+  }
+  
+  /* binary files and mode changes don't have any lines to show */
+  for (i = files->len; i > first; i--) {
+    ChangedFile *file = g_ptr_array_index (files, i - 1);
+    
+    if (file->hunks->len == 0) {
+      g_ptr_array_remove_index (files, i - 1);
+    }
+  }
+}
+
+static void
+run_index_job (WorkerState   *ws,
+               AsyncIndexJob *job)
+{
+  GList *item;
+  guint  i;
+  
+  if (job->full) {
+    for (item = ws->repos.head; item; item = item->next) {
+      ((RepoEntry *) item->data)->indexed = FALSE;
+    }
+  }
+  
+  for (i = 0; i < job->paths->len; i++) {
+    const gchar *path   = g_ptr_array_index (job->paths, i);
+    RepoEntry   *entry  = get_repo_for_path (ws, path, FALSE);
+    
+    if (! entry) {
+      continue;
+    } else if (! entry->indexed) {
+      index_repo_changes (entry->repo, NULL, job->files);
+      entry->indexed = TRUE;
+    } else if (! job->full) {
+      gchar *relpath = get_path_in_repository (entry->repo, path);
+      
+      if (relpath) {
+        index_repo_changes (entry->repo, relpath, job->files);
+        g_free (relpath);
       }
-      g_free(dirname);
     }
+  }
+  
+  g_idle_add_full (G_PRIORITY_LOW, report_index_in_idle, job, free_index_job);
+}
+
+static gpointer
+worker_thread (gpointer data)
+{
+  GAsyncQueue          *queue = data;
+  WorkerState           ws;
+  gpointer              item;
+  
+  worker_state_init (&ws);
+  
+  while ((item = g_async_queue_pop (queue)) != QUIT_THREAD_JOB) {
+    AsyncBlobContentsJob *job = item;
     
-    buf_zero (&job->buf);
-    if (repo) {
-      gchar *relpath = get_path_in_repository (repo, path);
+    if (*((AsyncJobType *) item) == JOB_DIFF) {
+      run_diff_job (item);
+      continue;
+    } else if (*((AsyncJobType *) item) == JOB_INDEX) {
+      run_index_job (&ws, item);
+      continue;
+    } else if (*((AsyncJobType *) item) == JOB_REPO_CHANGED) {
+      run_repo_changed_job (&ws, item);
+      continue;
+    }
+    
+    job->contents = get_head_blob_contents (&ws, job->path, job->force);
+    
+    g_idle_add_full (G_PRIORITY_LOW, report_work_in_idle, job, free_job);
+  }
+  
+  worker_state_clear (&ws);
+  
+  return NULL;
+}
+
+static void
+push_job (gpointer job)
+{
+  if (! G_thread) {
+    G_queue = g_async_queue_new ();
+#if GLIB_CHECK_VERSION (2, 32, 0)
+    G_thread = g_thread_new (PLUGIN"/blob-worker", worker_thread, G_queue);
+#else
+    G_thread = g_thread_create (worker_thread, G_queue, FALSE, NULL);
+#endif
+  }
+  
+  g_async_queue_push (G_queue, job);
+}
+
+static void
+get_cached_blob_contents_async (const gchar          *path,
+                                guint                 tag,
+                                gboolean              force,
+                                BlobContentsReadyFunc callback,
+                                gpointer              user_data)
+{
+  if ((! force && G_blob_contents && tag == G_blob_contents_tag) ||
+      ! path) {
+    callback (path, G_blob_contents, user_data);
+  } else {
+    AsyncBlobContentsJob *job = g_slice_alloc (sizeof *job);
+    
+    job->type       = JOB_BLOB_CONTENTS;
+    job->force      = force;
+    job->tag        = tag;
+    job->path       = g_strdup (path);
+    job->callback   = callback;
+    job->user_data  = user_data;
+    job->contents   = NULL;
+    
+    push_job (job);
+    /* cppcheck-suppress memleak symbolName=job */
+  }
+}
+
+static void
+diff_state_free (gpointer data)
+{
+  DiffState *state = data;
+  
+  g_bytes_unref (state->contents);
+  g_array_free (state->line_starts, TRUE);
+  g_array_free (state->hunks, TRUE);
+  g_slice_free1 (sizeof *state, state);
+}
+
+static DiffState *
+get_diff_state (ScintillaObject *sci)
+{
+  return g_object_get_qdata (G_OBJECT (sci), DIFF_STATE_QTAG);
+}
+
+/* the last line of @hunk in the new file, or the line after which lines got
+ * removed */
+static gint
+hunk_new_end (const DiffHunk *hunk)
+{
+  return hunk->new_start + MAX (hunk->new_lines - 1, 0);
+}
+
+/* maps an unchanged line of the document as of the last diff to the
+ * corresponding line of the blob */
+static gint
+map_line_to_old (GArray *hunks,
+                 gint    line)
+{
+  guint i;
+  
+  for (i = 0; i < hunks->len; i++) {
+    const DiffHunk *hunk = &g_array_index (hunks, DiffHunk, i);
+    
+    if (hunk_new_end (hunk) >= line) {
+      break;
+    }
+    line -= hunk->new_lines - hunk->old_lines;
+  }
+  
+  return line;
+}
+
+/* computes the lines to re-diff after the edits recorded in @state: the
+ * edited lines with some context, extended so that no hunk crosses the
+ * window boundaries.  @start and @end are lines as of the last diff and
+ * @old_start and @old_end the corresponding lines of the blob, all 1-based
+ * and inclusive.  Returns %FALSE if the window would be too large */
+static gboolean
+get_diff_window (DiffState *state,
+                 gint       n_doc_lines,
+                 gint      *start,
+                 gint      *end,
+                 gint      *old_start,
+                 gint      *old_end)
+{
+  gint      n_lines = n_doc_lines - state->lines_delta;
+  gint      a       = state->dirty_first + 1 - DIFF_WINDOW_CONTEXT;
+  gint      b       = state->dirty_last + 1 - state->lines_delta + DIFF_WINDOW_CONTEXT;
+  gboolean  changed = TRUE;
+  guint     i;
+  
+  while (changed) {
+    changed = FALSE;
+    for (i = 0; i < state->hunks->len; i++) {
+      const DiffHunk *hunk = &g_array_index (state->hunks, DiffHunk, i);
       
-      if (relpath) {
-        if (! repo_get_file_blob_contents (repo, relpath, &job->buf, 0)) {
-          git_buf_dispose (&job->buf);
-          buf_zero (&job->buf);
+      /* lines just outside the window have to be unchanged */
+      if (hunk->new_lines > 0 &&
+          hunk->new_start <= b + 1 && hunk_new_end (hunk) >= a - 1) {
+        if (hunk->new_start < a) {
+          a = hunk->new_start;
+          changed = TRUE;
+        }
+        if (hunk_new_end (hunk) > b) {
+          b = hunk_new_end (hunk);
+          changed = TRUE;
         }
-        
-        g_free (relpath);
       }
     }
-    
-    g_idle_add_full (G_PRIORITY_LOW, report_work_in_idle, job, free_job);
   }
   
-  for (i = 0; i < G_N_ELEMENTS (monitors); i++) {
-    if (monitors[i]) {
-      g_object_unref (monitors[i]);
-      monitors[i] = NULL;
-    }
-  }
-  if (repo) {
-    git_repository_free (repo);
+  a = MAX (a, 1);
+  b = MIN (b, n_lines);
+  
+  if (b - a > DIFF_WINDOW_MAX_LINES ||
+      b + state->lines_delta - a > DIFF_WINDOW_MAX_LINES) {
+    return FALSE;
   }
   
-  return NULL;
+  *start = a;
+  *end = b;
+  *old_start = map_line_to_old (state->hunks, a - 1) + 1;
+  *old_end = map_line_to_old (state->hunks, b + 1) - 1;
+  
+  return *old_end >= *old_start - 1 && b + state->lines_delta >= a - 1;
 }
 
-static void
-get_cached_blob_contents_async (const gchar          *path,
-                                guint                 tag,
-                                gboolean              force,
-                                BlobContentsReadyFunc callback,
-                                gpointer              user_data)
+/* offset of 1-based @line in the blob */
+static gsize
+get_old_line_offset (DiffState *state,
+                     gint       line)
 {
-  if ((! force && G_blob_contents.ptr && tag == G_blob_contents_tag) ||
-      ! path) {
-    callback (path, &G_blob_contents, user_data);
+  if (line - 1 < (gint) state->line_starts->len) {
+    return g_array_index (state->line_starts, gsize, line - 1);
   } else {
-    AsyncBlobContentsJob *job = g_slice_alloc (sizeof *job);
-    
-    job->force      = force;
-    job->tag        = tag;
-    job->path       = g_strdup (path);
-    job->callback   = callback;
-    job->user_data  = user_data;
-    buf_zero (&job->buf);
+    return g_bytes_get_size (state->contents);
+  }
+}
+
+/* diffs the current state of @doc against @contents in the worker thread,
+ * the markers are updated when the diff is ready.  When only a small region
+ * changed since the last diff against the same blob, only that region is
+ * re-diffed */
+static void
+diff_doc_async (GeanyDocument *doc,
+                GBytes        *contents)
+{
+  ScintillaObject  *sci   = doc->editor->sci;
+  DiffState        *state = get_diff_state (sci);
+  AsyncDiffJob     *job;
+  const gchar      *buf;
+  gint              n_doc_lines = sci_get_line_count (sci);
+  gint              old_end;
+  gsize             start_pos;
+  gsize             end_pos;
+  
+  if (state && state->contents == contents && ! state->dirty) {
+    /* nothing changed since the last diff */
+    gtk_widget_set_visible (G_undo_menu_item, TRUE);
+    return;
+  }
+  
+  job = g_slice_alloc0 (sizeof *job);
+  job->type         = JOB_DIFF;
+  job->doc_id       = doc->id;
+  job->serial       = g_atomic_int_get (&G_diff_serial);
+  job->old_contents = g_bytes_ref (contents);
+  job->old_offset   = 0;
+  job->old_len      = g_bytes_get_size (contents);
+  job->has_bom      = doc->has_bom;
+  job->encoding     = g_strdup (doc->encoding);
+  
+  /* lines can only be located in the blob in ASCII-compatible encodings */
+  job->windowed = (state && state->contents == contents &&
+                   ! encoding_needs_conversion (doc->encoding) &&
+                   get_diff_window (state, n_doc_lines, &job->start, &job->end,
+                                    &job->old_start, &old_end));
+  
+  if (job->windowed) {
+    job->lines_delta  = state->lines_delta;
+    job->old_offset   = get_old_line_offset (state, job->old_start);
+    job->old_len      = get_old_line_offset (state, old_end + 1) - job->old_offset;
     
-    if (! G_thread) {
-      G_queue = g_async_queue_new ();
-#if GLIB_CHECK_VERSION (2, 32, 0)
-      G_thread = g_thread_new (PLUGIN"/blob-worker", worker_thread, G_queue);
-#else
-      G_thread = g_thread_create (worker_thread, G_queue, FALSE, NULL);
-#endif
+    start_pos = sci_get_position_from_line (sci, job->start - 1);
+    if (job->end + job->lines_delta < n_doc_lines) {
+      end_pos = sci_get_position_from_line (sci, job->end + job->lines_delta);
+    } else {
+      end_pos = sci_get_length (sci);
     }
-    
-    g_async_queue_push (G_queue, job);
-    /* cppcheck-suppress memleak symbolName=job */
+  } else {
+    start_pos = 0;
+    end_pos = sci_get_length (sci);
   }
+  
+  buf = (const gchar *) scintilla_send_message (sci, SCI_GETCHARACTERPOINTER, 0, 0);
+  job->new_len = end_pos - start_pos;
+  job->new_buf = g_malloc (job->new_len + 1);
+  memcpy (job->new_buf, buf + start_pos, job->new_len);
+  job->new_buf[job->new_len] = 0;
+  
+  push_job (job);
 }
 
 static gint
@@ -653,6 +1454,7 @@ release_resources (ScintillaObject *sci)
       }
     }
     g_signal_handlers_disconnect_by_func (sci, on_sci_query_tooltip, NULL);
+    g_object_set_qdata (G_OBJECT (sci), DIFF_STATE_QTAG, NULL);
     g_object_set_qdata (G_OBJECT (sci), RESOURCES_ALLOCATED_QTAG, NULL);
   }
 }
@@ -740,31 +1542,34 @@ add_utf8_bom (gchar   **buffer,
   return TRUE;
 }
 
+/* diffs @old_contents against the UTF-8 buffer @new_buf converted to the
+ * document's encoding.  Doesn't use any GTK or Scintilla API so it can be
+ * used from the worker thread */
 static int
-diff_buf_to_doc (const git_buf   *old_buf,
-                 GeanyDocument   *doc,
-                 git_diff_hunk_cb hunk_cb,
-                 void            *payload)
+diff_buffers (const gchar     *old_buf,
+              gsize            old_len,
+              const gchar     *new_buf,
+              gsize            new_len,
+              gboolean         has_bom,
+              const gchar     *encoding,
+              git_diff_hunk_cb hunk_cb,
+              void            *payload)
 {
-  ScintillaObject  *sci = doc->editor->sci;
   git_diff_options  opts;
-  gchar            *buf;
-  size_t            len;
-  gboolean          free_buf = FALSE;
+  gchar            *buf       = (gchar *) new_buf;
+  gsize             len       = new_len;
+  gboolean          free_buf  = FALSE;
   int               ret;
   
-  buf = (gchar *) scintilla_send_message (sci, SCI_GETCHARACTERPOINTER, 0, 0);
-  len = sci_get_length (sci);
-  
   /* add the BOM if needed */
-  if (doc->has_bom) {
+  if (has_bom) {
     /* UTF-8 BOM, converted below */
     free_buf = add_utf8_bom (&buf, &len, free_buf);
   }
   /* convert the buffer back to in-file encoding if necessary */
-  if (encoding_needs_conversion (doc->encoding)) {
+  if (encoding_needs_conversion (encoding)) {
     free_buf = convert_encoding_inplace (&buf, &len, free_buf,
-                                         doc->encoding, "UTF-8", NULL);
+                                         encoding, "UTF-8", NULL);
   }
   
   git_diff_options_init (&opts, GIT_DIFF_OPTIONS_VERSION);
@@ -772,7 +1577,7 @@ diff_buf_to_doc (const git_buf   *old_buf,
   opts.context_lines = 0;
   opts.flags = GIT_DIFF_FORCE_TEXT;
   
-  ret = git_diff_buffers (old_buf->ptr, old_buf->size, NULL,
+  ret = git_diff_buffers (old_buf, old_len, NULL,
                           buf, len, NULL, &opts, NULL, NULL, hunk_cb, NULL,
                           payload);
   
@@ -784,31 +1589,118 @@ diff_buf_to_doc (const git_buf   *old_buf,
 }
 
 static int
-diff_hunk_cb (const git_diff_delta *delta,
-              const git_diff_hunk  *hunk,
-              void                 *data)
+diff_buf_to_doc (GBytes          *old_contents,
+                 GeanyDocument   *doc,
+                 git_diff_hunk_cb hunk_cb,
+                 void            *payload)
+{
+  ScintillaObject  *sci = doc->editor->sci;
+  const gchar      *buf;
+  const gchar      *old_buf;
+  gsize             old_len;
+  
+  buf = (const gchar *) scintilla_send_message (sci, SCI_GETCHARACTERPOINTER, 0, 0);
+  old_buf = g_bytes_get_data (old_contents, &old_len);
+  
+  return diff_buffers (old_buf, old_len, buf, sci_get_length (sci),
+                       doc->has_bom, doc->encoding, hunk_cb, payload);
+}
+
+/* sets in @masks the markers @hunk puts on lines @first to @last */
+static void
+add_hunk_marker_masks (guint8         *masks,
+                       gint            first,
+                       gint            last,
+                       const DiffHunk *hunk)
 {
-  ScintillaObject *sci = data;
   gint line;
   
   if (hunk->new_lines > 0) {
     guint marker = hunk->old_lines > 0 ? MARKER_LINE_CHANGED : MARKER_LINE_ADDED;
+    gint  start  = MAX (hunk->new_start - 1, first);
+    gint  end    = MIN (hunk->new_start - 1 + hunk->new_lines - 1, last);
     
-    for (line = hunk->new_start; line < hunk->new_start + hunk->new_lines; line++) {
-      scintilla_send_message (sci, SCI_MARKERADD, line - 1, G_markers[marker].num);
+    for (line = start; line <= end; line++) {
+      masks[line - first] |= 1 << marker;
     }
   } else {
     line = REMOVED_MARKER_POS (hunk->new_start);
-    scintilla_send_message (sci, SCI_MARKERADD, line,
-                            G_markers[MARKER_LINE_REMOVED].num);
+    if (line >= first && line <= last) {
+      masks[line - first] |= 1 << MARKER_LINE_REMOVED;
+    }
+  }
+}
+
+/* updates the markers of lines @first to @last to match @hunks, touching only
+ * the lines whose markers actually change */
+static void
+sync_markers (ScintillaObject *sci,
+              GArray          *hunks,
+              gint             first,
+              gint             last)
+{
+  guint8 *wanted;
+  guint8 *current;
+  gint    all_markers = 0;
+  gint    line;
+  guint   i;
+  
+  last = MIN (last, sci_get_line_count (sci) - 1);
+  first = MAX (first, 0);
+  if (last < first) {
+    return;
   }
   
-  return 0;
+  wanted = g_malloc0 ((gsize) (last - first + 1));
+  current = g_malloc0 ((gsize) (last - first + 1));
+  
+  for (i = 0; i < hunks->len; i++) {
+    const DiffHunk *hunk = &g_array_index (hunks, DiffHunk, i);
+    
+    if (hunk->new_start - 1 > last) {
+      break;
+    }
+    add_hunk_marker_masks (wanted, first, last, hunk);
+  }
+  
+  for (i = 0; i < MARKER_COUNT; i++) {
+    all_markers |= 1 << G_markers[i].num;
+  }
+  line = first - 1;
+  while ((line = scintilla_send_message (sci, SCI_MARKERNEXT, line + 1,
+                                         all_markers)) >= 0 &&
+         line <= last) {
+    gint mask = scintilla_send_message (sci, SCI_MARKERGET, line, 0);
+    
+    for (i = 0; i < MARKER_COUNT; i++) {
+      if (mask & (1 << G_markers[i].num)) {
+        current[line - first] |= 1 << i;
+      }
+    }
+  }
+  
+  for (line = first; line <= last; line++) {
+    guint8 changed = wanted[line - first] ^ current[line - first];
+    
+    for (i = 0; changed && i < MARKER_COUNT; i++) {
+      if (! (changed & (1 << i))) {
+        continue;
+      }
+      if (wanted[line - first] & (1 << i)) {
+        scintilla_send_message (sci, SCI_MARKERADD, line, G_markers[i].num);
+      } else {
+        scintilla_send_message (sci, SCI_MARKERDELETE, line, G_markers[i].num);
+      }
+    }
+  }
+  
+  g_free (wanted);
+  g_free (current);
 }
 
 static GtkWidget *
 get_widget_for_buf_range (GeanyDocument *doc,
-                          const git_buf *contents,
+                          GBytes        *contents,
                           gint           line_start,
                           gint           n_lines)
 {
@@ -819,8 +1711,9 @@ get_widget_for_buf_range (GeanyDocument *doc,
   gint                    zoom;
   gint                    i;
   GtkAllocation           alloc;
-  gchar                  *buf       = contents->ptr;
-  gsize                   buf_len   = contents->size;
+  gsize                   buf_len;
+  gchar                  *buf       = (gchar *) g_bytes_get_data (contents,
+                                                                  &buf_len);
   gboolean                free_buf  = FALSE;
   
   gtk_widget_get_allocation (GTK_WIDGET (doc->editor->sci), &alloc);
@@ -942,7 +1835,7 @@ on_sci_query_tooltip (GtkWidget  *widget,
   max_x = min_x + scintilla_send_message (sci, SCI_GETMARGINWIDTHN, 1, 0);
   
   if (x >= min_x && x <= max_x &&
-      G_blob_contents.ptr && G_blob_contents_tag == doc->id) {
+      G_blob_contents && G_blob_contents_tag == doc->id) {
     gint pos  = scintilla_send_message (sci, SCI_POSITIONFROMPOINT, x, y);
     gint line = sci_get_line_from_position (sci, pos);
     gint mask = scintilla_send_message (sci, SCI_MARKERGET, line, 0);
@@ -950,9 +1843,9 @@ on_sci_query_tooltip (GtkWidget  *widget,
     if (mask & ((1 << G_markers[MARKER_LINE_CHANGED].num) |
                 (1 << G_markers[MARKER_LINE_REMOVED].num))) {
       TooltipHunkData thd = TOOLTIP_HUNK_DATA_INIT (line + 1, doc,
-                                                    &G_blob_contents, tooltip);
+                                                    G_blob_contents, tooltip);
       
-      diff_buf_to_doc (&G_blob_contents, doc, tooltip_diff_hunk_cb, &thd);
+      diff_buf_to_doc (G_blob_contents, doc, tooltip_diff_hunk_cb, &thd);
       has_tooltip = thd.found;
     }
   }
@@ -960,9 +1853,100 @@ on_sci_query_tooltip (GtkWidget  *widget,
   return has_tooltip;
 }
 
+static void
+clear_markers (ScintillaObject *sci)
+{
+  guint i;
+  
+  for (i = 0; i < MARKER_COUNT; i++) {
+    scintilla_send_message (sci, SCI_MARKERDELETEALL, G_markers[i].num, 0);
+  }
+}
+
+/* replaces the hunks of @state inside the window re-diffed by @job with the
+ * ones found by @job */
+static void
+merge_window_hunks (DiffState    *state,
+                    AsyncDiffJob *job)
+{
+  GArray *hunks = g_array_sized_new (FALSE, FALSE, sizeof (DiffHunk),
+                                     state->hunks->len + job->hunks->len);
+  guint   i;
+  
+  /* hunks before the window */
+  for (i = 0; i < state->hunks->len; i++) {
+    const DiffHunk *hunk = &g_array_index (state->hunks, DiffHunk, i);
+    
+    if (hunk->new_lines > 0 ? hunk_new_end (hunk) >= job->start
+                            : hunk->new_start >= job->start - 1) {
+      break;
+    }
+    g_array_append_val (hunks, *hunk);
+  }
+  g_array_append_vals (hunks, job->hunks->data, job->hunks->len);
+  /* hunks after the window, moved by the lines added in the window */
+  for (; i < state->hunks->len; i++) {
+    DiffHunk hunk = g_array_index (state->hunks, DiffHunk, i);
+    
+    if (hunk.new_start > job->end) {
+      hunk.new_start += job->lines_delta;
+      g_array_append_val (hunks, hunk);
+    }
+  }
+  
+  g_array_free (state->hunks, TRUE);
+  state->hunks = hunks;
+}
+
+/* applies the result of a diff job from the worker thread */
+static gboolean
+report_diff_in_idle (gpointer data)
+{
+  AsyncDiffJob   *job = data;
+  GeanyDocument  *doc = document_get_current ();
+  
+  /* drop results for documents that changed since the snapshot was taken */
+  if (job->hunks && job->serial == g_atomic_int_get (&G_diff_serial) &&
+      doc && doc->id == job->doc_id &&
+      g_object_get_qdata (G_OBJECT (doc->editor->sci), RESOURCES_ALLOCATED_QTAG)) {
+    ScintillaObject  *sci   = doc->editor->sci;
+    DiffState        *state = get_diff_state (sci);
+    
+    if (job->windowed) {
+      /* the window was computed from the state, which can't have changed
+       * without changing the serial */
+      if (! state || state->contents != job->old_contents) {
+        return FALSE;
+      }
+      
+      merge_window_hunks (state, job);
+      /* the line before the window can hold a removed marker */
+      sync_markers (sci, state->hunks, job->start - 2,
+                    job->end + job->lines_delta);
+    } else {
+      state = g_slice_alloc (sizeof *state);
+      state->contents     = g_bytes_ref (job->old_contents);
+      state->line_starts  = job->line_starts;
+      state->hunks        = job->hunks;
+      job->line_starts    = NULL;
+      job->hunks          = NULL;
+      
+      g_object_set_qdata_full (G_OBJECT (sci), DIFF_STATE_QTAG, state,
+                               diff_state_free);
+      sync_markers (sci, state->hunks, 0, sci_get_line_count (sci) - 1);
+    }
+    state->dirty = FALSE;
+    state->lines_delta = 0;
+    
+    gtk_widget_set_visible (G_undo_menu_item, TRUE);
+  }
+  
+  return FALSE;
+}
+
 static void
 update_diff (const gchar *path,
-             git_buf     *contents,
+             GBytes      *contents,
              gpointer     data)
 {
   GeanyDocument *doc = document_get_current ();
@@ -972,25 +1956,23 @@ update_diff (const gchar *path,
     gboolean    allocated = !! g_object_get_qdata (G_OBJECT (sci),
                                                    RESOURCES_ALLOCATED_QTAG);
     
-    if (allocated) {
-      guint i;
+    if (contents && (allocated || allocate_resources (sci))) {
+      /* markers and the undo menu item are updated when the diff is ready */
+      diff_doc_async (doc, contents);
+    } else {
+      gtk_widget_set_visible (G_undo_menu_item, FALSE);
       
-      /* clear previous markers */
-      for (i = 0; i < MARKER_COUNT; i++) {
-        scintilla_send_message (sci, SCI_MARKERDELETEALL, G_markers[i].num, 0);
+      if (allocated) {
+        clear_markers (sci);
+        g_object_set_qdata (G_OBJECT (sci), DIFF_STATE_QTAG, NULL);
+      }
+      if (! contents && allocated) {
+        /* if we don't have contents, it probably means the document doesn't
+         * match any object known by Git, so next attempts will fail just the
+         * same.  So, drop allocated resources if any (if it used to be a valid
+         * object, e.g. the document was renamed to something unknown to Git) */
+        release_resources (sci);
       }
-    }
-    
-    gtk_widget_set_visible (G_undo_menu_item, contents != NULL);
-    
-    if (contents && (allocated || allocate_resources (sci))) {
-      diff_buf_to_doc (contents, doc, diff_hunk_cb, sci);
-    } else if (! contents && allocated) {
-      /* if we don't have contents, it probably means the document doesn't
-       * match any object known by Git, so next attempts will fail just the
-       * same.  So, drop allocated resources if any (if it used to be a valid
-       * object, e.g. the document was renamed to something unknown to Git) */
-      release_resources (sci);
     }
   }
 }
@@ -1046,6 +2028,8 @@ update_diff_push (GeanyDocument  *doc,
   g_return_if_fail (DOC_VALID (doc));
   
   gtk_widget_hide (G_undo_menu_item);
+  /* invalidate pending diffs */
+  g_atomic_int_inc (&G_diff_serial);
   
   if (G_source_id) {
     g_source_remove (G_source_id);
@@ -1059,12 +2043,46 @@ update_diff_push (GeanyDocument  *doc,
   }
 }
 
+/* records that @lines_added lines were added (or removed if negative) at
+ * @line, so the next diff can be limited to the edited region */
+static void
+diff_state_add_edit (DiffState *state,
+                     gint       line,
+                     gint       lines_added)
+{
+  if (! state->dirty) {
+    state->dirty        = TRUE;
+    state->dirty_first  = line;
+    state->dirty_last   = line + MAX (lines_added, 0);
+    state->lines_delta  = lines_added;
+  } else {
+    /* move the end of the edited region along with its content */
+    if (state->dirty_last >= line) {
+      state->dirty_last = MAX (state->dirty_last + lines_added, line);
+    }
+    state->dirty_first  = MIN (state->dirty_first, line);
+    state->dirty_last   = MAX (state->dirty_last, line + MAX (lines_added, 0));
+    state->lines_delta += lines_added;
+  }
+}
+
 static gboolean
 on_editor_notify (GObject        *obj,
                   GeanyEditor    *editor,
                   SCNotification *nt,
                   gpointer        user_data)
 {
+  if (nt->nmhdr.code == SCN_MODIFIED &&
+      nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) {
+    DiffState *state = get_diff_state (editor->sci);
+    
+    if (state) {
+      diff_state_add_edit (state,
+                           sci_get_line_from_position (editor->sci, nt->position),
+                           nt->linesAdded);
+    }
+  }
+  
   if (nt->nmhdr.code == SCN_CHARADDED ||
       (nt->nmhdr.code == SCN_MODIFIED &&
        nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT))) {
@@ -1083,6 +2101,23 @@ on_document_activate (GObject        *obj,
   update_diff_push (doc, FALSE);
 }
 
+static void
+on_document_save (GObject        *obj,
+                  GeanyDocument  *doc,
+                  gpointer        user_data)
+{
+  on_document_activate (obj, doc, user_data);
+  update_index_push_doc (doc);
+}
+
+static void
+on_document_open (GObject        *obj,
+                  GeanyDocument  *doc,
+                  gpointer        user_data)
+{
+  update_index_push_doc (doc);
+}
+
 static void
 on_startup_complete (GObject *obj,
                      gpointer user_data)
@@ -1092,6 +2127,7 @@ on_startup_complete (GObject *obj,
   if (doc) {
     update_diff_push (doc, FALSE);
   }
+  update_index_push ();
 }
 
 static void
@@ -1101,12 +2137,26 @@ on_git_repo_changed (GFileMonitor     *monitor,
                      GFileMonitorEvent event_type,
                      gpointer          force)
 {
-  GeanyDocument *doc = document_get_current ();
+  GeanyDocument *doc        = document_get_current ();
+  const gchar   *repo_path  = g_object_get_data (G_OBJECT (monitor),
+                                                 "repo-path");
+  
+  /* a branch switch affects all the files of the repository, not only the
+   * current document's */
+  if (repo_path) {
+    AsyncRepoChangedJob *job = g_slice_alloc (sizeof *job);
+    
+    job->type       = JOB_REPO_CHANGED;
+    job->repo_path  = g_strdup (repo_path);
+    
+    push_job (job);
+  }
   
   if (doc) {
     clear_cached_blob_contents ();
     update_diff_push (doc, GPOINTER_TO_INT (force));
   }
+  update_index_push ();
 }
 
 static int
@@ -1137,7 +2187,7 @@ goto_next_hunk_diff_hunk_cb (const git_diff_delta *delta,
 
 static void
 goto_next_hunk_cb (const gchar *path,
-                   git_buf     *contents,
+                   GBytes      *contents,
                    gpointer     udata)
 {
   GotoNextHunkData *data  = udata;
@@ -1174,16 +2224,240 @@ on_kb_goto_next_hunk (guint kb)
   }
 }
 
+/* --- project-wide change index --- */
+
+static gboolean
+report_index_in_idle (gpointer data)
+{
+  AsyncIndexJob  *job = data;
+  guint           i;
+  
+  if (! G_change_index) {
+    return FALSE;
+  }
+  
+  if (job->full) {
+    g_hash_table_remove_all (G_change_index);
+  } else {
+    for (i = 0; i < job->paths->len; i++) {
+      g_hash_table_remove (G_change_index, g_ptr_array_index (job->paths, i));
+    }
+  }
+  /* steal the files from the job */
+  for (i = 0; i < job->files->len; i++) {
+    ChangedFile *file = g_ptr_array_index (job->files, i);
+    
+    g_hash_table_replace (G_change_index, file->path, file);
+  }
+  g_ptr_array_set_free_func (job->files, NULL);
+  
+  return FALSE;
+}
+
+static void
+push_index_job (GPtrArray *paths,
+                gboolean   full)
+{
+  AsyncIndexJob *job = g_slice_alloc (sizeof *job);
+  
+  job->type   = JOB_INDEX;
+  job->full   = full;
+  job->paths  = paths;
+  job->files  = g_ptr_array_new_with_free_func (changed_file_free);
+  
+  push_job (job);
+}
+
+static gboolean
+update_index_idle (gpointer data)
+{
+  GPtrArray  *paths = g_ptr_array_new_with_free_func (g_free);
+  guint       i     = 0;
+  
+  G_index_source_id = 0;
+  
+  foreach_document (i) {
+    if (documents[i]->real_path) {
+      g_ptr_array_add (paths, g_strdup (documents[i]->real_path));
+    }
+  }
+  push_index_job (paths, TRUE);
+  
+  return FALSE;
+}
+
+/* re-indexes the repositories of all open documents soon */
+static void
+update_index_push (void)
+{
+  if (G_index_source_id) {
+    g_source_remove (G_index_source_id);
+  }
+  /* changes to the repository often come in bursts (checkouts, rebases...),
+   * so wait until things settle down */
+  G_index_source_id = plugin_timeout_add (geany_plugin, 1000,
+                                          update_index_idle, NULL);
+}
+
+/* updates the changes of a single document without re-indexing everything */
+static void
+update_index_push_doc (GeanyDocument *doc)
+{
+  if (doc->real_path && ! G_index_source_id) {
+    GPtrArray *paths = g_ptr_array_new_with_free_func (g_free);
+    
+    g_ptr_array_add (paths, g_strdup (doc->real_path));
+    push_index_job (paths, FALSE);
+  }
+}
+
+static gint
+compare_paths (gconstpointer a,
+               gconstpointer b)
+{
+  return strcmp (*(const gchar *const *) a, *(const gchar *const *) b);
+}
+
+/* returns the indexed paths, sorted, or %NULL if there are none */
+static GPtrArray *
+get_changed_paths (void)
+{
+  GPtrArray      *paths;
+  GHashTableIter  iter;
+  gpointer        key;
+  
+  if (! G_change_index || g_hash_table_size (G_change_index) == 0) {
+    return NULL;
+  }
+  
+  paths = g_ptr_array_sized_new (g_hash_table_size (G_change_index));
+  g_hash_table_iter_init (&iter, G_change_index);
+  while (g_hash_table_iter_next (&iter, &key, NULL)) {
+    g_ptr_array_add (paths, key);
+  }
+  g_ptr_array_sort (paths, compare_paths);
+  
+  return paths;
+}
+
+static void
+on_kb_goto_next_changed_file (guint kb)
+{
+  GeanyDocument  *doc     = document_get_current ();
+  const gchar    *current = doc ? doc->real_path : NULL;
+  GPtrArray      *paths   = get_changed_paths ();
+  const gchar    *target  = NULL;
+  GeanyDocument  *target_doc;
+  guint           i;
+  
+  if (! paths) {
+    ui_set_statusbar (FALSE, _("No changed files."));
+    return;
+  }
+  
+  if (kb == KB_GOTO_NEXT_CHANGED_FILE) {
+    for (i = 0; ! target && current && i < paths->len; i++) {
+      if (strcmp (g_ptr_array_index (paths, i), current) > 0) {
+        target = g_ptr_array_index (paths, i);
+      }
+    }
+    if (! target) {
+      target = g_ptr_array_index (paths, 0);
+    }
+  } else {
+    for (i = paths->len; ! target && current && i > 0; i--) {
+      if (strcmp (g_ptr_array_index (paths, i - 1), current) < 0) {
+        target = g_ptr_array_index (paths, i - 1);
+      }
+    }
+    if (! target) {
+      target = g_ptr_array_index (paths, paths->len - 1);
+    }
+  }
+  
+  target_doc = document_open_file (target, FALSE, NULL, NULL);
+  if (target_doc) {
+    ChangedFile    *file = g_hash_table_lookup (G_change_index, target);
+    const DiffHunk *hunk = &g_array_index (file->hunks, DiffHunk, 0);
+    
+    navqueue_goto_line (doc, target_doc,
+                        REMOVED_MARKER_POS (hunk->new_start) + 1);
+  }
+  
+  g_ptr_array_free (paths, TRUE);
+}
+
+static void
+show_changes (void)
+{
+  GPtrArray  *paths = get_changed_paths ();
+  guint       i;
+  
+  msgwin_clear_tab (MSG_MESSAGE);
+  if (! paths) {
+    msgwin_msg_add (COLOR_BLACK, -1, NULL, _("No changed files."));
+  } else {
+    for (i = 0; i < paths->len; i++) {
+      ChangedFile  *file  = g_hash_table_lookup (G_change_index,
+                                                 g_ptr_array_index (paths, i));
+      gchar        *utf8  = utils_get_utf8_from_locale (file->path);
+      guint         j;
+      
+      for (j = 0; j < file->hunks->len; j++) {
+        const DiffHunk *hunk = &g_array_index (file->hunks, DiffHunk, j);
+        
+        if (hunk->new_lines == 0) {
+          msgwin_msg_add (COLOR_BLACK, -1, NULL,
+                          g_dngettext (GETTEXT_PACKAGE, "%s:%d: %d line removed",
+                                       "%s:%d: %d lines removed",
+                                       (gulong) hunk->old_lines),
+                          utf8, REMOVED_MARKER_POS (hunk->new_start) + 1,
+                          hunk->old_lines);
+        } else if (hunk->old_lines == 0) {
+          msgwin_msg_add (COLOR_BLACK, -1, NULL,
+                          g_dngettext (GETTEXT_PACKAGE, "%s:%d: %d line added",
+                                       "%s:%d: %d lines added",
+                                       (gulong) hunk->new_lines),
+                          utf8, hunk->new_start, hunk->new_lines);
+        } else {
+          msgwin_msg_add (COLOR_BLACK, -1, NULL,
+                          g_dngettext (GETTEXT_PACKAGE, "%s:%d: %d line changed",
+                                       "%s:%d: %d lines changed",
+                                       (gulong) hunk->new_lines),
+                          utf8, hunk->new_start, hunk->new_lines);
+        }
+      }
+      g_free (utf8);
+    }
+    g_ptr_array_free (paths, TRUE);
+  }
+  msgwin_switch_tab (MSG_MESSAGE, TRUE);
+}
+
+static void
+on_kb_show_changes (guint kb)
+{
+  show_changes ();
+}
+
+static void
+on_show_changes_activate (GtkMenuItem *item,
+                          gpointer     user_data)
+{
+  show_changes ();
+}
+
 static void
 insert_buf_range (GeanyDocument *doc,
-                  const git_buf *old_contents,
+                  GBytes        *old_contents,
                   gint           pos,
                   gint           old_start,
                   gint           old_lines)
 {
   ScintillaObject *old_sci     = editor_create_widget (doc->editor);
-  gchar           *old_buf     = old_contents->ptr;
-  gsize            old_buf_len = old_contents->size;
+  gsize            old_buf_len;
+  gchar           *old_buf     = (gchar *) g_bytes_get_data (old_contents,
+                                                             &old_buf_len);
   gboolean         free_buf    = FALSE;
   gint             old_pos_start;
   gint             old_pos_end;
@@ -1236,7 +2510,7 @@ undo_hunk_diff_hunk_cb (const git_diff_delta *delta,
 
 static void
 undo_hunk_cb (const gchar *path,
-              git_buf     *contents,
+              GBytes      *contents,
               gpointer     udata)
 {
   UndoHunkData  *data = udata;
@@ -1321,7 +2595,7 @@ on_undo_hunk_activate (GtkWidget *widget,
 
 static void
 check_undo_hunk_cb (const gchar *path,
-                    git_buf     *contents,
+                    GBytes      *contents,
                     gpointer     udata)
 {
   UndoHunkData  *data = udata;
@@ -1529,11 +2803,12 @@ plugin_init (GeanyData *data)
 {
   GeanyKeyGroup *kb_group;
   
-  buf_zero (&G_blob_contents);
+  G_blob_contents     = NULL;
   G_blob_contents_tag = 0;
   G_source_id         = 0;
   G_thread            = NULL;
   G_queue             = NULL;
+  G_index_source_id   = 0;
   
   if (git_libgit2_init () < 0) {
     const git_error *err = git_error_last ();
@@ -1543,6 +2818,16 @@ plugin_init (GeanyData *data)
   
   load_config ();
   
+  G_change_index = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                          changed_file_free);
+  
+  G_changes_menu_item = gtk_menu_item_new_with_mnemonic (_("Show _Git Changes"));
+  g_signal_connect (G_changes_menu_item, "activate",
+                    G_CALLBACK (on_show_changes_activate), NULL);
+  gtk_widget_show (G_changes_menu_item);
+  gtk_container_add (GTK_CONTAINER (data->main_widgets->tools_menu),
+                     G_changes_menu_item);
+  
   G_undo_menu_item = gtk_menu_item_new_with_label (_("Undo Git hunk"));
   g_signal_connect (G_undo_menu_item, "activate",
                     G_CALLBACK (on_undo_hunk_activate), NULL);
@@ -1557,6 +2842,17 @@ plugin_init (GeanyData *data)
   keybindings_set_item (kb_group, KB_UNDO_HUNK, on_kb_undo_hunk, 0, 0,
                         "undo-hunk", _("Undo hunk at the cursor position"),
                         G_undo_menu_item);
+  keybindings_set_item (kb_group, KB_GOTO_PREV_CHANGED_FILE,
+                        on_kb_goto_next_changed_file, 0, 0,
+                        "goto-prev-changed-file",
+                        _("Go to the previous changed file"), NULL);
+  keybindings_set_item (kb_group, KB_GOTO_NEXT_CHANGED_FILE,
+                        on_kb_goto_next_changed_file, 0, 0,
+                        "goto-next-changed-file",
+                        _("Go to the next changed file"), NULL);
+  keybindings_set_item (kb_group, KB_SHOW_CHANGES, on_kb_show_changes, 0, 0,
+                        "show-changes", _("Show the changes of all files"),
+                        G_changes_menu_item);
   
   plugin_signal_connect (geany_plugin, NULL, "editor-notify", TRUE,
                          G_CALLBACK (on_editor_notify), NULL);
@@ -1567,7 +2863,9 @@ plugin_init (GeanyData *data)
   plugin_signal_connect (geany_plugin, NULL, "document-reload", TRUE,
                          G_CALLBACK (on_document_activate), NULL);
   plugin_signal_connect (geany_plugin, NULL, "document-save", TRUE,
-                         G_CALLBACK (on_document_activate), NULL);
+                         G_CALLBACK (on_document_save), NULL);
+  plugin_signal_connect (geany_plugin, NULL, "document-open", TRUE,
+                         G_CALLBACK (on_document_open), NULL);
   plugin_signal_connect (geany_plugin, NULL, "geany-startup-complete", TRUE,
                          G_CALLBACK (on_startup_complete), NULL);
   
@@ -1584,11 +2882,16 @@ plugin_cleanup (void)
   guint i = 0;
   
   gtk_widget_destroy (G_undo_menu_item);
+  gtk_widget_destroy (G_changes_menu_item);
   
   if (G_source_id) {
     g_source_remove (G_source_id);
     G_source_id = 0;
   }
+  if (G_index_source_id) {
+    g_source_remove (G_index_source_id);
+    G_index_source_id = 0;
+  }
   if (G_thread) {
     g_async_queue_push (G_queue, QUIT_THREAD_JOB); /* notify the thread */
     g_thread_join (G_thread);
@@ -1597,6 +2900,8 @@ plugin_cleanup (void)
     G_queue = NULL;
   }
   clear_cached_blob_contents ();
+  g_hash_table_destroy (G_change_index);
+  G_change_index = NULL;
   
   foreach_document (i) {
     release_resources (documents[i]->editor->sci);
@@ -25,8 +25,12 @@
 
 #include <jsonrpc-glib.h>
 
+extern GeanyPlugin *geany_plugin;
 extern GeanyData *geany_data;
 
+/* delay of redrawing after scrolling in viewport mode (ms) */
+#define VIEWPORT_UPDATE_DELAY 150
+
 
 typedef struct {
 	LspRange range;
@@ -57,6 +61,12 @@ typedef enum {
 static gint style_indices[LSP_DIAG_SEVERITY_MAX];
 
 static ScintillaObject *calltip_sci;
+
+/* lines drawn in viewport mode */
+static GeanyDocument *viewport_doc;
+static gint viewport_first_line;
+static gint viewport_last_line;
+static guint viewport_source;
 static GtkWidget *issue_label;
 static GtkWidget *issue_label_container;
 
@@ -362,8 +372,11 @@ void lsp_diagnostics_redraw(GeanyDocument *doc)
 	ScintillaObject *sci;
 	GPtrArray *diags;
 	gint last_start_pos = 0, last_end_pos = 0;
+	gint first_line = 0, last_line = G_MAXINT;
 	gint i;
 
+	viewport_doc = NULL;
+
 	if (!srv || !doc || !doc->real_path || is_diagnostics_disabled_for(doc, &srv->config))
 	{
 		set_statusbar_issue_num(-1);
@@ -376,6 +389,15 @@ void lsp_diagnostics_redraw(GeanyDocument *doc)
 
 	clear_indicators(sci);
 
+	// draw only diagnostics around the visible lines in huge documents
+	if (lsp_utils_use_viewport_mode(doc, &srv->config))
+	{
+		lsp_utils_get_viewport_lines(sci, &first_line, &last_line);
+		viewport_doc = doc;
+		viewport_first_line = first_line;
+		viewport_last_line = last_line;
+	}
+
 	diags = g_hash_table_lookup(srv->diag_table, doc->real_path);
 	if (!diags)
 	{
@@ -386,9 +408,14 @@ void lsp_diagnostics_redraw(GeanyDocument *doc)
 	for (i = 0; i < diags->len; i++)
 	{
 		LspDiag *diag = diags->pdata[i];
-		gint start_pos = lsp_utils_lsp_pos_to_scintilla(sci, diag->range.start);
-		gint end_pos = lsp_utils_lsp_pos_to_scintilla(sci, diag->range.end);
-		gint next_pos = SSM(sci, SCI_POSITIONAFTER, start_pos, 0);
+		gint start_pos, end_pos, next_pos;
+
+		if (diag->range.end.line < first_line || diag->range.start.line > last_line)
+			continue;
+
+		start_pos = lsp_utils_lsp_pos_to_scintilla(sci, diag->range.start);
+		end_pos = lsp_utils_lsp_pos_to_scintilla(sci, diag->range.end);
+		next_pos = SSM(sci, SCI_POSITIONAFTER, start_pos, 0);
 
 		if (start_pos == end_pos)
 		{
@@ -419,6 +446,33 @@ void lsp_diagnostics_redraw(GeanyDocument *doc)
 }
 
 
+static gboolean viewport_redraw_cb(gpointer user_data)
+{
+	GeanyDocument *doc = document_get_current();
+
+	viewport_source = 0;
+	if (doc && doc == viewport_doc)
+		lsp_diagnostics_redraw(doc);
+
+	return G_SOURCE_REMOVE;
+}
+
+
+/* redraws diagnostics after scrolling out of the lines drawn in viewport mode */
+void lsp_diagnostics_viewport_changed(GeanyDocument *doc)
+{
+	if (!doc || doc != viewport_doc)
+		return;
+
+	if (lsp_utils_viewport_in_lines(doc->editor->sci, viewport_first_line, viewport_last_line))
+		return;
+
+	if (viewport_source != 0)
+		g_source_remove(viewport_source);
+	viewport_source = plugin_timeout_add(geany_plugin, VIEWPORT_UPDATE_DELAY, viewport_redraw_cb, NULL);
+}
+
+
 void lsp_diagnostics_style_init(GeanyDocument *doc)
 {
 	LspServer *srv = lsp_server_get_if_running(doc);
@@ -35,6 +35,7 @@ void lsp_diagnostics_show_all(gboolean current_doc_only);
 
 void lsp_diagnostics_received(LspServer *srv, GVariant* diags);
 void lsp_diagnostics_redraw(GeanyDocument *doc);
+void lsp_diagnostics_viewport_changed(GeanyDocument *doc);
 void lsp_diagnostics_clear(LspServer *srv, GeanyDocument *doc);
 
 void lsp_diagnostics_style_init(GeanyDocument *doc);
@@ -43,6 +43,19 @@ static void log_print(LspLogInfo log, const gchar *fmt, ...)
 }
 
 
+/* time with millisecond precision */
+static gchar *format_time(GDateTime *time)
+{
+	gchar *time_str = g_date_time_format(time, "\%H:\%M:\%S.\%f");
+	gint time_str_len = strlen(time_str);
+
+	if (time_str_len > 3)
+		time_str[time_str_len-3] = '\0';
+
+	return time_str;
+}
+
+
 LspLogInfo lsp_log_start(LspServerConfig *config)
 {
 	LspLogInfo info = {0, TRUE, NULL};
@@ -97,7 +110,6 @@ void lsp_log(LspLogInfo log, LspLogType type, const gchar *method, GVariant *par
 	gchar *json_msg, *time_str;
 	const gchar *title = "";
 	GDateTime *time;
-	gint time_str_len;
 	gchar *delta_str = NULL;
 	gchar *err_msg;
 
@@ -114,10 +126,7 @@ void lsp_log(LspLogInfo log, LspLogType type, const gchar *method, GVariant *par
 	}
 	else
 		delta_str = g_strdup("");
-	time_str = g_date_time_format(time, "\%H:\%M:\%S.\%f");
-	time_str_len = strlen(time_str);
-	if (time_str_len > 3)
-		time_str[time_str_len-3] = '\0';
+	time_str = format_time(time);
 	g_date_time_unref(time);
 
 	if (!method)
@@ -162,3 +171,26 @@ void lsp_log(LspLogInfo log, LspLogType type, const gchar *method, GVariant *par
 	g_free(err_msg);
 	g_free(delta_str);
 }
+
+
+void lsp_log_request_stats(LspLogInfo log, guint issued, guint cancelled, guint dropped)
+{
+	gchar *time_str;
+	GDateTime *time;
+
+	if (log.type == 0 && !log.stream)
+		return;
+
+	time = g_date_time_new_now_local();
+	time_str = format_time(time);
+	g_date_time_unref(time);
+
+	if (log.full)
+		log_print(log, "\n\n\"[%s] requests: %u issued, %u cancelled, %u dropped\": \"\",\n",
+			time_str, issued, cancelled, dropped);
+	else
+		log_print(log, "[%s] requests: %u issued, %u cancelled, %u dropped\n",
+			time_str, issued, cancelled, dropped);
+
+	g_free(time_str);
+}
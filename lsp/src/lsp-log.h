@@ -40,5 +40,7 @@ void lsp_log_stop(LspLogInfo log);
 void lsp_log(LspLogInfo log, LspLogType type, const gchar *method, GVariant *params,
 	GError *error, GDateTime *req_time);
 
+void lsp_log_request_stats(LspLogInfo log, guint issued, guint cancelled, guint dropped);
+
 
 #endif  /* LSP_LOG_H */
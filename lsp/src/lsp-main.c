@@ -786,7 +786,7 @@ static gboolean on_editor_notify(G_GNUC_UNUSED GObject *obj, GeanyEditor *editor
 		{
 			LspPosition pos_start = lsp_utils_scintilla_pos_to_lsp(sci, nt->position);
 			LspPosition pos_end = pos_start;
-			gchar *text;
+			gchar *text = NULL;
 
 			if (srv->use_incremental_sync)
 			{
@@ -794,8 +794,6 @@ static gboolean on_editor_notify(G_GNUC_UNUSED GObject *obj, GeanyEditor *editor
 				memcpy(text, nt->text, nt->length);
 				text[nt->length] = '\0';
 			}
-			else
-				text = sci_get_contents(doc->editor->sci, -1);
 
 			lsp_sync_text_document_did_change(srv, doc, pos_start, pos_end, text);
 
@@ -806,20 +804,16 @@ static gboolean on_editor_notify(G_GNUC_UNUSED GObject *obj, GeanyEditor *editor
 			// BEFORE! delete for incremental sync
 			LspPosition pos_start = lsp_utils_scintilla_pos_to_lsp(sci, nt->position);
 			LspPosition pos_end = lsp_utils_scintilla_pos_to_lsp(sci, nt->position + nt->length);
-			gchar *text = g_strdup("");
 
-			lsp_sync_text_document_did_change(srv, doc, pos_start, pos_end, text);
-			g_free(text);
+			lsp_sync_text_document_did_change(srv, doc, pos_start, pos_end, "");
 		}
 		else if (!srv->use_incremental_sync &&(nt->modificationType & SC_MOD_DELETETEXT))
 		{
-			// AFTER! delete for full document sync
-			LspPosition dummy_start = lsp_utils_scintilla_pos_to_lsp(sci, 0);
-			LspPosition dummy_end = lsp_utils_scintilla_pos_to_lsp(sci, 0);
-			gchar *text = sci_get_contents(doc->editor->sci, -1);
+			// AFTER! delete for full document sync - the contents is retrieved
+			// when the accumulated changes are sent
+			LspPosition dummy_pos = {0, 0};
 
-			lsp_sync_text_document_did_change(srv, doc, dummy_start, dummy_end, text);
-			g_free(text);
+			lsp_sync_text_document_did_change(srv, doc, dummy_pos, dummy_pos, NULL);
 		}
 
 		if (nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT))
@@ -829,6 +823,9 @@ static gboolean on_editor_notify(G_GNUC_UNUSED GObject *obj, GeanyEditor *editor
 			if (update_source != 0)
 				g_source_remove(update_source);
 
+			lsp_semtokens_text_changed(doc, sci_get_line_from_position(sci, nt->position),
+				nt->linesAdded);
+
 			// perform expensive queries only after some minimum delay
 			update_source = plugin_timeout_add(geany_plugin, 300, on_update_idle, doc);
 			plugin_set_document_data(geany_plugin, doc, UPDATE_SOURCE_DOC_DATA, GUINT_TO_POINTER(update_source));
@@ -848,6 +845,13 @@ static gboolean on_editor_notify(G_GNUC_UNUSED GObject *obj, GeanyEditor *editor
 				lsp_selection_clear_selections();
 		}
 
+		if (nt->updated & SC_UPDATE_V_SCROLL)
+		{
+			lsp_diagnostics_viewport_changed(doc);
+			if (symbol_highlight_provided(doc, NULL))
+				lsp_semtokens_viewport_changed(doc);
+		}
+
 		if (perform_highlight && (nt->updated & SC_UPDATE_SELECTION))
 		{
 			LspServer *srv = lsp_server_get_if_running(doc);
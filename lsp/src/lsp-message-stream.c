@@ -0,0 +1,240 @@
+/*
+ * Copyright 2023 Jiri Techet <techet@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Input stream placed between the server's stdout and the jsonrpc client.
+ * jsonrpc-glib parses JSON messages in the main loop; for big messages
+ * (completion lists, semantic tokens, workspace symbols, ...) this blocks
+ * typing. The stream isn't pollable, so GIO calls its read function in a
+ * worker thread where big messages are parsed and re-encoded as
+ * "application/gvariant" messages which jsonrpc-glib only has to wrap.
+ * This works the same with the system and the builtin jsonrpc-glib.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lsp-message-stream.h"
+
+#include <json-glib/json-glib.h>
+#include <string.h>
+
+// messages at least this big are converted in the worker thread, smaller
+// ones are cheap enough to be parsed by jsonrpc-glib in the main loop
+#define CONVERT_MIN_SIZE (64 * 1024)
+
+// jsonrpc-glib refuses messages bigger than this
+#define MAX_MESSAGE_SIZE (16 * 1024 * 1024)
+
+
+struct _LspMessageStream
+{
+	GInputStream parent_instance;
+
+	GDataInputStream *base;
+	GByteArray *message;  // the next message for the reader
+	gsize message_pos;
+};
+
+
+G_DEFINE_TYPE(LspMessageStream, lsp_message_stream, G_TYPE_INPUT_STREAM)
+
+
+// parses the JSON message; returns NULL when it should be passed unchanged
+static GVariant *convert_message(const gchar *body, gsize length)
+{
+	GVariant *message = json_gvariant_deserialize_data(body, length, NULL, NULL);
+
+	if (!message)
+		return NULL;  // let jsonrpc-glib report the error
+
+	g_variant_ref_sink(message);
+	if (!g_variant_is_of_type(message, G_VARIANT_TYPE_VARDICT) ||
+		g_variant_get_size(message) > MAX_MESSAGE_SIZE)
+	{
+		g_variant_unref(message);
+		return NULL;
+	}
+
+	return message;
+}
+
+
+// reads the next message from the server into self->message, leaves it
+// empty at the end of the stream
+static gboolean read_message(LspMessageStream *self, GCancellable *cancellable,
+	GError **error)
+{
+	GString *headers = g_string_new(NULL);
+	gint64 content_length = -1;
+	gboolean is_gvariant = FALSE;
+	GVariant *converted = NULL;
+	gchar *body;
+	gsize n_read;
+
+	while (TRUE)
+	{
+		GError *err = NULL;
+		gchar *line = g_data_input_stream_read_line(self->base, NULL, cancellable, &err);
+
+		if (!line)
+		{
+			g_byte_array_append(self->message, (guint8 *)headers->str, headers->len);
+			g_string_free(headers, TRUE);
+			if (err)
+			{
+				g_propagate_error(error, err);
+				return FALSE;
+			}
+			return TRUE;
+		}
+
+		if (g_ascii_strncasecmp(line, "Content-Length: ", 16) == 0)
+			content_length = g_ascii_strtoll(line + 16, NULL, 10);
+		else if (g_ascii_strncasecmp(line, "Content-Type: ", 14) == 0 &&
+			strstr(line, "application/gvariant"))
+		{
+			is_gvariant = TRUE;
+		}
+
+		g_string_append(headers, line);
+		g_string_append(headers, "\r\n");
+
+		if (line[0] == '\0')
+		{
+			g_free(line);
+			break;
+		}
+		g_free(line);
+	}
+
+	// invalid headers are passed unchanged for jsonrpc-glib to report
+	if (content_length <= 0 || content_length > MAX_MESSAGE_SIZE)
+	{
+		g_byte_array_append(self->message, (guint8 *)headers->str, headers->len);
+		g_string_free(headers, TRUE);
+		return TRUE;
+	}
+
+	body = g_malloc(content_length);
+	if (!g_input_stream_read_all(G_INPUT_STREAM(self->base), body, content_length,
+			&n_read, cancellable, error))
+	{
+		g_free(body);
+		g_string_free(headers, TRUE);
+		return FALSE;
+	}
+
+	if (!is_gvariant && n_read == (gsize)content_length && content_length >= CONVERT_MIN_SIZE)
+		converted = convert_message(body, content_length);
+
+	if (converted)
+	{
+		gsize size = g_variant_get_size(converted);
+
+		g_string_printf(headers, "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+			"Content-Type: application/gvariant\r\n\r\n", size);
+		g_byte_array_append(self->message, (guint8 *)headers->str, headers->len);
+		g_byte_array_append(self->message, g_variant_get_data(converted), size);
+		g_variant_unref(converted);
+	}
+	else
+	{
+		g_byte_array_append(self->message, (guint8 *)headers->str, headers->len);
+		g_byte_array_append(self->message, (guint8 *)body, n_read);
+	}
+
+	g_free(body);
+	g_string_free(headers, TRUE);
+	return TRUE;
+}
+
+
+// called in a worker thread by GIO's asynchronous read implementation
+static gssize lsp_message_stream_read(GInputStream *stream, void *buffer, gsize count,
+	GCancellable *cancellable, GError **error)
+{
+	LspMessageStream *self = LSP_MESSAGE_STREAM(stream);
+	gsize n;
+
+	if (self->message_pos >= self->message->len)
+	{
+		g_byte_array_set_size(self->message, 0);
+		self->message_pos = 0;
+
+		if (!read_message(self, cancellable, error))
+			return -1;
+		if (self->message->len == 0)
+			return 0;
+	}
+
+	n = MIN(count, self->message->len - self->message_pos);
+	memcpy(buffer, self->message->data + self->message_pos, n);
+	self->message_pos += n;
+
+	return n;
+}
+
+
+static gboolean lsp_message_stream_close(GInputStream *stream, GCancellable *cancellable,
+	GError **error)
+{
+	LspMessageStream *self = LSP_MESSAGE_STREAM(stream);
+
+	return g_input_stream_close(G_INPUT_STREAM(self->base), cancellable, error);
+}
+
+
+static void lsp_message_stream_finalize(GObject *object)
+{
+	LspMessageStream *self = LSP_MESSAGE_STREAM(object);
+
+	g_object_unref(self->base);
+	g_byte_array_unref(self->message);
+
+	G_OBJECT_CLASS(lsp_message_stream_parent_class)->finalize(object);
+}
+
+
+static void lsp_message_stream_class_init(LspMessageStreamClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS(klass);
+	GInputStreamClass *stream_class = G_INPUT_STREAM_CLASS(klass);
+
+	object_class->finalize = lsp_message_stream_finalize;
+	stream_class->read_fn = lsp_message_stream_read;
+	stream_class->close_fn = lsp_message_stream_close;
+}
+
+
+static void lsp_message_stream_init(LspMessageStream *self)
+{
+	self->message = g_byte_array_new();
+}
+
+
+GInputStream *lsp_message_stream_new(GInputStream *base_stream)
+{
+	LspMessageStream *self = g_object_new(LSP_TYPE_MESSAGE_STREAM, NULL);
+
+	self->base = g_data_input_stream_new(base_stream);
+	g_data_input_stream_set_newline_type(self->base, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+
+	return G_INPUT_STREAM(self);
+}
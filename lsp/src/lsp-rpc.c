@@ -27,6 +27,7 @@
 #include "lsp-log.h"
 #include "lsp-utils.h"
 #include "lsp-workspace-folders.h"
+#include "lsp-sync.h"
 
 #include <jsonrpc-glib.h>
 #include <stdio.h>
@@ -39,12 +40,38 @@ typedef struct
 	LspRpcCallback callback;
 	GDateTime *req_time;
 	gboolean cb_on_startup_shutdown;
+	GVariant *id;
+	gchar *supersede_key;
+	gboolean superseded;
 } CallbackData;
 
 
 struct LspRpc
 {
 	JsonrpcClient *client;
+	/* requests whose result becomes useless once a newer request of the same
+	 * kind for the same document is made: supersede key -> CallbackData */
+	GHashTable *active_requests;
+	guint requests_issued;
+	guint requests_cancelled;
+	guint responses_dropped;
+};
+
+
+/* Requests answering a question about the current state of a document (or of
+ * the workspace) - when a new such request is made, the result of the previous
+ * one isn't interesting any more. All semantic token requests share one kind
+ * because they all update the same highlighting. */
+static const gchar *superseding_methods[][2] = {
+	{"textDocument/completion", "completion"},
+	{"textDocument/hover", "hover"},
+	{"textDocument/signatureHelp", "signatureHelp"},
+	{"textDocument/documentHighlight", "documentHighlight"},
+	{"textDocument/codeLens", "codeLens"},
+	{"textDocument/semanticTokens/full", "semanticTokens"},
+	{"textDocument/semanticTokens/full/delta", "semanticTokens"},
+	{"textDocument/semanticTokens/range", "semanticTokens"},
+	{"workspace/symbol", "workspaceSymbol"}
 };
 
 
@@ -450,6 +477,72 @@ static gboolean handle_call(JsonrpcClient *client, gchar* method, GVariant *id,
 }
 
 
+static gchar *get_supersede_key(const gchar *method, GVariant *params)
+{
+	const gchar *uri = NULL;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(superseding_methods); i++)
+	{
+		if (g_strcmp0(method, superseding_methods[i][0]) == 0)
+		{
+			if (g_str_has_prefix(method, "workspace/"))
+				return g_strdup(superseding_methods[i][1]);
+
+			JSONRPC_MESSAGE_PARSE(params,
+				"textDocument", "{",
+					"uri", JSONRPC_MESSAGE_GET_STRING(&uri),
+				"}"
+			);
+			if (!uri)
+				return NULL;
+
+			return g_strconcat(superseding_methods[i][1], " ", uri, NULL);
+		}
+	}
+
+	return NULL;
+}
+
+
+static void log_request_stats(LspServer *srv)
+{
+	LspRpc *rpc = srv->rpc;
+
+	lsp_log_request_stats(srv->log, rpc->requests_issued, rpc->requests_cancelled,
+		rpc->responses_dropped);
+}
+
+
+/* Tells the server it doesn't have to finish the previous request of the same
+ * kind. The request stays registered in the jsonrpc client (its reply must
+ * still arrive) but call_cb() drops the reply's result and the callback
+ * receives an error. */
+static void supersede_request(LspServer *srv, CallbackData *data)
+{
+	LspRpc *rpc = srv->rpc;
+	CallbackData *old_data;
+	GVariant *params;
+
+	old_data = g_hash_table_lookup(rpc->active_requests, data->supersede_key);
+	if (old_data)
+	{
+		old_data->superseded = TRUE;
+
+		params = JSONRPC_MESSAGE_NEW(
+			"id", JSONRPC_MESSAGE_PUT_VARIANT(old_data->id)
+		);
+		lsp_rpc_notify(srv, "$/cancelRequest", params, NULL, NULL);
+		g_variant_unref(params);
+
+		rpc->requests_cancelled++;
+		log_request_stats(srv);
+	}
+
+	g_hash_table_insert(rpc->active_requests, g_strdup(data->supersede_key), data);
+}
+
+
 static void call_cb(GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
 	JsonrpcClient *client = (JsonrpcClient *)source_object;
@@ -461,11 +554,33 @@ static void call_cb(GObject *source_object, GAsyncResult *res, gpointer user_dat
 
 	jsonrpc_client_call_finish(client, res, &return_value, &error);
 
+	if (srv && data->supersede_key &&
+		g_hash_table_lookup(srv->rpc->active_requests, data->supersede_key) == data)
+	{
+		g_hash_table_remove(srv->rpc->active_requests, data->supersede_key);
+	}
+
+	if (data->superseded)
+	{
+		if (return_value)
+			g_variant_unref(return_value);
+		return_value = NULL;
+		g_clear_error(&error);
+		g_set_error_literal(&error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+			"Request superseded");
+	}
+
 	if (srv)
 	{
 		lsp_log(srv->log, LspLogClientMessageReceived, data->method_name,
 			return_value, error, data->req_time);
 		is_startup_shutdown = srv->startup_shutdown;
+
+		if (data->superseded)
+		{
+			srv->rpc->responses_dropped++;
+			log_request_stats(srv);
+		}
 	}
 
 	if (data->callback && (!is_startup_shutdown || data->cb_on_startup_shutdown))
@@ -477,7 +592,10 @@ static void call_cb(GObject *source_object, GAsyncResult *res, gpointer user_dat
 	if (error)
 		g_error_free(error);
 
+	if (data->id)
+		g_variant_unref(data->id);
 	g_date_time_unref(data->req_time);
+	g_free(data->supersede_key);
 	g_free(data->method_name);
 	g_free(data);
 }
@@ -494,9 +612,22 @@ static void call_full(LspServer *srv, const gchar *method, GVariant *params,
 	data->req_time = g_date_time_new_now_local();
 	data->cb_on_startup_shutdown = cb_on_startup_shutdown;
 
+	// make sure the server sees the same document contents as we do
+	lsp_sync_flush_all_changes(srv);
+
 	lsp_log(srv->log, LspLogClientMessageSent, method, params, NULL, NULL);
 
-	jsonrpc_client_call_async(srv->rpc->client, method, params, NULL, call_cb, data);
+	jsonrpc_client_call_with_id_async(srv->rpc->client, method, params, &data->id,
+		NULL, call_cb, data);
+	srv->rpc->requests_issued++;
+
+	// id is NULL when the call failed immediately (and call_cb is pending)
+	if (data->id && !srv->startup_shutdown)
+	{
+		data->supersede_key = get_supersede_key(method, params);
+		if (data->supersede_key)
+			supersede_request(srv, data);
+	}
 }
 
 
@@ -572,6 +703,18 @@ void lsp_rpc_notify(LspServer *srv, const gchar *method, GVariant *params,
 }
 
 
+/* Big messages from the server are re-encoded as GVariant by LspMessageStream
+ * which makes jsonrpc-glib switch to GVariant for the messages it sends too -
+ * servers only understand JSON so switch back right away. */
+static void on_use_gvariant_changed(GObject *object, GParamSpec *pspec, gpointer user_data)
+{
+	JsonrpcClient *client = JSONRPC_CLIENT(object);
+
+	if (jsonrpc_client_get_use_gvariant(client))
+		jsonrpc_client_set_use_gvariant(client, FALSE);
+}
+
+
 LspRpc *lsp_rpc_new(LspServer *srv, GIOStream *stream)
 {
 	LspRpc *c = g_new0(LspRpc, 1);
@@ -580,9 +723,11 @@ LspRpc *lsp_rpc_new(LspServer *srv, GIOStream *stream)
 		client_table = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, NULL);
 
 	c->client = jsonrpc_client_new(stream);
+	c->active_requests = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 	g_hash_table_insert(client_table, c->client, srv);
 	g_signal_connect(c->client, "handle-call", G_CALLBACK(handle_call), NULL);
 	g_signal_connect(c->client, "notification", G_CALLBACK(handle_notification), NULL);
+	g_signal_connect(c->client, "notify::use-gvariant", G_CALLBACK(on_use_gvariant_changed), NULL);
 	jsonrpc_client_start_listening(c->client);
 
 	return c;
@@ -591,7 +736,13 @@ LspRpc *lsp_rpc_new(LspServer *srv, GIOStream *stream)
 
 void lsp_rpc_destroy(LspRpc *rpc)
 {
+	LspServer *srv = g_hash_table_lookup(client_table, rpc->client);
+
+	if (srv)
+		log_request_stats(srv);
+
 	g_hash_table_remove(client_table, rpc->client);
+	g_hash_table_destroy(rpc->active_requests);
 	jsonrpc_client_close(rpc->client, NULL, NULL);
 	g_object_unref(rpc->client);
 	g_free(rpc);
@@ -40,27 +40,129 @@ extern GeanyPlugin *geany_plugin;
 
 extern GeanyData *geany_data;
 
+/* tokens processed at once when painting in the background */
+#define PAINT_CHUNK_SIZE 5000
+/* delay between background painting chunks (ms) */
+#define PAINT_INTERVAL 5
+/* delay of the request after scrolling in viewport mode (ms) */
+#define VIEWPORT_UPDATE_DELAY 150
+
+/* lines [first, last], empty when first > last */
 typedef struct {
-	GArray *tokens;
+	gint first;
+	gint last;
+} LineRange;
+
+typedef struct {
+	GArray *tokens;  /* encoded tokens as received from the server */
+
+	/* decoded tokens with absolute positions, one item per token */
+	GArray *lines;
+	GArray *chars;
+	GArray *lengths;
+	GArray *types;
+	GPtrArray *names;  /* keys of name_refs, NULL when not needed or not known yet */
+
+	GHashTable *name_refs;  /* token text -> number of tokens with the text */
+	gboolean names_changed;
+
+	/* lines edited since the last request and lines edited before the
+	 * requests waiting for a result; the text of the tokens there may have
+	 * changed even when the server doesn't report any change of the tokens */
+	LineRange modified_lines;
+	LineRange requested_lines;
+
+	/* state of painting in the background; painting stays set when it's
+	 * interrupted by an edit so the next result repaints everything */
+	gboolean painting;
+	guint paint_pos;
+	guint visible_start;
+	guint visible_end;
+
 	gchar *tokens_str;
 	gchar *result_id;
 } CachedData;
 
+typedef struct {
+	gint line;
+	gint pos;
+} LineCache;
+
 
 static gint style_index;
 
 static guint keyword_hash = 0;
 
+static GQueue paint_queue = G_QUEUE_INIT;  /* documents painted in the background */
+static guint paint_source = 0;
+
+/* lines requested in viewport mode */
+static GeanyDocument *viewport_doc;
+static gint viewport_first_line;
+static gint viewport_last_line;
+static guint viewport_source = 0;
+
+
+static void line_range_clear(LineRange *range)
+{
+	range->first = G_MAXINT;
+	range->last = -1;
+}
+
+
+static void line_range_add(LineRange *range, gint first, gint last)
+{
+	range->first = MIN(range->first, first);
+	range->last = MAX(range->last, last);
+}
+
+
+/* moves the lines after line by lines_added */
+static void line_range_shift(LineRange *range, gint line, gint lines_added)
+{
+	if (range->first > range->last)
+		return;
+
+	if (range->first > line)
+		range->first = MAX(line, range->first + lines_added);
+	if (range->last > line)
+		range->last = MAX(line, range->last + lines_added);
+}
+
 
 static void cached_data_free(CachedData *data)
 {
 	g_array_free(data->tokens, TRUE);
+	g_array_free(data->lines, TRUE);
+	g_array_free(data->chars, TRUE);
+	g_array_free(data->lengths, TRUE);
+	g_array_free(data->types, TRUE);
+	g_ptr_array_free(data->names, TRUE);
+	g_hash_table_destroy(data->name_refs);
 	g_free(data->tokens_str);
 	g_free(data->result_id);
 	g_free(data);
 }
 
 
+static CachedData *cached_data_new(void)
+{
+	CachedData *data = g_new0(CachedData, 1);
+
+	data->tokens = g_array_sized_new(FALSE, FALSE, sizeof(guint), 1000);
+	data->lines = g_array_new(FALSE, FALSE, sizeof(guint));
+	data->chars = g_array_new(FALSE, FALSE, sizeof(guint));
+	data->lengths = g_array_new(FALSE, FALSE, sizeof(guint));
+	data->types = g_array_new(FALSE, FALSE, sizeof(guint));
+	data->names = g_ptr_array_new();
+	data->name_refs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	line_range_clear(&data->modified_lines);
+	line_range_clear(&data->requested_lines);
+
+	return data;
+}
+
+
 void lsp_semtokens_init(gint ft_id)
 {
 	guint i;
@@ -68,7 +170,10 @@ void lsp_semtokens_init(gint ft_id)
 	{
 		GeanyDocument *doc = documents[i];
 		if (doc->file_type->id == ft_id)
+		{
+			g_queue_remove(&paint_queue, doc);
 			plugin_set_document_data(geany_plugin, doc, CACHE_KEY, NULL);
+		}
 	}
 }
 
@@ -91,10 +196,28 @@ void lsp_semtokens_style_init(GeanyDocument *doc)
 
 void lsp_semtokens_destroy(GeanyDocument *doc)
 {
+	g_queue_remove(&paint_queue, doc);
 	plugin_set_document_data(geany_plugin, doc, CACHE_KEY, NULL);
 }
 
 
+void lsp_semtokens_text_changed(GeanyDocument *doc, gint line, gint lines_added)
+{
+	CachedData *data = plugin_get_document_data(geany_plugin, doc, CACHE_KEY);
+
+	/* the token positions don't match the text anymore - stop painting in the
+	 * background, the result requested after the edit repaints everything */
+	g_queue_remove(&paint_queue, doc);
+
+	if (!data)
+		return;
+
+	line_range_shift(&data->modified_lines, line, lines_added);
+	line_range_shift(&data->requested_lines, line, lines_added);
+	line_range_add(&data->modified_lines, line, line + MAX(lines_added, 0));
+}
+
+
 static SemanticTokensEdit *sem_tokens_edit_new(void)
 {
 	SemanticTokensEdit *edit = g_new0(SemanticTokensEdit, 1);
@@ -110,12 +233,14 @@ static void sem_tokens_edit_free(SemanticTokensEdit *edit)
 }
 
 
-static void sem_tokens_edit_apply(CachedData *data, SemanticTokensEdit *edit)
+static gboolean sem_tokens_edit_apply(CachedData *data, SemanticTokensEdit *edit)
 {
-	g_return_if_fail(edit->start + edit->delete_count <= data->tokens->len);
+	g_return_val_if_fail(edit->start + edit->delete_count <= data->tokens->len, FALSE);
 
 	g_array_remove_range(data->tokens, edit->start, edit->delete_count);
 	g_array_insert_vals(data->tokens, edit->start, edit->data->data, edit->data->len);
+
+	return TRUE;
 }
 
 
@@ -151,75 +276,137 @@ static void highlight_keywords(LspServer *srv, GeanyDocument *doc)
 }
 
 
-static gchar *process_tokens(GArray *tokens, GeanyDocument *doc, guint64 token_mask)
+/* converts the relative positions of the encoded tokens to absolute ones */
+static void decode_tokens(CachedData *data)
 {
-	GHashTable *type_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-	ScintillaObject *sci = doc->editor->sci;
-	guint delta_line = 0;
-	guint delta_char = 0;
-	guint len = 0;
-	guint token_type = 0;
-	LspPosition last_pos = {0, 0};
-	gboolean first = TRUE;
-	GList *keys, *item;
-	GString *type_str;
-	gint i;
+	guint tokens_num = data->tokens->len / 5;
+	guint *encoded = (guint *) data->tokens->data;
+	guint line = 0, character = 0;
+	guint i;
 
-	if (style_index > 0)
+	g_array_set_size(data->lines, tokens_num);
+	g_array_set_size(data->chars, tokens_num);
+	g_array_set_size(data->lengths, tokens_num);
+	g_array_set_size(data->types, tokens_num);
+
+	for (i = 0; i < tokens_num; i++)
 	{
-		sci_indicator_set(doc->editor->sci, style_index);
-		sci_indicator_clear(doc->editor->sci, 0, sci_get_length(doc->editor->sci));
+		guint *token = encoded + 5 * i;
+
+		line += token[0];
+		if (token[0] == 0)
+			character += token[1];
+		else
+			character = token[1];
+
+		g_array_index(data->lines, guint, i) = line;
+		g_array_index(data->chars, guint, i) = character;
+		g_array_index(data->lengths, guint, i) = token[2];
+		g_array_index(data->types, guint, i) = token[3];
 	}
+}
 
-	for (i = 0; i < tokens->len; i++)
+
+static void get_token_range(ScintillaObject *sci, CachedData *data, guint i, LineCache *cache,
+	gint *sci_pos_start, gint *sci_pos_end)
+{
+	gint line = g_array_index(data->lines, guint, i);
+
+	/* tokens are sorted so consecutive tokens mostly share the line */
+	if (cache->line != line)
 	{
-		guint v = g_array_index(tokens, guint, i);
+		cache->line = line;
+		cache->pos = sci_get_position_from_line(sci, line);
+	}
 
-		switch (i % 5)
-		{
-			case 0:
-				delta_line = v;
-				break;
-			case 1:
-				delta_char = v;
-				break;
-			case 2:
-				len = v;
-				break;
-			case 3:
-				token_type = 1 << v;
-				break;
-		}
+	*sci_pos_start = SSM(sci, SCI_POSITIONRELATIVECODEUNITS, cache->pos,
+		g_array_index(data->chars, guint, i));
+	*sci_pos_end = SSM(sci, SCI_POSITIONRELATIVECODEUNITS, *sci_pos_start,
+		g_array_index(data->lengths, guint, i));
+}
 
-		if (i % 5 == 4)
-		{
-			last_pos.line += delta_line;
-			if (delta_line == 0)
-				last_pos.character += delta_char;
-			else
-				last_pos.character = delta_char;
 
-			if (token_type & token_mask)
-			{
-				LspPosition end_pos = last_pos;
-				gint sci_pos_start, sci_pos_end;
-				gchar *str;
+static gboolean token_type_wanted(CachedData *data, guint i, guint64 token_mask)
+{
+	guint type = g_array_index(data->types, guint, i);
 
-				end_pos.character += len;
-				sci_pos_start = lsp_utils_lsp_pos_to_scintilla(sci, last_pos);
-				sci_pos_end = lsp_utils_lsp_pos_to_scintilla(sci, end_pos);
+	return type < 64 && ((G_GUINT64_CONSTANT(1) << type) & token_mask);
+}
 
-				if (style_index > 0)
-					editor_indicator_set_on_range(doc->editor, style_index, sci_pos_start, sci_pos_end);
 
-				str = sci_get_contents_range(sci, sci_pos_start, sci_pos_end);
-				if (str)
-					g_hash_table_insert(type_table, str, NULL);
-			}
-		}
+static void ref_name(CachedData *data, guint i, gchar *str)
+{
+	gpointer key, value;
+
+	if (g_hash_table_lookup_extended(data->name_refs, str, &key, &value))
+	{
+		g_hash_table_insert(data->name_refs, key, GUINT_TO_POINTER(GPOINTER_TO_UINT(value) + 1));
+		g_free(str);
 	}
+	else
+	{
+		key = str;
+		g_hash_table_insert(data->name_refs, key, GUINT_TO_POINTER(1));
+		data->names_changed = TRUE;
+	}
+
+	data->names->pdata[i] = key;
+}
+
+
+static void unref_name(CachedData *data, guint i)
+{
+	gchar *name = data->names->pdata[i];
+	guint refs;
+
+	if (!name)
+		return;
+
+	data->names->pdata[i] = NULL;
+	refs = GPOINTER_TO_UINT(g_hash_table_lookup(data->name_refs, name));
+	if (refs > 1)
+		g_hash_table_insert(data->name_refs, name, GUINT_TO_POINTER(refs - 1));
+	else
+	{
+		g_hash_table_remove(data->name_refs, name);
+		data->names_changed = TRUE;
+	}
+}
+
+
+/* paints the token when using indicators or remembers its text when using
+ * keywords */
+static void process_token(ScintillaObject *sci, CachedData *data, guint i, guint64 token_mask,
+	LineCache *cache)
+{
+	gint sci_pos_start, sci_pos_end;
+
+	if (!token_type_wanted(data, i, token_mask))
+		return;
+
+	get_token_range(sci, data, i, cache, &sci_pos_start, &sci_pos_end);
+
+	if (style_index > 0)
+		SSM(sci, SCI_INDICATORFILLRANGE, sci_pos_start, sci_pos_end - sci_pos_start);
+	else if (!data->names->pdata[i])
+	{
+		gchar *str = sci_get_contents_range(sci, sci_pos_start, sci_pos_end);
+		if (str)
+			ref_name(data, i, str);
+	}
+}
+
+
+static void update_tokens_str(CachedData *data)
+{
+	GList *keys, *item;
+	GString *type_str;
+	gboolean first = TRUE;
+
+	if (style_index > 0 || (data->tokens_str && !data->names_changed))
+		return;
 
-	keys = g_hash_table_get_keys(type_table);
+	keys = g_hash_table_get_keys(data->name_refs);
 	type_str = g_string_new("");
 
 	foreach_list(item, keys)
@@ -231,9 +418,135 @@ static gchar *process_tokens(GArray *tokens, GeanyDocument *doc, guint64 token_m
 	}
 
 	g_list_free(keys);
-	g_hash_table_destroy(type_table);
 
-	return g_string_free(type_str, FALSE);
+	g_free(data->tokens_str);
+	data->tokens_str = g_string_free(type_str, FALSE);
+	data->names_changed = FALSE;
+}
+
+
+static void tokens_processed(GeanyDocument *doc, CachedData *data)
+{
+	LspServer *srv = lsp_server_get(doc);
+
+	update_tokens_str(data);
+	if (srv)
+		highlight_keywords(srv, doc);
+}
+
+
+/* returns the index of the first token at or after line */
+static guint find_token(CachedData *data, guint line)
+{
+	guint low = 0, high = data->lines->len;
+
+	while (low < high)
+	{
+		guint mid = low + (high - low) / 2;
+
+		if (g_array_index(data->lines, guint, mid) < line)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+
+static gboolean paint_cb(gpointer user_data)
+{
+	GeanyDocument *doc;
+
+	while ((doc = g_queue_peek_head(&paint_queue)))
+	{
+		CachedData *data = DOC_VALID(doc) ? plugin_get_document_data(geany_plugin, doc, CACHE_KEY) : NULL;
+		LspServer *srv = DOC_VALID(doc) ? lsp_server_get(doc) : NULL;
+		LineCache cache = {-1, 0};
+		guint tokens_num, end, i;
+
+		if (!data || !data->painting || !srv)
+		{
+			g_queue_pop_head(&paint_queue);
+			continue;
+		}
+
+		tokens_num = data->lines->len;
+		end = MIN(data->paint_pos + PAINT_CHUNK_SIZE, tokens_num);
+
+		if (style_index > 0)
+			sci_indicator_set(doc->editor->sci, style_index);
+		for (i = data->paint_pos; i < end; i++)
+		{
+			if (i < data->visible_start || i >= data->visible_end)
+				process_token(doc->editor->sci, data, i, srv->semantic_token_mask, &cache);
+		}
+		data->paint_pos = end;
+
+		if (end == tokens_num)
+		{
+			data->painting = FALSE;
+			g_queue_pop_head(&paint_queue);
+			tokens_processed(doc, data);
+		}
+		break;
+	}
+
+	if (g_queue_is_empty(&paint_queue))
+	{
+		paint_source = 0;
+		return G_SOURCE_REMOVE;
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+
+/* Processes all tokens of the document. Tokens in the visible part of the
+ * document are processed immediately, the rest in the background for big
+ * documents. */
+static void process_all_tokens(GeanyDocument *doc, CachedData *data, guint64 token_mask)
+{
+	ScintillaObject *sci = doc->editor->sci;
+	LineCache cache = {-1, 0};
+	gint first_visible, last_visible;
+	guint i;
+
+	g_hash_table_remove_all(data->name_refs);
+	g_ptr_array_set_size(data->names, 0);
+	g_ptr_array_set_size(data->names, data->lines->len);
+	data->names_changed = TRUE;
+	line_range_clear(&data->requested_lines);
+
+	if (style_index > 0)
+	{
+		sci_indicator_set(sci, style_index);
+		sci_indicator_clear(sci, 0, sci_get_length(sci));
+	}
+
+	if (data->lines->len <= PAINT_CHUNK_SIZE)
+	{
+		data->painting = FALSE;
+		for (i = 0; i < data->lines->len; i++)
+			process_token(sci, data, i, token_mask, &cache);
+		tokens_processed(doc, data);
+		return;
+	}
+
+	first_visible = SSM(sci, SCI_DOCLINEFROMVISIBLE, SSM(sci, SCI_GETFIRSTVISIBLELINE, 0, 0), 0);
+	last_visible = SSM(sci, SCI_DOCLINEFROMVISIBLE,
+		SSM(sci, SCI_GETFIRSTVISIBLELINE, 0, 0) + SSM(sci, SCI_LINESONSCREEN, 0, 0), 0);
+
+	data->visible_start = find_token(data, first_visible);
+	data->visible_end = find_token(data, last_visible + 1);
+	for (i = data->visible_start; i < data->visible_end; i++)
+		process_token(sci, data, i, token_mask, &cache);
+
+	data->painting = TRUE;
+	data->paint_pos = 0;
+	if (!g_queue_find(&paint_queue, doc))
+		g_queue_push_tail(&paint_queue, doc);
+	if (paint_source == 0)
+		paint_source = plugin_timeout_add(geany_plugin, PAINT_INTERVAL, paint_cb, NULL);
 }
 
 
@@ -256,8 +569,7 @@ static void process_full_result(GeanyDocument *doc, GVariant *result, guint64 to
 
 		if (data == NULL)
 		{
-			data = g_new0(CachedData, 1);
-			data->tokens = g_array_sized_new(FALSE, FALSE, sizeof(guint), 1000);
+			data = cached_data_new();
 			plugin_set_document_data_full(geany_plugin, doc, CACHE_KEY, data, (GDestroyNotify)cached_data_free);
 		}
 
@@ -271,8 +583,8 @@ static void process_full_result(GeanyDocument *doc, GVariant *result, guint64 to
 			g_array_append_val(data->tokens, v);
 		}
 
-		g_free(data->tokens_str);
-		data->tokens_str = process_tokens(data->tokens, doc, token_mask);
+		decode_tokens(data);
+		process_all_tokens(doc, data, token_mask);
 
 		g_variant_iter_free(iter);
 	}
@@ -284,7 +596,170 @@ static gint sort_edits(gconstpointer a, gconstpointer b)
 	const SemanticTokensEdit *e1 = *((SemanticTokensEdit **) a);
 	const SemanticTokensEdit *e2 = *((SemanticTokensEdit **) b);
 
-	return e2->start - e1->start;
+	return e1->start - e2->start;
+}
+
+
+/* marks tokens overlapping the integers [start, start + len) of the encoded
+ * tokens together with their neighbors so the gaps after deleted tokens get
+ * cleared too */
+static void mark_dirty(guint8 *dirty, guint tokens_num, guint start, guint len)
+{
+	guint first = start / 5;
+	guint last = (start + len + 4) / 5;
+	guint i;
+
+	first = first > 0 ? first - 1 : 0;
+	last = MIN(last + 1, tokens_num);
+	for (i = first; i < last; i++)
+		dirty[i] = TRUE;
+}
+
+
+static guint count_clean(guint8 *dirty, guint tokens_num)
+{
+	guint clean = 0, i;
+
+	for (i = 0; i < tokens_num; i++)
+		clean += !dirty[i];
+	return clean;
+}
+
+
+/* repaints tokens changed by the edits; returns FALSE when the whole
+ * document has to be processed again */
+static gboolean apply_edits(GeanyDocument *doc, CachedData *data, GPtrArray *edits, guint64 token_mask)
+{
+	ScintillaObject *sci = doc->editor->sci;
+	guint old_num = data->lines->len;
+	guint8 *old_dirty = g_new0(guint8, old_num + 1);
+	guint8 *new_dirty;
+	GPtrArray *new_names;
+	LineCache cache = {-1, 0};
+	SemanticTokensEdit *edit;
+	gboolean success = TRUE;
+	gint shift = 0;
+	guint new_num, i, j;
+
+	g_ptr_array_sort(edits, sort_edits);
+
+	foreach_ptr_array(edit, i, edits)
+		mark_dirty(old_dirty, old_num, edit->start, edit->delete_count);
+
+	/* apply from the end so the start offsets of the remaining edits stay valid */
+	for (i = edits->len; i > 0 && success; i--)
+		success = sem_tokens_edit_apply(data, edits->pdata[i - 1]);
+
+	if (!success || data->tokens->len % 5 != 0 || data->painting)
+	{
+		g_free(old_dirty);
+		return FALSE;
+	}
+
+	new_num = data->tokens->len / 5;
+	new_dirty = g_new0(guint8, new_num + 1);
+	foreach_ptr_array(edit, i, edits)
+	{
+		mark_dirty(new_dirty, new_num, edit->start + shift, edit->data->len);
+		shift += (gint)edit->data->len - (gint)edit->delete_count;
+	}
+
+	/* tokens outside the edits must correspond to each other */
+	if (count_clean(old_dirty, old_num) != count_clean(new_dirty, new_num))
+	{
+		g_free(old_dirty);
+		g_free(new_dirty);
+		return FALSE;
+	}
+
+	for (i = 0; i < old_num; i++)
+	{
+		if (old_dirty[i])
+			unref_name(data, i);
+	}
+
+	new_names = g_ptr_array_sized_new(new_num);
+	for (i = 0, j = 0; i < new_num; i++)
+	{
+		if (new_dirty[i])
+			g_ptr_array_add(new_names, NULL);
+		else
+		{
+			while (old_dirty[j])
+				j++;
+			g_ptr_array_add(new_names, data->names->pdata[j++]);
+		}
+	}
+	g_ptr_array_free(data->names, TRUE);
+	data->names = new_names;
+
+	decode_tokens(data);
+
+	/* edits which keep the tokens, e.g. renaming to a name of the same length,
+	 * aren't reported by the server - take the names from the edited lines again */
+	if (style_index == 0)
+	{
+		LineRange edited = data->requested_lines;
+		guint end;
+
+		line_range_add(&edited, data->modified_lines.first, data->modified_lines.last);
+		if (edited.first <= edited.last)
+		{
+			end = find_token(data, edited.last + 1);
+			for (i = find_token(data, edited.first); i < end; i++)
+			{
+				unref_name(data, i);
+				new_dirty[i] = TRUE;
+			}
+		}
+	}
+	line_range_clear(&data->requested_lines);
+
+	if (style_index > 0)
+		sci_indicator_set(sci, style_index);
+
+	for (i = 0; i < new_num; i++)
+	{
+		gint clear_start = 0, clear_end = sci_get_length(sci);
+		gint pos_start, pos_end;
+		guint span_end;
+
+		if (!new_dirty[i])
+			continue;
+
+		for (span_end = i; span_end < new_num && new_dirty[span_end]; span_end++)
+			;
+
+		if (style_index > 0)
+		{
+			if (i > 0)
+			{
+				get_token_range(sci, data, i - 1, &cache, &pos_start, &pos_end);
+				clear_start = pos_end;
+			}
+			if (span_end < new_num)
+			{
+				get_token_range(sci, data, span_end, &cache, &pos_start, &pos_end);
+				clear_end = pos_start;
+			}
+			if (clear_end > clear_start)
+				sci_indicator_clear(sci, clear_start, clear_end - clear_start);
+		}
+
+		for (; i < span_end; i++)
+			process_token(sci, data, i, token_mask, &cache);
+	}
+
+	/* all tokens deleted */
+	if (new_num == 0 && style_index > 0)
+		sci_indicator_clear(sci, 0, sci_get_length(sci));
+
+	g_free(old_dirty);
+	g_free(new_dirty);
+
+	tokens_processed(doc, data);
+
+	return TRUE;
 }
 
 
@@ -313,7 +788,6 @@ static gboolean process_delta_result(GeanyDocument *doc, GVariant *result, guint
 		GPtrArray *edits = g_ptr_array_new_full(4, (GDestroyNotify)sem_tokens_edit_free);
 		SemanticTokensEdit *edit;
 		GVariant *val = NULL;
-		guint i;
  
 		while (g_variant_iter_loop(iter, "v", &val))
 		{
@@ -348,13 +822,13 @@ static gboolean process_delta_result(GeanyDocument *doc, GVariant *result, guint
 				g_variant_iter_free(iter2);
 		}
 
-		g_ptr_array_sort(edits, sort_edits);
-
-		foreach_ptr_array(edit, i, edits)
-			sem_tokens_edit_apply(data, edit);
-
-		g_free(data->tokens_str);
-		data->tokens_str = process_tokens(data->tokens, doc, token_mask);
+		/* edits which can't be mapped to the painted tokens (or arriving while
+		 * the previous result is still being painted) repaint everything */
+		if (!apply_edits(doc, data, edits, token_mask))
+		{
+			decode_tokens(data);
+			process_all_tokens(doc, data, token_mask);
+		}
 		g_free(data->result_id);
 		data->result_id = g_strdup(result_id);
 
@@ -381,7 +855,6 @@ static void semtokens_cb(GVariant *return_value, GError *error, gpointer user_da
 
 		if (srv)
 		{
-			gboolean success = TRUE;
 			GVariantIter *iter = NULL;
 
 			//printf("%s\n\n\n", lsp_utils_json_pretty_print(return_value));
@@ -396,10 +869,7 @@ static void semtokens_cb(GVariant *return_value, GError *error, gpointer user_da
 				g_variant_iter_free(iter);
 			}
 			else
-				success = process_delta_result(doc, return_value, srv->semantic_token_mask);
-
-			if (success)
-				highlight_keywords(srv, doc);
+				process_delta_result(doc, return_value, srv->semantic_token_mask);
 		}
 	}
 }
@@ -411,7 +881,7 @@ void lsp_semtokens_send_request(GeanyDocument *doc)
 	gchar *doc_uri;
 	GVariant *node;
 	CachedData *cached_data;
-	gboolean delta;
+	gboolean viewport, delta;
 
 	if (!doc || !server)
 		return;
@@ -422,12 +892,56 @@ void lsp_semtokens_send_request(GeanyDocument *doc)
 	 * need to request document opening here */
 	lsp_sync_text_document_did_open(server, doc);
 
+	/* huge documents - request only tokens around the visible lines */
+	viewport = server->config.semantic_tokens_supports_range &&
+		lsp_utils_use_viewport_mode(doc, &server->config);
+	viewport_doc = NULL;
+
 	cached_data = plugin_get_document_data(geany_plugin, doc, CACHE_KEY);
-	delta = cached_data != NULL && cached_data->result_id &&
+	if (cached_data)
+	{
+		LineRange *modified = &cached_data->modified_lines;
+
+		if (modified->first <= modified->last)
+			line_range_add(&cached_data->requested_lines, modified->first, modified->last);
+		line_range_clear(modified);
+	}
+	delta = !viewport && cached_data != NULL && cached_data->result_id &&
 		server->config.semantic_tokens_supports_delta &&
 		!server->config.semantic_tokens_force_full;
 
-	if (delta)
+	if (viewport)
+	{
+		ScintillaObject *sci = doc->editor->sci;
+		LspPosition start_pos, end_pos;
+
+		lsp_utils_get_viewport_lines(sci, &viewport_first_line, &viewport_last_line);
+		viewport_doc = doc;
+
+		start_pos = lsp_utils_scintilla_pos_to_lsp(sci,
+			sci_get_position_from_line(sci, viewport_first_line));
+		end_pos = lsp_utils_scintilla_pos_to_lsp(sci,
+			sci_get_line_end_position(sci, viewport_last_line));
+
+		node = JSONRPC_MESSAGE_NEW(
+			"textDocument", "{",
+				"uri", JSONRPC_MESSAGE_PUT_STRING(doc_uri),
+			"}",
+			"range", "{",
+				"start", "{",
+					"line", JSONRPC_MESSAGE_PUT_INT32(start_pos.line),
+					"character", JSONRPC_MESSAGE_PUT_INT32(start_pos.character),
+				"}",
+				"end", "{",
+					"line", JSONRPC_MESSAGE_PUT_INT32(end_pos.line),
+					"character", JSONRPC_MESSAGE_PUT_INT32(end_pos.character),
+				"}",
+			"}"
+		);
+		lsp_rpc_call(server, "textDocument/semanticTokens/range", node,
+			semtokens_cb, doc);
+	}
+	else if (delta)
 	{
 		node = JSONRPC_MESSAGE_NEW(
 			"previousResultId", JSONRPC_MESSAGE_PUT_STRING(cached_data->result_id),
@@ -477,11 +991,39 @@ void lsp_semtokens_send_request(GeanyDocument *doc)
 }
 
 
+static gboolean viewport_request_cb(gpointer user_data)
+{
+	GeanyDocument *doc = document_get_current();
+
+	viewport_source = 0;
+	if (doc && doc == viewport_doc)
+		lsp_semtokens_send_request(doc);
+
+	return G_SOURCE_REMOVE;
+}
+
+
+/* requests tokens after scrolling out of the lines requested in viewport mode */
+void lsp_semtokens_viewport_changed(GeanyDocument *doc)
+{
+	if (!doc || doc != viewport_doc)
+		return;
+
+	if (lsp_utils_viewport_in_lines(doc->editor->sci, viewport_first_line, viewport_last_line))
+		return;
+
+	if (viewport_source != 0)
+		g_source_remove(viewport_source);
+	viewport_source = plugin_timeout_add(geany_plugin, VIEWPORT_UPDATE_DELAY, viewport_request_cb, NULL);
+}
+
+
 void lsp_semtokens_clear(GeanyDocument *doc)
 {
 	if (!doc)
 		return;
 
+	g_queue_remove(&paint_queue, doc);
 	plugin_set_document_data(geany_plugin, doc, CACHE_KEY, NULL);
 	keyword_hash = 0;
 
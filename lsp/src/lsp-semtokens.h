@@ -24,7 +24,9 @@
 #include <glib.h>
 
 void lsp_semtokens_send_request(GeanyDocument *doc);
+void lsp_semtokens_viewport_changed(GeanyDocument *doc);
 void lsp_semtokens_clear(GeanyDocument *doc);
+void lsp_semtokens_text_changed(GeanyDocument *doc, gint line, gint lines_added);
 
 void lsp_semtokens_style_init(GeanyDocument *doc);
 
@@ -32,6 +32,7 @@
 #include "lsp-symbol-kinds.h"
 #include "lsp-highlight.h"
 #include "lsp-workspace-folders.h"
+#include "lsp-message-stream.h"
 
 #include "spawn/spawn.h"
 
@@ -573,6 +574,7 @@ static void initialize_cb(GVariant *return_value, GError *error, gpointer user_d
 			(supports_semantic_token_full || supports_semantic_token_range);
 		s->config.semantic_tokens_range_only = !supports_semantic_token_full &&
 			supports_semantic_token_range;
+		s->config.semantic_tokens_supports_range = supports_semantic_token_range;
 
 		s->semantic_token_mask = get_semantic_token_mask(s, return_value);
 
@@ -875,6 +877,8 @@ static void start_lsp_server(LspServer *server)
 	input_stream = lsp_unix_input_stream_new(stdout_fd, TRUE);
 	output_stream = lsp_unix_output_stream_new(stdin_fd, TRUE);
 #endif
+	// big messages are parsed in a worker thread
+	input_stream = lsp_message_stream_new(input_stream);
 	server->stream = g_simple_io_stream_new(input_stream, output_stream);
 
 	server->log = lsp_log_start(&server->config);
@@ -996,6 +1000,8 @@ static void load_config(GKeyFile *kf, const gchar *section, LspServer *s)
 	get_str(&s->config.command_on_save_regex, kf, section, "command_on_save_regex");
 
 	get_bool(&s->config.progress_bar_enable, kf, section, "progress_bar_enable");
+
+	get_int(&s->config.viewport_mode_line_threshold, kf, section, "viewport_mode_line_threshold");
 	get_bool(&s->config.swap_header_source_enable, kf, section, "swap_header_source_enable");
 
 	get_str(&s->config.trace_value, kf, section, "trace_value");
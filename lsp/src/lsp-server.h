@@ -89,6 +89,7 @@ typedef struct LspServerConfig
 	gchar **semantic_tokens_types;
 	gboolean semantic_tokens_supports_delta;
 	gboolean semantic_tokens_range_only;
+	gboolean semantic_tokens_supports_range;
 	gint semantic_tokens_lexer_kw_index;
 	gchar *semantic_tokens_type_style;
 
@@ -110,6 +111,8 @@ typedef struct LspServerConfig
 
 	gboolean progress_bar_enable;
 
+	gint viewport_mode_line_threshold;
+
 	gboolean execute_command_enable;
 	gboolean code_action_enable;
 	gboolean selection_range_enable;
@@ -151,6 +154,8 @@ typedef struct LspServer
 
 	GHashTable *open_docs;
 	GSList *mru_docs;
+	GHashTable *pending_changes;
+	guint pending_changes_source;
 	GHashTable *diag_table;
 	GHashTable *wks_folder_table;
 	GSList *progress_ops;
@@ -30,21 +30,73 @@
 #include "lsp-symbols.h"
 
 #include <jsonrpc-glib.h>
+#include <string.h>
 
 #define VERSION_NUM_KEY "lsp_sync_version_num"
 
 #define MRU_SIZE 50
 
+// delay after which accumulated changes are sent to the server
+#define FLUSH_DELAY 20
+
+// approximate size of the serialized range and rangeLength of a change
+#define CHANGE_RANGE_SIZE 100
+
+
+typedef struct
+{
+	LspPosition pos_start;
+	LspPosition pos_end;
+	gint range_length;
+	gchar *text;
+} PendingChange;
+
+
+typedef struct
+{
+	GPtrArray *changes;
+	gsize payload_len;  // approximate size of the serialized changes
+	gboolean full_sync;  // send the whole document instead of the ranges
+} PendingChanges;
+
 
 extern GeanyPlugin *geany_plugin;
 
 
+static void pending_change_free(PendingChange *change)
+{
+	g_free(change->text);
+	g_free(change);
+}
+
+
+static void pending_changes_free(PendingChanges *pending)
+{
+	g_ptr_array_free(pending->changes, TRUE);
+	g_free(pending);
+}
+
+
+static void remove_flush_source(LspServer *srv)
+{
+	if (srv->pending_changes_source != 0)
+		g_source_remove(srv->pending_changes_source);
+	srv->pending_changes_source = 0;
+}
+
+
 void lsp_sync_init(LspServer *srv)
 {
 	if (!srv->open_docs)
 		srv->open_docs = g_hash_table_new(NULL, NULL);
 	g_hash_table_remove_all(srv->open_docs);
 
+	if (!srv->pending_changes)
+		srv->pending_changes = g_hash_table_new_full(NULL, NULL, NULL,
+			(GDestroyNotify)pending_changes_free);
+	g_hash_table_remove_all(srv->pending_changes);
+	remove_flush_source(srv);
+
 	g_slist_free(srv->mru_docs);
 	srv->mru_docs = NULL;
 }
@@ -52,6 +104,8 @@ void lsp_sync_init(LspServer *srv)
 
 static void destroy_doc_data(LspServer *srv, GeanyDocument *doc)
 {
+	if (srv->pending_changes)
+		g_hash_table_remove(srv->pending_changes, doc);
 	lsp_semtokens_destroy(doc);
 	lsp_symbols_destroy(doc);
 	srv->mru_docs = g_slist_remove(srv->mru_docs, doc);
@@ -74,6 +128,11 @@ void lsp_sync_free(LspServer *srv)
 		g_hash_table_destroy(srv->open_docs);
 	}
 	srv->open_docs = NULL;
+
+	remove_flush_source(srv);
+	if (srv->pending_changes)
+		g_hash_table_destroy(srv->pending_changes);
+	srv->pending_changes = NULL;
 }
 
 
@@ -183,6 +242,8 @@ void lsp_sync_text_document_did_save(LspServer *server, GeanyDocument *doc)
 	if (!server->send_did_save)
 		return;
 
+	lsp_sync_flush_changes(server, doc);
+
 	doc_uri = lsp_utils_get_doc_uri(doc);
 
 	if (server->include_text_on_save)
@@ -214,61 +275,177 @@ void lsp_sync_text_document_did_save(LspServer *server, GeanyDocument *doc)
 }
 
 
-void lsp_sync_text_document_did_change(LspServer *server, GeanyDocument *doc,
-	LspPosition pos_start, LspPosition pos_end, gchar *text)
+static GVariant *create_content_changes(GeanyDocument *doc, PendingChanges *pending)
 {
-	GVariant *node;
-	gchar *doc_uri = lsp_utils_get_doc_uri(doc);
-	guint doc_version = get_next_doc_version_num(doc);
+	GPtrArray *arr = g_ptr_array_new_full(1, (GDestroyNotify) g_variant_unref);
+	GVariant *changes;
 
-	if (server->use_incremental_sync)
+	if (pending->full_sync)
 	{
-		gint range = SSM(
-			doc->editor->sci, SCI_COUNTCODEUNITS,
-			lsp_utils_lsp_pos_to_scintilla(doc->editor->sci, pos_start),
-			lsp_utils_lsp_pos_to_scintilla(doc->editor->sci, pos_end)
-		);
+		gchar *doc_text = sci_get_contents(doc->editor->sci, -1);
 
-		node = JSONRPC_MESSAGE_NEW (
-			"textDocument", "{",
-				"uri", JSONRPC_MESSAGE_PUT_STRING(doc_uri),
-				"version", JSONRPC_MESSAGE_PUT_INT32(doc_version),
-			"}",
-			"contentChanges", "[", "{",
+		g_ptr_array_add(arr, JSONRPC_MESSAGE_NEW (
+			"text", JSONRPC_MESSAGE_PUT_STRING(doc_text)
+		));
+
+		g_free(doc_text);
+	}
+	else
+	{
+		PendingChange *change;
+		guint i;
+
+		foreach_ptr_array(change, i, pending->changes)
+		{
+			g_ptr_array_add(arr, JSONRPC_MESSAGE_NEW (
 				"range", "{",
 					"start", "{",
-						"line", JSONRPC_MESSAGE_PUT_INT32(pos_start.line),
-						"character", JSONRPC_MESSAGE_PUT_INT32(pos_start.character),
+						"line", JSONRPC_MESSAGE_PUT_INT32(change->pos_start.line),
+						"character", JSONRPC_MESSAGE_PUT_INT32(change->pos_start.character),
 					"}",
 					"end", "{",
-						"line", JSONRPC_MESSAGE_PUT_INT32(pos_end.line),
-						"character", JSONRPC_MESSAGE_PUT_INT32(pos_end.character),
+						"line", JSONRPC_MESSAGE_PUT_INT32(change->pos_end.line),
+						"character", JSONRPC_MESSAGE_PUT_INT32(change->pos_end.character),
 					"}",
 				"}",
 				// not required but the lemminx server crashes without it
-				"rangeLength", JSONRPC_MESSAGE_PUT_INT32(range),
-				"text", JSONRPC_MESSAGE_PUT_STRING(text),
-			"}", "]"
-		);
+				"rangeLength", JSONRPC_MESSAGE_PUT_INT32(change->range_length),
+				"text", JSONRPC_MESSAGE_PUT_STRING(change->text)
+			));
+		}
 	}
-	else
+
+	changes = g_variant_take_ref(g_variant_new_array(G_VARIANT_TYPE_VARDICT,
+		(GVariant **)arr->pdata, arr->len));
+
+	g_ptr_array_free(arr, TRUE);
+
+	return changes;
+}
+
+
+/* Sends all changes accumulated for the document as a single didChange
+ * notification. Has to be called before any request depending on the
+ * current document contents is sent to the server. */
+void lsp_sync_flush_changes(LspServer *server, GeanyDocument *doc)
+{
+	PendingChanges *pending;
+	GVariant *node, *changes;
+	gchar *doc_uri;
+	guint doc_version;
+
+	if (!server || !server->pending_changes)
+		return;
+
+	pending = g_hash_table_lookup(server->pending_changes, doc);
+	if (!pending)
+		return;
+
+	g_hash_table_steal(server->pending_changes, doc);
+
+	if (!lsp_sync_is_document_open(server, doc))
 	{
-		node = JSONRPC_MESSAGE_NEW (
-			"textDocument", "{",
-				"uri", JSONRPC_MESSAGE_PUT_STRING(doc_uri),
-				"version", JSONRPC_MESSAGE_PUT_INT32(doc_version),
-			"}",
-			"contentChanges", "[", "{",
-				"text", JSONRPC_MESSAGE_PUT_STRING(text),
-			"}", "]"
-		);
+		pending_changes_free(pending);
+		return;
 	}
 
+	doc_uri = lsp_utils_get_doc_uri(doc);
+	doc_version = get_next_doc_version_num(doc);
+	changes = create_content_changes(doc, pending);
+
+	node = JSONRPC_MESSAGE_NEW (
+		"textDocument", "{",
+			"uri", JSONRPC_MESSAGE_PUT_STRING(doc_uri),
+			"version", JSONRPC_MESSAGE_PUT_INT32(doc_version),
+		"}",
+		"contentChanges", JSONRPC_MESSAGE_PUT_VARIANT(changes)
+	);
+
 	//printf("%s\n\n\n", lsp_utils_json_pretty_print(node));
 
 	lsp_rpc_notify(server, "textDocument/didChange", node, NULL, NULL);
 
 	g_free(doc_uri);
-
+	g_variant_unref(changes);
 	g_variant_unref(node);
+	pending_changes_free(pending);
+}
+
+
+void lsp_sync_flush_all_changes(LspServer *server)
+{
+	GList *docs, *item;
+
+	if (!server || !server->pending_changes)
+		return;
+
+	remove_flush_source(server);
+
+	docs = g_hash_table_get_keys(server->pending_changes);
+	foreach_list(item, docs)
+	{
+		lsp_sync_flush_changes(server, item->data);
+	}
+	g_list_free(docs);
+}
+
+
+static gboolean flush_changes_cb(gpointer user_data)
+{
+	LspServer *server = user_data;
+
+	server->pending_changes_source = 0;
+	lsp_sync_flush_all_changes(server);
+
+	return G_SOURCE_REMOVE;
+}
+
+
+/* Records the change without sending it - changes are collected and sent
+ * together shortly afterwards or before the next request. For full document
+ * sync pos_start, pos_end and text are ignored. */
+void lsp_sync_text_document_did_change(LspServer *server, GeanyDocument *doc,
+	LspPosition pos_start, LspPosition pos_end, const gchar *text)
+{
+	PendingChanges *pending = g_hash_table_lookup(server->pending_changes, doc);
+
+	if (!pending)
+	{
+		pending = g_new0(PendingChanges, 1);
+		pending->changes = g_ptr_array_new_with_free_func((GDestroyNotify)pending_change_free);
+		g_hash_table_insert(server->pending_changes, doc, pending);
+	}
+
+	if (!server->use_incremental_sync)
+		pending->full_sync = TRUE;
+
+	if (!pending->full_sync)
+	{
+		PendingChange *change = g_new0(PendingChange, 1);
+
+		change->pos_start = pos_start;
+		change->pos_end = pos_end;
+		change->range_length = SSM(
+			doc->editor->sci, SCI_COUNTCODEUNITS,
+			lsp_utils_lsp_pos_to_scintilla(doc->editor->sci, pos_start),
+			lsp_utils_lsp_pos_to_scintilla(doc->editor->sci, pos_end)
+		);
+		change->text = g_strdup(text);
+		g_ptr_array_add(pending->changes, change);
+
+		pending->payload_len += CHANGE_RANGE_SIZE + strlen(text);
+
+		// when the accumulated changes get bigger than the document itself,
+		// it's cheaper to send the whole document - this also limits the number
+		// of changes of edits which mostly delete text
+		if (pending->payload_len > (gsize)sci_get_length(doc->editor->sci))
+		{
+			pending->full_sync = TRUE;
+			g_ptr_array_set_size(pending->changes, 0);
+		}
+	}
+
+	if (server->pending_changes_source == 0)
+		server->pending_changes_source = plugin_timeout_add(geany_plugin, FLUSH_DELAY,
+			flush_changes_cb, server);
 }
@@ -30,7 +30,9 @@ void lsp_sync_text_document_did_open(LspServer *server, GeanyDocument *doc);
 void lsp_sync_text_document_did_close(LspServer *server, GeanyDocument *doc);
 void lsp_sync_text_document_did_save(LspServer *server, GeanyDocument *doc);
 void lsp_sync_text_document_did_change(LspServer *server, GeanyDocument *doc,
-	LspPosition pos_start, LspPosition pos_end, gchar *text);
+	LspPosition pos_start, LspPosition pos_end, const gchar *text);
+void lsp_sync_flush_changes(LspServer *server, GeanyDocument *doc);
+void lsp_sync_flush_all_changes(LspServer *server);
 
 gboolean lsp_sync_is_document_open(LspServer *server, GeanyDocument *doc);
 
@@ -864,6 +864,37 @@ gchar *lsp_utils_get_current_iden(GeanyDocument *doc, gint current_pos, const gc
 }
 
 
+/* whether only the visible part of the document should be processed */
+gboolean lsp_utils_use_viewport_mode(GeanyDocument *doc, LspServerConfig *cfg)
+{
+	return cfg->viewport_mode_line_threshold > 0 &&
+		sci_get_line_count(doc->editor->sci) > cfg->viewport_mode_line_threshold;
+}
+
+
+/* returns the visible lines extended by one screen above and below */
+void lsp_utils_get_viewport_lines(ScintillaObject *sci, gint *first_line, gint *last_line)
+{
+	gint first_visible = SSM(sci, SCI_GETFIRSTVISIBLELINE, 0, 0);
+	gint lines_on_screen = SSM(sci, SCI_LINESONSCREEN, 0, 0);
+	gint margin = MAX(lines_on_screen, 50);
+
+	*first_line = SSM(sci, SCI_DOCLINEFROMVISIBLE, MAX(first_visible - margin, 0), 0);
+	*last_line = SSM(sci, SCI_DOCLINEFROMVISIBLE, first_visible + lines_on_screen + margin, 0);
+}
+
+
+/* whether the currently visible lines are within the given lines */
+gboolean lsp_utils_viewport_in_lines(ScintillaObject *sci, gint first_line, gint last_line)
+{
+	gint first_visible = SSM(sci, SCI_GETFIRSTVISIBLELINE, 0, 0);
+	gint lines_on_screen = SSM(sci, SCI_LINESONSCREEN, 0, 0);
+
+	return SSM(sci, SCI_DOCLINEFROMVISIBLE, first_visible, 0) >= first_line &&
+		SSM(sci, SCI_DOCLINEFROMVISIBLE, first_visible + lines_on_screen, 0) <= last_line;
+}
+
+
 gint lsp_utils_set_indicator_style(ScintillaObject *sci, const gchar *style_str)
 {
 	gchar **comps = g_strsplit(style_str, ";", -1);
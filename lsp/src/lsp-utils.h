@@ -122,6 +122,10 @@ gchar *lsp_utils_get_current_iden(GeanyDocument *doc, gint current_pos, const gc
 
 gint lsp_utils_set_indicator_style(ScintillaObject *sci, const gchar *style_str);
 
+gboolean lsp_utils_use_viewport_mode(GeanyDocument *doc, LspServerConfig *cfg);
+void lsp_utils_get_viewport_lines(ScintillaObject *sci, gint *first_line, gint *last_line);
+gboolean lsp_utils_viewport_in_lines(ScintillaObject *sci, gint first_line, gint last_line);
+
 gchar *lsp_utils_get_relative_path(const gchar *utf8_parent, const gchar *utf8_descendant);
 
 void lsp_utils_save_all_docs(void);
@@ -0,0 +1,537 @@
+/*
+ * Copyright 2026 The Geany contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Directory scanner running in a pool of worker threads. Every worker owns
+ * a queue of directories to scan - newly found subdirectories are added to
+ * the worker's own queue and processed depth-first; when a worker runs out
+ * of work, it steals directories from the other end of the queues of other
+ * workers. Found files are sent in batches to the main loop.
+ */
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
+#include <geanyplugin.h>
+
+#ifndef G_OS_WIN32
+	#include <dirent.h>
+#endif
+
+#include "prjorg-crawler.h"
+#include "prjorg-project.h"
+#include "prjorg-utils.h"
+
+extern GeanyPlugin *geany_plugin;
+
+#define MAX_WORKERS 8
+#define BATCH_SIZE 1000
+/* how often found files are passed to the main loop (ms) */
+#define DISPATCH_INTERVAL 100
+
+typedef struct
+{
+	guint root_index;
+	gboolean is_root;
+	gchar *utf8_path;
+	gchar *locale_path;
+} CrawlDir;
+
+typedef struct
+{
+	guint root_index;
+	GPtrArray *utf8_paths;
+	GPtrArray *utf8_dirs;
+} CrawlBatch;
+
+typedef struct
+{
+	PrjOrgCrawler *crawler;
+	GThread *thread;
+	GMutex lock;  /* protects dirs */
+	GQueue dirs;  /* of CrawlDir */
+	CrawlBatch *batch;  /* batch being filled, accessed by the worker only */
+} CrawlWorker;
+
+struct PrjOrgCrawler
+{
+	CrawlWorker *workers;
+	guint workers_num;
+
+	GMutex lock;  /* protects visited_paths, used also for waiting for work */
+	GCond cond;
+	GHashTable *visited_paths;
+
+	gint pending_dirs;  /* directories queued or being scanned */
+	gint finished_workers;
+	gint cancelled;
+
+	GAsyncQueue *batches;  /* of CrawlBatch */
+	guint dispatch_source;
+
+	GSList *patterns;
+	GSList *ignored_dirs_patterns;
+	GSList *ignored_file_patterns;
+	gboolean show_empty_dirs;
+
+	PrjOrgCrawlerBatchFunc batch_cb;
+	PrjOrgCrawlerDoneFunc done_cb;
+	gpointer user_data;
+};
+
+
+static void crawl_dir_free(CrawlDir *dir)
+{
+	g_free(dir->utf8_path);
+	g_free(dir->locale_path);
+	g_free(dir);
+}
+
+
+static void crawl_batch_free(CrawlBatch *batch)
+{
+	g_ptr_array_free(batch->utf8_paths, TRUE);
+	g_ptr_array_free(batch->utf8_dirs, TRUE);
+	g_free(batch);
+}
+
+
+static void free_patterns(GSList *patterns)
+{
+	g_slist_foreach(patterns, (GFunc) g_pattern_spec_free, NULL);
+	g_slist_free(patterns);
+}
+
+
+static void push_dir(CrawlWorker *worker, CrawlDir *dir)
+{
+	PrjOrgCrawler *crawler = worker->crawler;
+
+	g_atomic_int_inc(&crawler->pending_dirs);
+
+	g_mutex_lock(&worker->lock);
+	g_queue_push_tail(&worker->dirs, dir);
+	g_mutex_unlock(&worker->lock);
+
+	/* wake up idle workers so they can steal the directory */
+	g_mutex_lock(&crawler->lock);
+	g_cond_signal(&crawler->cond);
+	g_mutex_unlock(&crawler->lock);
+}
+
+
+static CrawlDir *take_dir(CrawlWorker *worker)
+{
+	PrjOrgCrawler *crawler = worker->crawler;
+	guint self = worker - crawler->workers;
+	CrawlDir *dir;
+	guint i;
+
+	g_mutex_lock(&worker->lock);
+	dir = g_queue_pop_tail(&worker->dirs);
+	g_mutex_unlock(&worker->lock);
+
+	/* steal from the other end - those are the directories higher in the
+	 * hierarchy with most work under them */
+	for (i = 1; !dir && i < crawler->workers_num; i++)
+	{
+		CrawlWorker *victim = &crawler->workers[(self + i) % crawler->workers_num];
+
+		g_mutex_lock(&victim->lock);
+		dir = g_queue_pop_head(&victim->dirs);
+		g_mutex_unlock(&victim->lock);
+	}
+
+	return dir;
+}
+
+
+static void flush_batch(CrawlWorker *worker)
+{
+	if (worker->batch)
+		g_async_queue_push(worker->crawler->batches, worker->batch);
+	worker->batch = NULL;
+}
+
+
+static CrawlBatch *get_batch(CrawlWorker *worker, guint root_index)
+{
+	if (worker->batch && (worker->batch->root_index != root_index ||
+		worker->batch->utf8_paths->len + worker->batch->utf8_dirs->len >= BATCH_SIZE))
+	{
+		flush_batch(worker);
+	}
+
+	if (!worker->batch)
+	{
+		worker->batch = g_new0(CrawlBatch, 1);
+		worker->batch->root_index = root_index;
+		worker->batch->utf8_paths = g_ptr_array_new_with_free_func(g_free);
+		worker->batch->utf8_dirs = g_ptr_array_new_with_free_func(g_free);
+	}
+
+	return worker->batch;
+}
+
+
+static void add_result(CrawlWorker *worker, guint root_index, gchar *utf8_path)
+{
+	g_ptr_array_add(get_batch(worker, root_index)->utf8_paths, utf8_path);
+}
+
+
+static void add_scanned_dir(CrawlWorker *worker, guint root_index, const gchar *utf8_dir)
+{
+	g_ptr_array_add(get_batch(worker, root_index)->utf8_dirs, g_strdup(utf8_dir));
+}
+
+
+/* returns 1 if the entry is a matching file or a non-ignored directory */
+static guint process_entry(CrawlWorker *worker, CrawlDir *dir, const gchar *locale_name,
+	gboolean is_dir, gboolean is_regular)
+{
+	PrjOrgCrawler *crawler = worker->crawler;
+	gchar *utf8_name;
+	guint found = 0;
+
+	if (!is_dir && !is_regular)
+		return 0;
+
+	/* convert just the name, the rest of the path is known already */
+	utf8_name = utils_get_utf8_from_locale(locale_name);
+
+	if (is_dir)
+	{
+		if (!patterns_match(crawler->ignored_dirs_patterns, utf8_name))
+		{
+			CrawlDir *child = g_new0(CrawlDir, 1);
+
+			child->root_index = dir->root_index;
+			child->utf8_path = g_build_filename(dir->utf8_path, utf8_name, NULL);
+			child->locale_path = g_build_filename(dir->locale_path, locale_name, NULL);
+			push_dir(worker, child);
+			found = 1;
+		}
+	}
+	else if (patterns_match(crawler->patterns, utf8_name) &&
+		!patterns_match(crawler->ignored_file_patterns, utf8_name))
+	{
+		add_result(worker, dir->root_index, g_build_filename(dir->utf8_path, utf8_name, NULL));
+		found = 1;
+	}
+
+	g_free(utf8_name);
+
+	return found;
+}
+
+
+#ifdef G_OS_WIN32
+
+static guint read_dir(CrawlWorker *worker, CrawlDir *dir)
+{
+	GDir *d = g_dir_open(dir->locale_path, 0, NULL);
+	const gchar *locale_name;
+	guint found = 0;
+
+	if (!d)
+		return 0;
+
+	while ((locale_name = g_dir_read_name(d)) && !g_atomic_int_get(&worker->crawler->cancelled))
+	{
+		gchar *locale_filename = g_build_filename(dir->locale_path, locale_name, NULL);
+		gboolean is_dir = g_file_test(locale_filename, G_FILE_TEST_IS_DIR);
+		gboolean is_regular = !is_dir && g_file_test(locale_filename, G_FILE_TEST_IS_REGULAR);
+
+		found += process_entry(worker, dir, locale_name, is_dir, is_regular);
+		g_free(locale_filename);
+	}
+
+	g_dir_close(d);
+
+	return found;
+}
+
+#else
+
+static void get_entry_type(CrawlDir *dir, struct dirent *entry, gboolean *is_dir, gboolean *is_regular)
+{
+	gchar *locale_filename;
+	GStatBuf s;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+	/* avoid stat() unless we get a symlink or the filesystem doesn't
+	 * provide the type */
+	if (entry->d_type == DT_DIR || entry->d_type == DT_REG)
+	{
+		*is_dir = entry->d_type == DT_DIR;
+		*is_regular = entry->d_type == DT_REG;
+		return;
+	}
+	else if (entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
+	{
+		*is_dir = *is_regular = FALSE;
+		return;
+	}
+#endif
+
+	/* follow symlinks like g_file_test() */
+	locale_filename = g_build_filename(dir->locale_path, entry->d_name, NULL);
+	if (g_stat(locale_filename, &s) == 0)
+	{
+		*is_dir = S_ISDIR(s.st_mode);
+		*is_regular = S_ISREG(s.st_mode);
+	}
+	else
+		*is_dir = *is_regular = FALSE;
+	g_free(locale_filename);
+}
+
+
+static guint read_dir(CrawlWorker *worker, CrawlDir *dir)
+{
+	DIR *d = opendir(dir->locale_path);
+	struct dirent *entry;
+	guint found = 0;
+
+	if (!d)
+		return 0;
+
+	while ((entry = readdir(d)) && !g_atomic_int_get(&worker->crawler->cancelled))
+	{
+		gboolean is_dir, is_regular;
+
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+
+		get_entry_type(dir, entry, &is_dir, &is_regular);
+		found += process_entry(worker, dir, entry->d_name, is_dir, is_regular);
+	}
+
+	closedir(d);
+
+	return found;
+}
+
+#endif
+
+
+static void scan_dir(CrawlWorker *worker, CrawlDir *dir)
+{
+	PrjOrgCrawler *crawler = worker->crawler;
+	gchar *real_path = utils_get_real_path(dir->locale_path);
+	gboolean visited = TRUE;
+	guint found = 0;
+
+	/* avoid infinite loops caused by symlinks */
+	if (real_path)
+	{
+		g_mutex_lock(&crawler->lock);
+		visited = g_hash_table_contains(crawler->visited_paths, real_path);
+		if (!visited)
+			g_hash_table_add(crawler->visited_paths, real_path);
+		g_mutex_unlock(&crawler->lock);
+
+		if (visited)
+			g_free(real_path);
+	}
+
+	if (!visited)
+	{
+		found = read_dir(worker, dir);
+		add_scanned_dir(worker, dir->root_index, dir->utf8_path);
+	}
+
+	/* The directory is shown in the sidebar only when it contains no files
+	 * and no subdirectories - otherwise these determine its existence. */
+	if (found == 0 && !dir->is_root && crawler->show_empty_dirs)
+		add_result(worker, dir->root_index,
+			g_build_path(G_DIR_SEPARATOR_S, dir->utf8_path, PROJORG_DIR_ENTRY, NULL));
+}
+
+
+static gpointer worker_thread(gpointer data)
+{
+	CrawlWorker *worker = data;
+	PrjOrgCrawler *crawler = worker->crawler;
+
+	while (!g_atomic_int_get(&crawler->cancelled))
+	{
+		CrawlDir *dir = take_dir(worker);
+
+		if (!dir)
+		{
+			gint64 end_time;
+
+			if (g_atomic_int_get(&crawler->pending_dirs) == 0)
+				break;  /* all done */
+
+			/* other workers are still scanning and may produce more work */
+			g_mutex_lock(&crawler->lock);
+			end_time = g_get_monotonic_time() + 10 * G_TIME_SPAN_MILLISECOND;
+			g_cond_wait_until(&crawler->cond, &crawler->lock, end_time);
+			g_mutex_unlock(&crawler->lock);
+			continue;
+		}
+
+		scan_dir(worker, dir);
+		crawl_dir_free(dir);
+
+		if (g_atomic_int_dec_and_test(&crawler->pending_dirs))
+		{
+			g_mutex_lock(&crawler->lock);
+			g_cond_broadcast(&crawler->cond);
+			g_mutex_unlock(&crawler->lock);
+		}
+	}
+
+	flush_batch(worker);
+	g_atomic_int_inc(&crawler->finished_workers);
+
+	return NULL;
+}
+
+
+static void crawler_free(PrjOrgCrawler *crawler)
+{
+	CrawlBatch *batch;
+	guint i;
+
+	g_atomic_int_set(&crawler->cancelled, TRUE);
+
+	g_mutex_lock(&crawler->lock);
+	g_cond_broadcast(&crawler->cond);
+	g_mutex_unlock(&crawler->lock);
+
+	for (i = 0; i < crawler->workers_num; i++)
+	{
+		CrawlWorker *worker = &crawler->workers[i];
+
+		if (worker->thread)
+			g_thread_join(worker->thread);
+		g_queue_foreach(&worker->dirs, (GFunc) crawl_dir_free, NULL);
+		g_queue_clear(&worker->dirs);
+		g_mutex_clear(&worker->lock);
+	}
+	g_free(crawler->workers);
+
+	if (crawler->dispatch_source != 0)
+		g_source_remove(crawler->dispatch_source);
+
+	while ((batch = g_async_queue_try_pop(crawler->batches)))
+		crawl_batch_free(batch);
+	g_async_queue_unref(crawler->batches);
+
+	g_hash_table_destroy(crawler->visited_paths);
+	g_mutex_clear(&crawler->lock);
+	g_cond_clear(&crawler->cond);
+
+	free_patterns(crawler->patterns);
+	free_patterns(crawler->ignored_dirs_patterns);
+	free_patterns(crawler->ignored_file_patterns);
+
+	g_free(crawler);
+}
+
+
+static gboolean dispatch_batches(gpointer user_data)
+{
+	PrjOrgCrawler *crawler = user_data;
+	CrawlBatch *batch;
+	gboolean finished;
+
+	/* check before taking batches so we don't miss the last ones */
+	finished = g_atomic_int_get(&crawler->finished_workers) == (gint)crawler->workers_num;
+
+	while ((batch = g_async_queue_try_pop(crawler->batches)))
+	{
+		crawler->batch_cb(batch->root_index, batch->utf8_paths, batch->utf8_dirs, crawler->user_data);
+		crawl_batch_free(batch);
+	}
+
+	if (!finished)
+		return G_SOURCE_CONTINUE;
+
+	crawler->dispatch_source = 0;
+	crawler->done_cb(crawler->user_data);
+	crawler_free(crawler);
+
+	return G_SOURCE_REMOVE;
+}
+
+
+PrjOrgCrawler *prjorg_crawler_start(gchar **utf8_base_dirs, GSList *patterns,
+	GSList *ignored_dirs_patterns, GSList *ignored_file_patterns, gboolean show_empty_dirs,
+	PrjOrgCrawlerBatchFunc batch_cb, PrjOrgCrawlerDoneFunc done_cb, gpointer user_data)
+{
+	PrjOrgCrawler *crawler = g_new0(PrjOrgCrawler, 1);
+	guint i;
+
+	crawler->patterns = patterns;
+	crawler->ignored_dirs_patterns = ignored_dirs_patterns;
+	crawler->ignored_file_patterns = ignored_file_patterns;
+	crawler->show_empty_dirs = show_empty_dirs;
+	crawler->batch_cb = batch_cb;
+	crawler->done_cb = done_cb;
+	crawler->user_data = user_data;
+
+	g_mutex_init(&crawler->lock);
+	g_cond_init(&crawler->cond);
+	crawler->visited_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	crawler->batches = g_async_queue_new();
+
+	crawler->workers_num = CLAMP(g_get_num_processors(), 1, MAX_WORKERS);
+	crawler->workers = g_new0(CrawlWorker, crawler->workers_num);
+	for (i = 0; i < crawler->workers_num; i++)
+	{
+		crawler->workers[i].crawler = crawler;
+		g_mutex_init(&crawler->workers[i].lock);
+		g_queue_init(&crawler->workers[i].dirs);
+	}
+
+	for (i = 0; utf8_base_dirs[i] != NULL; i++)
+	{
+		CrawlDir *dir = g_new0(CrawlDir, 1);
+
+		dir->root_index = i;
+		dir->is_root = TRUE;
+		dir->utf8_path = g_strdup(utf8_base_dirs[i]);
+		dir->locale_path = utils_get_locale_from_utf8(utf8_base_dirs[i]);
+		push_dir(&crawler->workers[i % crawler->workers_num], dir);
+	}
+
+	for (i = 0; i < crawler->workers_num; i++)
+		crawler->workers[i].thread = g_thread_new("prjorg-crawler", worker_thread, &crawler->workers[i]);
+
+	crawler->dispatch_source = plugin_timeout_add(geany_plugin, DISPATCH_INTERVAL,
+		dispatch_batches, crawler);
+
+	return crawler;
+}
+
+
+void prjorg_crawler_cancel(PrjOrgCrawler *crawler)
+{
+	if (crawler)
+		crawler_free(crawler);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2026 The Geany contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PRJORG_CRAWLER_H__
+#define __PRJORG_CRAWLER_H__
+
+#include <glib.h>
+
+typedef struct PrjOrgCrawler PrjOrgCrawler;
+
+/* utf8_paths contains the found files (and PROJORG_DIR_ENTRY entries for
+ * empty directories) of the root with the given index, utf8_dirs the scanned
+ * directories; the arrays are owned by the crawler */
+typedef void (*PrjOrgCrawlerBatchFunc)(guint root_index, GPtrArray *utf8_paths, GPtrArray *utf8_dirs,
+	gpointer user_data);
+typedef void (*PrjOrgCrawlerDoneFunc)(gpointer user_data);
+
+/* Scans utf8_base_dirs in background threads. The pattern lists are owned by
+ * the crawler afterwards. Callbacks are invoked from the main loop; the
+ * crawler frees itself after done_cb returns. */
+PrjOrgCrawler *prjorg_crawler_start(gchar **utf8_base_dirs, GSList *patterns,
+	GSList *ignored_dirs_patterns, GSList *ignored_file_patterns, gboolean show_empty_dirs,
+	PrjOrgCrawlerBatchFunc batch_cb, PrjOrgCrawlerDoneFunc done_cb, gpointer user_data);
+
+/* Stops the scan and frees the crawler; no callbacks are invoked afterwards */
+void prjorg_crawler_cancel(PrjOrgCrawler *crawler);
+
+#endif
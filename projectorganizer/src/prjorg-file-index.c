@@ -0,0 +1,573 @@
+/*
+ * Copyright 2026 The Geany contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Fuzzy file name index used by "Go to file". The index is owned by a worker
+ * thread which applies additions, removals and queries in the order they were
+ * submitted. Every entry stores the case-folded path relative to the base
+ * directory together with a bitmask of the characters it contains so most
+ * entries are rejected without looking at the path at all. The remaining ones
+ * are matched as subsequences of the query words and scored similarly to fzf:
+ * matches at word boundaries, consecutive matches and matches in the file name
+ * are preferred.
+ */
+
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
+#include <geanyplugin.h>
+
+#include "prjorg-file-index.h"
+
+extern GeanyPlugin *geany_plugin;
+
+/* how often results are checked for while a query is running (ms) */
+#define POLL_INTERVAL 10
+/* how often a running query checks whether it was superseded (entries) */
+#define CANCEL_CHECK_INTERVAL 4096
+
+#define SCORE_MATCH 16
+#define BONUS_BOUNDARY 8
+#define BONUS_CONSECUTIVE 4
+#define BONUS_NAME 8
+#define MAX_GAP_PENALTY 32
+
+typedef enum
+{
+	CMD_ADD,
+	CMD_REMOVE,
+	CMD_QUERY,
+	CMD_QUIT
+} CommandType;
+
+typedef struct
+{
+	CommandType type;
+	GPtrArray *utf8_paths;
+	gchar *query;
+	guint max_results;
+	guint serial;
+} Command;
+
+typedef struct
+{
+	gchar *utf8_path;  /* NULL for removed entries */
+	gchar *folded_path;  /* relative to the base dir */
+	guint64 mask;
+	gsize len;
+	gsize name_offset;
+} FileEntry;
+
+typedef struct
+{
+	gchar *folded;
+	gsize len;
+	guint64 mask;
+} QueryWord;
+
+typedef struct
+{
+	const FileEntry *entry;
+	gint score;
+} Match;
+
+typedef struct
+{
+	gchar *query;
+	GPtrArray *utf8_paths;
+	guint serial;
+} QueryResult;
+
+struct PrjOrgFileIndex
+{
+	gchar *utf8_base_dir;
+
+	GThread *thread;
+	GAsyncQueue *commands;  /* of Command */
+	GAsyncQueue *results;  /* of QueryResult */
+
+	/* owned by the worker thread */
+	GArray *entries;  /* of FileEntry */
+	GHashTable *entry_ids;  /* utf8 path -> index into entries + 1 */
+	guint removed_num;
+
+	/* serial of the last submitted query */
+	volatile gint query_serial;
+	guint poll_source;
+	PrjOrgFileIndexQueryFunc query_cb;
+	gpointer query_data;
+};
+
+
+static void command_free(Command *cmd)
+{
+	if (cmd->utf8_paths)
+		g_ptr_array_free(cmd->utf8_paths, TRUE);
+	g_free(cmd->query);
+	g_free(cmd);
+}
+
+
+static void query_result_free(QueryResult *result)
+{
+	g_free(result->query);
+	g_ptr_array_free(result->utf8_paths, TRUE);
+	g_free(result);
+}
+
+
+static gchar *fold_string(const gchar *str)
+{
+	gchar *normalized = g_utf8_normalize(str, -1, G_NORMALIZE_ALL);
+	gchar *folded;
+
+	if (!normalized)
+		return g_strdup(str);
+
+	folded = g_utf8_casefold(normalized, -1);
+	g_free(normalized);
+
+	return folded;
+}
+
+
+static guint64 get_char_mask(const gchar *str, gsize len)
+{
+	guint64 mask = 0;
+	gsize i;
+
+	for (i = 0; i < len; i++)
+	{
+		guchar c = str[i];
+
+		if (c >= 'a' && c <= 'z')
+			mask |= G_GUINT64_CONSTANT(1) << (c - 'a');
+		else if (c >= '0' && c <= '9')
+			mask |= G_GUINT64_CONSTANT(1) << (26 + c - '0');
+		else if (c < 0x80)
+			mask |= G_GUINT64_CONSTANT(1) << (36 + c % 27);
+		else
+			mask |= G_GUINT64_CONSTANT(1) << 63;
+	}
+
+	return mask;
+}
+
+
+static gboolean is_boundary(gchar c)
+{
+	return c == G_DIR_SEPARATOR || c == '/' || c == '_' || c == '-' || c == '.' || c == ' ';
+}
+
+
+/* scores the shortest occurrence of word as a subsequence of str[from..] */
+static gint score_word_from(const FileEntry *entry, gsize from, const QueryWord *word)
+{
+	const gchar *str = entry->folded_path;
+	gsize i, j, start, end;
+	gint score = 0;
+	gint consecutive = 0;
+	gsize last = 0;
+
+	for (i = from, j = 0; i < entry->len && j < word->len; i++)
+	{
+		if (str[i] == word->folded[j])
+			j++;
+	}
+	if (j < word->len)
+		return -1;
+	end = i;
+
+	/* search backwards for the shortest match ending at the same position */
+	for (i = end, j = word->len; j > 0; )
+	{
+		i--;
+		if (str[i] == word->folded[j - 1])
+			j--;
+	}
+	start = i;
+
+	for (i = start, j = 0; i < end && j < word->len; i++)
+	{
+		if (str[i] != word->folded[j])
+		{
+			consecutive = 0;
+			continue;
+		}
+
+		score += SCORE_MATCH;
+		if (i == 0 || is_boundary(str[i - 1]))
+			score += BONUS_BOUNDARY;
+		if (j > 0 && i == last + 1)
+			score += ++consecutive * BONUS_CONSECUTIVE;
+		if (i >= entry->name_offset)
+			score += BONUS_NAME;
+		last = i;
+		j++;
+	}
+
+	return score - (gint)MIN(end - start - word->len, MAX_GAP_PENALTY);
+}
+
+
+static gint score_entry(const FileEntry *entry, QueryWord *words, guint words_num)
+{
+	gint total = 0;
+	guint i;
+
+	for (i = 0; i < words_num; i++)
+	{
+		gint score, name_score;
+
+		if ((words[i].mask & entry->mask) != words[i].mask)
+			return -1;
+
+		score = score_word_from(entry, 0, &words[i]);
+		if (score < 0)
+			return -1;
+
+		/* the first occurrence may be in the directory part while a better
+		 * one exists in the file name */
+		name_score = score_word_from(entry, entry->name_offset, &words[i]);
+		total += MAX(score, name_score);
+	}
+
+	return total;
+}
+
+
+static gint match_cmp(const Match *a, const Match *b)
+{
+	if (a->score != b->score)
+		return b->score - a->score;
+	if (a->entry->len != b->entry->len)
+		return a->entry->len < b->entry->len ? -1 : 1;
+	return strcmp(a->entry->folded_path, b->entry->folded_path);
+}
+
+
+static void add_match(GArray *matches, guint max_results, const FileEntry *entry, gint score)
+{
+	Match match = {entry, score};
+	guint i;
+
+	if (matches->len == max_results &&
+		match_cmp(&match, &g_array_index(matches, Match, matches->len - 1)) >= 0)
+	{
+		return;
+	}
+
+	/* keep the matches sorted, max_results is small */
+	for (i = matches->len; i > 0; i--)
+	{
+		if (match_cmp(&match, &g_array_index(matches, Match, i - 1)) >= 0)
+			break;
+	}
+	g_array_insert_val(matches, i, match);
+	if (matches->len > max_results)
+		g_array_set_size(matches, max_results);
+}
+
+
+static void run_query(PrjOrgFileIndex *index, Command *cmd)
+{
+	GArray *matches = g_array_new(FALSE, FALSE, sizeof(Match));
+	GArray *words = g_array_new(FALSE, FALSE, sizeof(QueryWord));
+	gchar *folded_query = fold_string(cmd->query);
+	gchar **word_strv = g_strsplit_set(folded_query, " ", -1);
+	gboolean cancelled = FALSE;
+	QueryResult *result;
+	gchar **val;
+	guint i;
+
+	foreach_strv(val, word_strv)
+	{
+		QueryWord word = {*val, strlen(*val), 0};
+
+		if (word.len == 0)
+			continue;
+		word.mask = get_char_mask(word.folded, word.len);
+		g_array_append_val(words, word);
+	}
+
+	for (i = 0; i < index->entries->len; i++)
+	{
+		const FileEntry *entry = &g_array_index(index->entries, FileEntry, i);
+		gint score;
+
+		if (i % CANCEL_CHECK_INTERVAL == 0 &&
+			(guint)g_atomic_int_get(&index->query_serial) != cmd->serial)
+		{
+			cancelled = TRUE;
+			break;
+		}
+
+		if (!entry->utf8_path)
+			continue;
+
+		score = score_entry(entry, (QueryWord *)words->data, words->len);
+		if (score >= 0)
+			add_match(matches, cmd->max_results, entry, score);
+
+		/* without a query any files will do */
+		if (words->len == 0 && matches->len == cmd->max_results)
+			break;
+	}
+
+	if (!cancelled)
+	{
+		result = g_new0(QueryResult, 1);
+		result->query = g_strdup(cmd->query);
+		result->serial = cmd->serial;
+		result->utf8_paths = g_ptr_array_new_with_free_func(g_free);
+		for (i = 0; i < matches->len; i++)
+		{
+			const FileEntry *entry = g_array_index(matches, Match, i).entry;
+			g_ptr_array_add(result->utf8_paths, g_strdup(entry->utf8_path));
+		}
+		g_async_queue_push(index->results, result);
+	}
+
+	g_array_free(words, TRUE);
+	g_array_free(matches, TRUE);
+	g_strfreev(word_strv);
+	g_free(folded_query);
+}
+
+
+static void add_entry(PrjOrgFileIndex *index, const gchar *utf8_path)
+{
+	gsize base_len = strlen(index->utf8_base_dir);
+	const gchar *rel_path = utf8_path;
+	const gchar *name;
+	FileEntry entry;
+
+	if (g_hash_table_contains(index->entry_ids, utf8_path))
+		return;
+
+	if (strncmp(utf8_path, index->utf8_base_dir, base_len) == 0 &&
+		utf8_path[base_len] == G_DIR_SEPARATOR)
+	{
+		rel_path = utf8_path + base_len + 1;
+	}
+
+	entry.utf8_path = g_strdup(utf8_path);
+	entry.folded_path = fold_string(rel_path);
+	entry.len = strlen(entry.folded_path);
+	entry.mask = get_char_mask(entry.folded_path, entry.len);
+	name = strrchr(entry.folded_path, G_DIR_SEPARATOR);
+	entry.name_offset = name ? (gsize)(name - entry.folded_path) + 1 : 0;
+
+	g_array_append_val(index->entries, entry);
+	g_hash_table_insert(index->entry_ids, entry.utf8_path, GUINT_TO_POINTER(index->entries->len));
+}
+
+
+static void compact_entries(PrjOrgFileIndex *index)
+{
+	guint i, j;
+
+	g_hash_table_remove_all(index->entry_ids);
+	for (i = 0, j = 0; i < index->entries->len; i++)
+	{
+		FileEntry *entry = &g_array_index(index->entries, FileEntry, i);
+
+		if (!entry->utf8_path)
+			continue;
+
+		g_array_index(index->entries, FileEntry, j) = *entry;
+		j++;
+		g_hash_table_insert(index->entry_ids, entry->utf8_path, GUINT_TO_POINTER(j));
+	}
+	g_array_set_size(index->entries, j);
+	index->removed_num = 0;
+}
+
+
+static void remove_entry(PrjOrgFileIndex *index, const gchar *utf8_path)
+{
+	guint id = GPOINTER_TO_UINT(g_hash_table_lookup(index->entry_ids, utf8_path));
+	FileEntry *entry;
+
+	if (id == 0)
+		return;
+
+	entry = &g_array_index(index->entries, FileEntry, id - 1);
+	g_hash_table_remove(index->entry_ids, utf8_path);
+	g_free(entry->utf8_path);
+	g_free(entry->folded_path);
+	entry->utf8_path = NULL;
+	entry->folded_path = NULL;
+	index->removed_num++;
+
+	if (index->removed_num > index->entries->len / 2)
+		compact_entries(index);
+}
+
+
+static gpointer worker_thread(gpointer data)
+{
+	PrjOrgFileIndex *index = data;
+
+	while (TRUE)
+	{
+		Command *cmd = g_async_queue_pop(index->commands);
+		guint i;
+
+		switch (cmd->type)
+		{
+			case CMD_ADD:
+				for (i = 0; i < cmd->utf8_paths->len; i++)
+					add_entry(index, cmd->utf8_paths->pdata[i]);
+				break;
+			case CMD_REMOVE:
+				for (i = 0; i < cmd->utf8_paths->len; i++)
+					remove_entry(index, cmd->utf8_paths->pdata[i]);
+				break;
+			case CMD_QUERY:
+				/* skip queries superseded while waiting in the queue */
+				if ((guint)g_atomic_int_get(&index->query_serial) == cmd->serial)
+					run_query(index, cmd);
+				break;
+			case CMD_QUIT:
+				command_free(cmd);
+				return NULL;
+		}
+
+		command_free(cmd);
+	}
+
+	return NULL;
+}
+
+
+static gboolean poll_results(gpointer user_data)
+{
+	PrjOrgFileIndex *index = user_data;
+	QueryResult *result;
+
+	while ((result = g_async_queue_try_pop(index->results)))
+	{
+		if (result->serial == (guint)g_atomic_int_get(&index->query_serial))
+		{
+			index->poll_source = 0;
+			index->query_cb(result->query, result->utf8_paths, index->query_data);
+			query_result_free(result);
+			return G_SOURCE_REMOVE;
+		}
+		query_result_free(result);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+
+static void push_command(PrjOrgFileIndex *index, CommandType type, GPtrArray *utf8_paths)
+{
+	Command *cmd = g_new0(Command, 1);
+	guint i;
+
+	cmd->type = type;
+	if (utf8_paths)
+	{
+		cmd->utf8_paths = g_ptr_array_new_full(utf8_paths->len, g_free);
+		for (i = 0; i < utf8_paths->len; i++)
+			g_ptr_array_add(cmd->utf8_paths, g_strdup(utf8_paths->pdata[i]));
+	}
+	g_async_queue_push(index->commands, cmd);
+}
+
+
+PrjOrgFileIndex *prjorg_file_index_new(const gchar *utf8_base_dir)
+{
+	PrjOrgFileIndex *index = g_new0(PrjOrgFileIndex, 1);
+
+	index->utf8_base_dir = g_strdup(utf8_base_dir);
+	index->commands = g_async_queue_new_full((GDestroyNotify)command_free);
+	index->results = g_async_queue_new_full((GDestroyNotify)query_result_free);
+	index->entries = g_array_new(FALSE, FALSE, sizeof(FileEntry));
+	index->entry_ids = g_hash_table_new(g_str_hash, g_str_equal);
+	index->thread = g_thread_new("prjorg-file-index", worker_thread, index);
+
+	return index;
+}
+
+
+void prjorg_file_index_free(PrjOrgFileIndex *index)
+{
+	guint i;
+
+	if (!index)
+		return;
+
+	/* make the running query stop */
+	g_atomic_int_inc(&index->query_serial);
+	push_command(index, CMD_QUIT, NULL);
+	g_thread_join(index->thread);
+
+	if (index->poll_source != 0)
+		g_source_remove(index->poll_source);
+
+	for (i = 0; i < index->entries->len; i++)
+	{
+		FileEntry *entry = &g_array_index(index->entries, FileEntry, i);
+		g_free(entry->utf8_path);
+		g_free(entry->folded_path);
+	}
+	g_array_free(index->entries, TRUE);
+	g_hash_table_destroy(index->entry_ids);
+	g_async_queue_unref(index->commands);
+	g_async_queue_unref(index->results);
+	g_free(index->utf8_base_dir);
+	g_free(index);
+}
+
+
+void prjorg_file_index_add(PrjOrgFileIndex *index, GPtrArray *utf8_paths)
+{
+	if (utf8_paths->len > 0)
+		push_command(index, CMD_ADD, utf8_paths);
+}
+
+
+void prjorg_file_index_remove(PrjOrgFileIndex *index, GPtrArray *utf8_paths)
+{
+	if (utf8_paths->len > 0)
+		push_command(index, CMD_REMOVE, utf8_paths);
+}
+
+
+void prjorg_file_index_query(PrjOrgFileIndex *index, const gchar *query, guint max_results,
+	PrjOrgFileIndexQueryFunc cb, gpointer user_data)
+{
+	Command *cmd = g_new0(Command, 1);
+
+	cmd->type = CMD_QUERY;
+	cmd->query = g_strdup(query);
+	cmd->max_results = MAX(max_results, 1);
+	cmd->serial = (guint)g_atomic_int_add(&index->query_serial, 1) + 1;
+
+	index->query_cb = cb;
+	index->query_data = user_data;
+	g_async_queue_push(index->commands, cmd);
+
+	if (index->poll_source == 0)
+		index->poll_source = plugin_timeout_add(geany_plugin, POLL_INTERVAL, poll_results, index);
+}
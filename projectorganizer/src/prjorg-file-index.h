@@ -0,0 +1,42 @@
+/*
+ * Copyright 2026 The Geany contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PRJORG_FILE_INDEX_H__
+#define __PRJORG_FILE_INDEX_H__
+
+#include <glib.h>
+
+typedef struct PrjOrgFileIndex PrjOrgFileIndex;
+
+/* utf8_paths contains the best matching files, best first; the array is owned
+ * by the index */
+typedef void (*PrjOrgFileIndexQueryFunc)(const gchar *query, GPtrArray *utf8_paths,
+	gpointer user_data);
+
+PrjOrgFileIndex *prjorg_file_index_new(const gchar *utf8_base_dir);
+void prjorg_file_index_free(PrjOrgFileIndex *index);
+
+void prjorg_file_index_add(PrjOrgFileIndex *index, GPtrArray *utf8_paths);
+void prjorg_file_index_remove(PrjOrgFileIndex *index, GPtrArray *utf8_paths);
+
+/* Searches the index in the background; the callback is invoked from the main
+ * loop unless the query gets superseded by another one before finishing. */
+void prjorg_file_index_query(PrjOrgFileIndex *index, const gchar *query, guint max_results,
+	PrjOrgFileIndexQueryFunc cb, gpointer user_data);
+
+#endif
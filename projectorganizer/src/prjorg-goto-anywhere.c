@@ -100,10 +100,14 @@ static void goto_line(GeanyDocument *doc, const gchar *line_str)
 }
 
 
-static void goto_file(const gchar *file_str)
+#define MAX_FILE_RESULTS 20
+
+static guint s_file_query_serial;
+
+
+static GPtrArray *get_open_files(const gchar *file_str, GHashTable *files_added)
 {
 	GPtrArray *arr = g_ptr_array_new_full(0, (GDestroyNotify)prjorg_goto_symbol_free);
-	GHashTable *files_added = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 	GPtrArray *filtered;
 	guint i;
 
@@ -124,36 +128,75 @@ static void goto_file(const gchar *file_str)
 		g_hash_table_insert(files_added, g_strdup(sym->file_name), GINT_TO_POINTER(1));
 	}
 
-	if (prj_org && prj_org->roots)
+	filtered = prjorg_goto_panel_filter(arr, file_str);
+	/* the filtered array doesn't own the symbols */
+	g_ptr_array_set_free_func(filtered, (GDestroyNotify)prjorg_goto_symbol_free);
+	for (i = 0; i < filtered->len; i++)
+		g_ptr_array_remove_fast(arr, filtered->pdata[i]);
+	g_ptr_array_free(arr, TRUE);
+
+	return filtered;
+}
+
+
+static void on_file_index_query(const gchar *query, GPtrArray *utf8_paths, gpointer user_data)
+{
+	GHashTable *files_added;
+	GPtrArray *arr;
+	guint i;
+
+	/* the panel has been used for another lookup meanwhile */
+	if (GPOINTER_TO_UINT(user_data) != s_file_query_serial)
+		return;
+
+	/* open documents first, then the best matching project files */
+	files_added = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	arr = get_open_files(query, files_added);
+
+	for (i = 0; i < utf8_paths->len && arr->len < MAX_FILE_RESULTS; i++)
 	{
-		PrjOrgRoot *root = prj_org->roots->data;
-		GHashTableIter iter;
-		gpointer key, value;
+		const gchar *utf8_path = utf8_paths->pdata[i];
+		PrjorgGotoSymbol *sym;
 
-		g_hash_table_iter_init(&iter, root->file_table);
-		while (g_hash_table_iter_next(&iter, &key, &value))
-		{
-			if (!g_hash_table_lookup(files_added, key))
-			{
-				PrjorgGotoSymbol *sym;
-				sym = g_new0(PrjorgGotoSymbol, 1);
-				sym->file_name = g_strdup(key);
-				sym->name = g_path_get_basename(key);
-				sym->icon = TM_ICON_NONE;
-				g_ptr_array_add(arr, sym);
-			}
-		}
+		if (g_hash_table_lookup(files_added, utf8_path))
+			continue;
+
+		sym = g_new0(PrjorgGotoSymbol, 1);
+		sym->file_name = g_strdup(utf8_path);
+		sym->name = g_path_get_basename(utf8_path);
+		sym->icon = TM_ICON_NONE;
+		g_ptr_array_add(arr, sym);
 	}
 
-	filtered = prjorg_goto_panel_filter(arr, file_str);
-	prjorg_goto_panel_fill(filtered);
+	prjorg_goto_panel_fill(arr);
 
-	g_ptr_array_free(filtered, TRUE);
 	g_ptr_array_free(arr, TRUE);
 	g_hash_table_destroy(files_added);
 }
 
 
+static void goto_file(const gchar *file_str)
+{
+	PrjOrgFileIndex *file_index = prjorg_project_get_file_index();
+
+	if (file_index)
+	{
+		prjorg_file_index_query(file_index, file_str, MAX_FILE_RESULTS,
+			on_file_index_query, GUINT_TO_POINTER(s_file_query_serial));
+	}
+	else
+	{
+		GHashTable *files_added = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+		GPtrArray *arr = get_open_files(file_str, files_added);
+
+		prjorg_goto_panel_fill(arr);
+
+		g_ptr_array_free(arr, TRUE);
+		g_hash_table_destroy(files_added);
+	}
+}
+
+
 /* symplified hard-coded icons because we don't have access to Geany icon mappings */
 static int get_icon(TMTagType type)
 {
@@ -250,6 +293,9 @@ static void perform_lookup(const gchar *query)
 	GeanyDocument *doc = document_get_current();
 	const gchar *query_str = query ? query : "";
 
+	/* results of running file queries are not wanted any more */
+	s_file_query_serial++;
+
 	if (g_str_has_prefix(query_str, "#"))
 	{
 		if (doc)
@@ -17,6 +17,7 @@
  */
 
 #include <sys/time.h>
+#include <string.h>
 #include <gdk/gdkkeysyms.h>
 #include <glib/gstdio.h>
 
@@ -29,6 +30,9 @@
 #include "prjorg-project.h"
 #include "prjorg-sidebar.h"
 #include "prjorg-wraplabel.h"
+#include "prjorg-crawler.h"
+#include "prjorg-watcher.h"
+#include "prjorg-file-index.h"
 
 extern GeanyPlugin *geany_plugin;
 extern GeanyData *geany_data;
@@ -50,6 +54,22 @@ static PropertyDialogElements *e;
 static GSList *s_idle_add_funcs;
 static GSList *s_idle_remove_funcs;
 
+/* minimum delay between sidebar updates while scanning (ms) */
+#define SIDEBAR_UPDATE_INTERVAL 1000
+
+/* apply more changes reported by the watcher by rescanning the project */
+#define MAX_INCREMENTAL_CHANGES 50000
+
+static PrjOrgCrawler *s_crawler;
+static gchar **s_session_files;
+static guint s_scanned_files_num;
+static gint64 s_last_sidebar_update;
+static gboolean s_tags_generated;
+
+static PrjOrgWatcher *s_watcher;
+static GHashTable *s_pending_changes;  /* reported by the watcher during a scan */
+static PrjOrgFileIndex *s_file_index;  /* files of the project root */
+
 
 static void clear_idle_queue(GSList **queue)
 {
@@ -71,161 +91,163 @@ static void collect_source_files(gchar *filename, TMSourceFile *sf, gpointer use
 }
 
 
-/* path - absolute path in locale, returned list in utf8 */
-static GSList *get_file_list(const gchar *utf8_path, GSList *patterns,
-		GSList *ignored_dirs_patterns, GSList *ignored_file_patterns, GHashTable *visited_paths)
+static void clear_root(PrjOrgRoot *root)
 {
-	GSList *list = NULL;
-	GDir *dir;
-	const gchar *child_name;
-	GSList *child = NULL;
-	GSList *children = NULL;
-	gchar *locale_path = utils_get_locale_from_utf8(utf8_path);
-	gchar *real_path = utils_get_real_path(locale_path);
-
-	dir = g_dir_open(locale_path, 0, NULL);
-	if (!dir || !real_path || g_hash_table_lookup(visited_paths, real_path))
-	{
-		g_free(locale_path);
-		g_free(real_path);
-		if (dir)
-			g_dir_close(dir);
-		return NULL;
-	}
+	GPtrArray *source_files;
 
-	g_hash_table_insert(visited_paths, real_path, GINT_TO_POINTER(1));
+	source_files = g_ptr_array_new();
+	g_hash_table_foreach(root->file_table, (GHFunc)collect_source_files, source_files);
+	tm_workspace_remove_source_files(source_files);
+	g_ptr_array_free(source_files, TRUE);
+	g_hash_table_remove_all(root->file_table);
+}
 
-	while ((child_name = g_dir_read_name(dir)))
-		children = g_slist_prepend(children, g_strdup(child_name));
 
-	g_dir_close(dir);
+typedef struct
+{
+	guint ft_index;
+	GPatternSpec *pattern;
+} FiletypePattern;
 
-	foreach_slist(child, children)
-	{
-		const gchar *locale_name;
-		gchar *locale_filename, *utf8_filename, *utf8_name;
 
-		locale_name = child->data;
+/* Filetype patterns compiled once for all files. Patterns of the form
+ * "*.ext" and patterns without wildcards are looked up in hash tables, the
+ * remaining patterns are matched by compiled GPatternSpecs. Values are
+ * indices into the filetypes array + 1. */
+typedef struct
+{
+	guint signature;
+	GHashTable *extensions;  /* extension -> filetype index */
+	GHashTable *names;  /* base name -> filetype index */
+	GPtrArray *globs;  /* of FiletypePattern, sorted by filetype index */
+	guint hits;
+	guint misses;
+} FiletypeMatcher;
 
-		utf8_name = utils_get_utf8_from_locale(locale_name);
-		locale_filename = g_build_filename(locale_path, locale_name, NULL);
-		utf8_filename = utils_get_utf8_from_locale(locale_filename);
+static FiletypeMatcher *s_ft_matcher;
 
-		if (g_file_test(locale_filename, G_FILE_TEST_IS_DIR))
-		{
-			GSList *lst;
 
-			if (!patterns_match(ignored_dirs_patterns, utf8_name))
-			{
-				lst = get_file_list(utf8_filename, patterns, ignored_dirs_patterns,
-						ignored_file_patterns, visited_paths);
-				if (lst)
-					list = g_slist_concat(list, lst);
-				else if (prj_org->show_empty_dirs)
-					list = g_slist_prepend(list, g_build_path(G_DIR_SEPARATOR_S, utf8_filename, PROJORG_DIR_ENTRY, NULL));
-			}
-		}
-		else if (g_file_test(locale_filename, G_FILE_TEST_IS_REGULAR))
-		{
-			if (patterns_match(patterns, utf8_name) && !patterns_match(ignored_file_patterns, utf8_name))
-				list = g_slist_prepend(list, g_strdup(utf8_filename));
-		}
+static void filetype_pattern_free(FiletypePattern *ft_pattern)
+{
+	g_pattern_spec_free(ft_pattern->pattern);
+	g_free(ft_pattern);
+}
 
-		g_free(utf8_filename);
-		g_free(locale_filename);
-		g_free(utf8_name);
-	}
 
-	g_slist_free_full(children, g_free);
-	g_free(locale_path);
+static void filetype_matcher_free(FiletypeMatcher *matcher)
+{
+	if (!matcher)
+		return;
 
-	return list;
+	g_hash_table_destroy(matcher->extensions);
+	g_hash_table_destroy(matcher->names);
+	g_ptr_array_free(matcher->globs, TRUE);
+	g_free(matcher);
 }
 
 
-static gint prjorg_project_rescan_root(PrjOrgRoot *root)
+/* the first filetype with a matching pattern wins */
+static void insert_min_index(GHashTable *table, const gchar *key, guint ft_index)
 {
-	GPtrArray *source_files;
-	GSList *pattern_list = NULL;
-	GSList *ignored_dirs_list = NULL;
-	GSList *ignored_file_list = NULL;
-	GHashTable *visited_paths;
-	GSList *lst;
-	GSList *elem = NULL;
-	gint filenum = 0;
+	guint val = GPOINTER_TO_UINT(g_hash_table_lookup(table, key));
 
-	source_files = g_ptr_array_new();
-	g_hash_table_foreach(root->file_table, (GHFunc)collect_source_files, source_files);
-	tm_workspace_remove_source_files(source_files);
-	g_ptr_array_free(source_files, TRUE);
-	g_hash_table_remove_all(root->file_table);
+	if (val == 0 || ft_index + 1 < val)
+		g_hash_table_insert(table, g_strdup(key), GUINT_TO_POINTER(ft_index + 1));
+}
 
-	if (!geany_data->app->project->file_patterns || !geany_data->app->project->file_patterns[0])
-	{
-		gchar **all_pattern = g_strsplit ("*", " ", -1);
-		pattern_list = get_precompiled_patterns(all_pattern);
-		g_strfreev(all_pattern);
-	}
-	else
-		pattern_list = get_precompiled_patterns(geany_data->app->project->file_patterns);
 
-	ignored_dirs_list = get_precompiled_patterns(prj_org->ignored_dirs_patterns);
-	ignored_file_list = get_precompiled_patterns(prj_org->ignored_file_patterns);
+static FiletypeMatcher *filetype_matcher_new(guint signature)
+{
+	FiletypeMatcher *matcher = g_new0(FiletypeMatcher, 1);
+	guint i;
 
-	visited_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-	lst = get_file_list(root->base_dir, pattern_list, ignored_dirs_list, ignored_file_list, visited_paths);
-	g_hash_table_destroy(visited_paths);
+	matcher->signature = signature;
+	matcher->extensions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	matcher->names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	matcher->globs = g_ptr_array_new_with_free_func((GDestroyNotify)filetype_pattern_free);
 
-	foreach_slist(elem, lst)
+	for (i = 0; i < geany_data->filetypes_array->len; i++)
 	{
-		char *path = elem->data;
+		GeanyFiletype *ft = filetypes[i];
+		gchar **pattern;
+
+		if (G_UNLIKELY(ft->id == GEANY_FILETYPES_NONE))
+			continue;
 
-		if (path)
+		foreach_strv(pattern, ft->pattern)
 		{
-			g_hash_table_insert(root->file_table, g_strdup(path), NULL);
-			filenum++;
+			const gchar *pat = *pattern;
+
+			if (g_str_has_prefix(pat, "*.") && !strpbrk(pat + 2, "*?"))
+				insert_min_index(matcher->extensions, pat + 2, i);
+			else if (!strpbrk(pat, "*?"))
+				insert_min_index(matcher->names, pat, i);
+			else
+			{
+				FiletypePattern *ft_pattern = g_new0(FiletypePattern, 1);
+
+				ft_pattern->ft_index = i;
+				ft_pattern->pattern = g_pattern_spec_new(pat);
+				g_ptr_array_add(matcher->globs, ft_pattern);
+			}
 		}
 	}
 
-	g_slist_foreach(lst, (GFunc) g_free, NULL);
-	g_slist_free(lst);
+	return matcher;
+}
 
-	g_slist_foreach(pattern_list, (GFunc) g_pattern_spec_free, NULL);
-	g_slist_free(pattern_list);
 
-	g_slist_foreach(ignored_dirs_list, (GFunc) g_pattern_spec_free, NULL);
-	g_slist_free(ignored_dirs_list);
+/* rebuilds the matcher only when the filetype definitions change */
+static void update_filetype_matcher(void)
+{
+	guint signature = get_filetypes_signature();
 
-	g_slist_foreach(ignored_file_list, (GFunc) g_pattern_spec_free, NULL);
-	g_slist_free(ignored_file_list);
+	if (s_ft_matcher && s_ft_matcher->signature == signature)
+		return;
 
-	return filenum;
+	filetype_matcher_free(s_ft_matcher);
+	s_ft_matcher = filetype_matcher_new(signature);
 }
 
 
-static gboolean match_basename(gconstpointer pft, gconstpointer user_data)
+static GeanyFiletype *filetype_matcher_match(FiletypeMatcher *matcher, const gchar *utf8_base_filename)
 {
-	const GeanyFiletype *ft = pft;
-	const gchar *utf8_base_filename = user_data;
-	gint j;
-	gboolean ret = FALSE;
+	guint best = GPOINTER_TO_UINT(g_hash_table_lookup(matcher->names, utf8_base_filename));
+	const gchar *dot;
+	guint i;
 
-	if (G_UNLIKELY(ft->id == GEANY_FILETYPES_NONE))
-		return FALSE;
+	/* try all suffixes so extensions like "tar.gz" are found too */
+	for (dot = strchr(utf8_base_filename, '.'); dot; dot = strchr(dot + 1, '.'))
+	{
+		guint val = GPOINTER_TO_UINT(g_hash_table_lookup(matcher->extensions, dot + 1));
+
+		if (val != 0 && (best == 0 || val < best))
+			best = val;
+	}
 
-	for (j = 0; ft->pattern[j] != NULL; j++)
+	/* only filetypes before the one already found can still win */
+	for (i = 0; i < matcher->globs->len; i++)
 	{
-		GPatternSpec *pattern = g_pattern_spec_new(ft->pattern[j]);
+		FiletypePattern *ft_pattern = matcher->globs->pdata[i];
 
-		if (g_pattern_spec_match_string(pattern, utf8_base_filename))
+		if (best != 0 && ft_pattern->ft_index + 1 >= best)
+			break;
+
+		if (g_pattern_spec_match_string(ft_pattern->pattern, utf8_base_filename))
 		{
-			ret = TRUE;
-			g_pattern_spec_free(pattern);
+			best = ft_pattern->ft_index + 1;
 			break;
 		}
-		g_pattern_spec_free(pattern);
 	}
-	return ret;
+
+	if (best == 0)
+	{
+		matcher->misses++;
+		return NULL;
+	}
+
+	matcher->hits++;
+	return filetypes[best - 1];
 }
 
 
@@ -233,18 +255,14 @@ static gboolean match_basename(gconstpointer pft, gconstpointer user_data)
  * first looks at shebang inside the file and then, if it fails, checks the
  * file extension. Opening every file is too expensive so instead check just
  * extension and only if this fails, look at the shebang */
-static GeanyFiletype *filetypes_detect(const gchar *utf8_filename)
+static GeanyFiletype *filetypes_detect(const gchar *utf8_filename, GStatBuf *s)
 {
-	GStatBuf s;
 	GeanyFiletype *ft = NULL;
-	gchar *locale_filename;
 
-	locale_filename = utils_get_locale_from_utf8(utf8_filename);
-	if (g_stat(locale_filename, &s) != 0 || s.st_size > 10*1024*1024)
+	if (s->st_size > 10*1024*1024)
 		ft = filetypes[GEANY_FILETYPES_NONE];
 	else
 	{
-		guint i;
 		gchar *utf8_base_filename;
 
 		/* to match against the basename of the file (because of Makefile*) */
@@ -254,23 +272,28 @@ static GeanyFiletype *filetypes_detect(const gchar *utf8_filename)
 		SETPTR(utf8_base_filename, g_utf8_strdown(utf8_base_filename, -1));
 #endif
 
-		for (i = 0; i < geany_data->filetypes_array->len; i++)
-		{
-			GeanyFiletype *ftype = filetypes[i];
-
-			if (match_basename(ftype, utf8_base_filename))
-			{
-				ft = ftype;
-				break;
-			}
-		}
-
+		ft = filetype_matcher_match(s_ft_matcher, utf8_base_filename);
 		if (ft == NULL)
 			ft = filetypes_detect_from_file(utf8_filename);
 
 		g_free(utf8_base_filename);
 	}
 
+	return ft;
+}
+
+
+static GeanyFiletype *filetypes_detect_path(const gchar *utf8_filename)
+{
+	gchar *locale_filename = utils_get_locale_from_utf8(utf8_filename);
+	GeanyFiletype *ft;
+	GStatBuf s;
+
+	if (g_stat(locale_filename, &s) != 0)
+		ft = filetypes[GEANY_FILETYPES_NONE];
+	else
+		ft = filetypes_detect(utf8_filename, &s);
+
 	g_free(locale_filename);
 
 	return ft;
@@ -298,7 +321,7 @@ static void regenerate_tags(PrjOrgRoot *root, gpointer user_data)
 		gboolean will_open = session_files && g_strv_contains(session_files, utf8_path);
 
 		if (g_strcmp0(PROJORG_DIR_ENTRY, basename) != 0)
-			sf = tm_source_file_new(locale_path, filetypes_detect(utf8_path)->name);
+			sf = tm_source_file_new(locale_path, filetypes_detect_path(utf8_path)->name);
 		if (sf && !will_open && !document_find_by_filename(utf8_path))
 			g_ptr_array_add(source_files, sf);
 
@@ -314,22 +337,530 @@ static void regenerate_tags(PrjOrgRoot *root, gpointer user_data)
 }
 
 
+static void add_to_file_index(GPtrArray *utf8_paths)
+{
+	GPtrArray *files = g_ptr_array_sized_new(utf8_paths->len);
+	guint i;
+
+	for (i = 0; i < utf8_paths->len; i++)
+	{
+		const gchar *utf8_path = utf8_paths->pdata[i];
+
+		if (!g_str_has_suffix(utf8_path, G_DIR_SEPARATOR_S PROJORG_DIR_ENTRY))
+			g_ptr_array_add(files, (gpointer)utf8_path);
+	}
+	prjorg_file_index_add(s_file_index, files);
+
+	g_ptr_array_free(files, TRUE);
+}
+
+
+static void on_crawler_batch(guint root_index, GPtrArray *utf8_paths, GPtrArray *utf8_dirs,
+	gpointer user_data)
+{
+	PrjOrgRoot *root = g_slist_nth_data(prj_org->roots, root_index);
+	gint64 now = g_get_monotonic_time();
+	guint i;
+
+	if (!root)
+		return;
+
+	for (i = 0; i < utf8_paths->len; i++)
+		g_hash_table_insert(root->file_table, g_strdup(utf8_paths->pdata[i]), NULL);
+	s_scanned_files_num += utf8_paths->len;
+
+	if (root_index == 0)
+		add_to_file_index(utf8_paths);
+
+	for (i = 0; i < utf8_dirs->len; i++)
+		prjorg_watcher_add_dir(s_watcher, utf8_dirs->pdata[i]);
+
+	/* populate the sidebar progressively but don't rebuild it too often */
+	if (now - s_last_sidebar_update > SIDEBAR_UPDATE_INTERVAL * G_TIME_SPAN_MILLISECOND)
+	{
+		s_last_sidebar_update = now;
+		prjorg_sidebar_update(TRUE);
+	}
+}
+
+
+static void on_watcher_changes(GHashTable *utf8_paths, gpointer user_data);
+
+
+static void on_crawler_done(gpointer user_data)
+{
+	gchar **session_files = s_session_files;
+
+	s_crawler = NULL;
+	s_session_files = NULL;
+
+	s_tags_generated = prj_org->generate_tag_prefs == PrjOrgTagYes ||
+		(prj_org->generate_tag_prefs == PrjOrgTagAuto && s_scanned_files_num < 1000);
+
+	if (s_tags_generated)
+	{
+		update_filetype_matcher();
+		s_ft_matcher->hits = s_ft_matcher->misses = 0;
+
+		g_slist_foreach(prj_org->roots, (GFunc)regenerate_tags, session_files);
+
+		g_debug("Filetype patterns matched %u files, %u files left for content detection",
+			s_ft_matcher->hits, s_ft_matcher->misses);
+	}
+
+	/* changes in directories the crawler read before they happened */
+	if (s_pending_changes)
+	{
+		GHashTable *pending_changes = s_pending_changes;
+
+		s_pending_changes = NULL;
+		on_watcher_changes(pending_changes, NULL);
+		g_hash_table_destroy(pending_changes);
+	}
+	else
+		prjorg_sidebar_update(TRUE);
+
+	g_strfreev(session_files);
+}
+
+
+static void cancel_scan(void)
+{
+	prjorg_crawler_cancel(s_crawler);
+	s_crawler = NULL;
+	g_strfreev(s_session_files);
+	s_session_files = NULL;
+	if (s_pending_changes)
+		g_hash_table_destroy(s_pending_changes);
+	s_pending_changes = NULL;
+}
+
+
+PrjOrgFileIndex *prjorg_project_get_file_index(void)
+{
+	return s_file_index;
+}
+
+
+gboolean prjorg_project_is_scanning(void)
+{
+	return s_crawler != NULL;
+}
+
+
+static void get_scan_patterns(GSList **pattern_list, GSList **ignored_dirs_list,
+	GSList **ignored_file_list)
+{
+	if (!geany_data->app->project->file_patterns || !geany_data->app->project->file_patterns[0])
+	{
+		gchar **all_pattern = g_strsplit ("*", " ", -1);
+		*pattern_list = get_precompiled_patterns(all_pattern);
+		g_strfreev(all_pattern);
+	}
+	else
+		*pattern_list = get_precompiled_patterns(geany_data->app->project->file_patterns);
+
+	*ignored_dirs_list = get_precompiled_patterns(prj_org->ignored_dirs_patterns);
+	*ignored_file_list = get_precompiled_patterns(prj_org->ignored_file_patterns);
+}
+
+
+static void free_patterns(GSList *patterns)
+{
+	g_slist_foreach(patterns, (GFunc) g_pattern_spec_free, NULL);
+	g_slist_free(patterns);
+}
+
+
+typedef struct
+{
+	GSList *pattern_list;
+	GSList *ignored_dirs_list;
+	GSList *ignored_file_list;
+	GHashTable *visited_paths;
+	GPtrArray *added_sfs;
+	GPtrArray *added_paths;  /* of the project root, for the file index */
+} ChangesData;
+
+
+static PrjOrgRoot *find_root(const gchar *utf8_path)
+{
+	GSList *elem;
+
+	foreach_slist(elem, prj_org->roots)
+	{
+		PrjOrgRoot *root = elem->data;
+		gsize len = strlen(root->base_dir);
+
+		if (strncmp(utf8_path, root->base_dir, len) == 0 && utf8_path[len] == G_DIR_SEPARATOR)
+			return root;
+	}
+
+	return NULL;
+}
+
+
+static void remove_dir_entry(PrjOrgRoot *root, const gchar *utf8_dir)
+{
+	gchar *dir_entry = g_build_path(G_DIR_SEPARATOR_S, utf8_dir, PROJORG_DIR_ENTRY, NULL);
+
+	g_hash_table_remove(root->file_table, dir_entry);
+	g_free(dir_entry);
+}
+
+
+static void add_file(PrjOrgRoot *root, const gchar *utf8_path, ChangesData *data)
+{
+	TMSourceFile *sf = NULL;
+
+	if (g_hash_table_contains(root->file_table, utf8_path))
+		return;
+
+	if (s_tags_generated)
+	{
+		gchar *locale_path = utils_get_locale_from_utf8(utf8_path);
+		GStatBuf st;
+
+		if (g_stat(locale_path, &st) == 0)
+			sf = tm_source_file_new(locale_path, filetypes_detect(utf8_path, &st)->name);
+		if (sf && !document_find_by_filename(utf8_path))
+			g_ptr_array_add(data->added_sfs, sf);
+		g_free(locale_path);
+	}
+
+	g_hash_table_insert(root->file_table, g_strdup(utf8_path), sf);
+	if (root == prj_org->roots->data)
+		g_ptr_array_add(data->added_paths, g_strdup(utf8_path));
+}
+
+
+/* adds the contents of a newly created directory */
+static void add_dir(PrjOrgRoot *root, const gchar *utf8_dir, ChangesData *data)
+{
+	gchar *locale_dir = utils_get_locale_from_utf8(utf8_dir);
+	gchar *real_path = utils_get_real_path(locale_dir);
+	const gchar *locale_name;
+	gboolean found = FALSE;
+	GDir *dir;
+
+	dir = g_dir_open(locale_dir, 0, NULL);
+	if (!dir || !real_path || g_hash_table_contains(data->visited_paths, real_path))
+	{
+		g_free(real_path);
+		g_free(locale_dir);
+		if (dir)
+			g_dir_close(dir);
+		return;
+	}
+
+	g_hash_table_add(data->visited_paths, real_path);
+	prjorg_watcher_add_dir(s_watcher, utf8_dir);
+
+	while ((locale_name = g_dir_read_name(dir)))
+	{
+		gchar *utf8_name = utils_get_utf8_from_locale(locale_name);
+		gchar *locale_path = g_build_filename(locale_dir, locale_name, NULL);
+		gchar *utf8_path = g_build_filename(utf8_dir, utf8_name, NULL);
+
+		if (g_file_test(locale_path, G_FILE_TEST_IS_DIR))
+		{
+			if (!patterns_match(data->ignored_dirs_list, utf8_name))
+			{
+				add_dir(root, utf8_path, data);
+				found = TRUE;
+			}
+		}
+		else if (g_file_test(locale_path, G_FILE_TEST_IS_REGULAR))
+		{
+			if (patterns_match(data->pattern_list, utf8_name) &&
+				!patterns_match(data->ignored_file_list, utf8_name))
+			{
+				add_file(root, utf8_path, data);
+				found = TRUE;
+			}
+		}
+
+		g_free(utf8_path);
+		g_free(locale_path);
+		g_free(utf8_name);
+	}
+
+	g_dir_close(dir);
+	g_free(locale_dir);
+
+	if (!found && prj_org->show_empty_dirs)
+		g_hash_table_insert(root->file_table,
+			g_build_path(G_DIR_SEPARATOR_S, utf8_dir, PROJORG_DIR_ENTRY, NULL), NULL);
+}
+
+
+static gboolean is_deleted(const gchar *utf8_path, GHashTable *deleted_paths)
+{
+	gchar *path = g_strdup(utf8_path);
+	gboolean deleted = FALSE;
+
+	/* the file itself or any of its parent directories */
+	while (!deleted)
+	{
+		gchar *sep;
+
+		deleted = g_hash_table_contains(deleted_paths, path);
+		sep = strrchr(path, G_DIR_SEPARATOR);
+		if (!sep)
+			break;
+		*sep = '\0';
+	}
+
+	g_free(path);
+	return deleted;
+}
+
+
+static void remove_deleted(PrjOrgRoot *root, GHashTable *deleted_paths)
+{
+	GPtrArray *removed_sfs = g_ptr_array_new();
+	GPtrArray *removed_paths = g_ptr_array_new();
+	GHashTableIter iter;
+	gpointer key, value;
+	guint i;
+
+	g_hash_table_iter_init(&iter, root->file_table);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+	{
+		if (is_deleted(key, deleted_paths))
+		{
+			g_ptr_array_add(removed_paths, key);
+			if (value)
+				g_ptr_array_add(removed_sfs, value);
+		}
+	}
+
+	/* remove from the tag manager before the source files get freed */
+	tm_workspace_remove_source_files(removed_sfs);
+	if (root == prj_org->roots->data)
+		prjorg_file_index_remove(s_file_index, removed_paths);
+	for (i = 0; i < removed_paths->len; i++)
+		g_hash_table_remove(root->file_table, removed_paths->pdata[i]);
+
+	g_ptr_array_free(removed_sfs, TRUE);
+	g_ptr_array_free(removed_paths, TRUE);
+}
+
+
+/* directories whose last file was deleted are shown as empty directories */
+static void add_emptied_dirs(PrjOrgRoot *root, GHashTable *deleted_paths)
+{
+	GHashTable *parent_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	GHashTableIter iter;
+	gpointer key;
+
+	g_hash_table_iter_init(&iter, deleted_paths);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+	{
+		gchar *parent = g_path_get_dirname(key);
+		gchar *locale_parent = utils_get_locale_from_utf8(parent);
+
+		if (find_root(key) == root && g_strcmp0(parent, root->base_dir) != 0 &&
+			g_file_test(locale_parent, G_FILE_TEST_IS_DIR))
+		{
+			g_hash_table_add(parent_dirs, parent);
+		}
+		else
+			g_free(parent);
+		g_free(locale_parent);
+	}
+
+	g_hash_table_iter_init(&iter, root->file_table);
+	while (g_hash_table_size(parent_dirs) > 0 && g_hash_table_iter_next(&iter, &key, NULL))
+	{
+		gchar *parent = g_path_get_dirname(key);
+
+		while (strlen(parent) > strlen(root->base_dir))
+		{
+			g_hash_table_remove(parent_dirs, parent);
+			SETPTR(parent, g_path_get_dirname(parent));
+		}
+		g_free(parent);
+	}
+
+	g_hash_table_iter_init(&iter, parent_dirs);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		g_hash_table_insert(root->file_table,
+			g_build_path(G_DIR_SEPARATOR_S, key, PROJORG_DIR_ENTRY, NULL), NULL);
+
+	g_hash_table_destroy(parent_dirs);
+}
+
+
+/* Applies changes reported by the directory watcher to the file tables and
+ * the tag manager */
+static void on_watcher_changes(GHashTable *utf8_paths, gpointer user_data)
+{
+	GHashTable *deleted_paths;
+	GPtrArray *modified_sfs;
+	GHashTableIter iter;
+	ChangesData data;
+	gpointer key;
+	GSList *elem;
+	guint i;
+
+	if (!prj_org)
+		return;
+
+	/* the crawler may have read the changed directories already, the changes are
+	 * applied once it's done */
+	if (s_crawler)
+	{
+		GHashTableIter iter;
+		gpointer key;
+
+		if (!s_pending_changes)
+			s_pending_changes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+		g_hash_table_iter_init(&iter, utf8_paths);
+		while (g_hash_table_iter_next(&iter, &key, NULL))
+			g_hash_table_add(s_pending_changes, g_strdup(key));
+		return;
+	}
+
+	if (g_hash_table_size(utf8_paths) > MAX_INCREMENTAL_CHANGES)
+	{
+		prjorg_project_rescan();
+		prjorg_sidebar_update(TRUE);
+		return;
+	}
+
+	get_scan_patterns(&data.pattern_list, &data.ignored_dirs_list, &data.ignored_file_list);
+	data.visited_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	data.added_sfs = g_ptr_array_new();
+	data.added_paths = g_ptr_array_new_with_free_func(g_free);
+	deleted_paths = g_hash_table_new(g_str_hash, g_str_equal);
+	modified_sfs = g_ptr_array_new();
+
+	if (s_tags_generated)
+		update_filetype_matcher();
+
+	g_hash_table_iter_init(&iter, utf8_paths);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+	{
+		const gchar *utf8_path = key;
+		PrjOrgRoot *root = find_root(utf8_path);
+		gchar *locale_path, *utf8_name, *utf8_parent;
+		gpointer value;
+
+		if (!root)
+			continue;
+
+		locale_path = utils_get_locale_from_utf8(utf8_path);
+		utf8_name = g_path_get_basename(utf8_path);
+		utf8_parent = g_path_get_dirname(utf8_path);
+
+		if (g_file_test(locale_path, G_FILE_TEST_IS_DIR))
+		{
+			if (!prjorg_watcher_is_watched(s_watcher, utf8_path) &&
+				!patterns_match(data.ignored_dirs_list, utf8_name))
+			{
+				remove_dir_entry(root, utf8_parent);
+				add_dir(root, utf8_path, &data);
+			}
+		}
+		else if (g_file_test(locale_path, G_FILE_TEST_IS_REGULAR))
+		{
+			if (g_hash_table_lookup_extended(root->file_table, utf8_path, NULL, &value))
+			{
+				/* modified file which isn't managed by Geany - reparse */
+				if (value && !document_find_by_filename(utf8_path))
+					g_ptr_array_add(modified_sfs, value);
+			}
+			else if (patterns_match(data.pattern_list, utf8_name) &&
+				!patterns_match(data.ignored_file_list, utf8_name))
+			{
+				remove_dir_entry(root, utf8_parent);
+				add_file(root, utf8_path, &data);
+			}
+		}
+		else
+		{
+			g_hash_table_add(deleted_paths, (gpointer)utf8_path);
+			prjorg_watcher_remove_dir(s_watcher, utf8_path);
+		}
+
+		g_free(utf8_parent);
+		g_free(utf8_name);
+		g_free(locale_path);
+	}
+
+	if (g_hash_table_size(deleted_paths) > 0)
+	{
+		foreach_slist(elem, prj_org->roots)
+		{
+			remove_deleted(elem->data, deleted_paths);
+			if (prj_org->show_empty_dirs)
+				add_emptied_dirs(elem->data, deleted_paths);
+		}
+	}
+
+	/* all the changes are passed to the tag manager at once */
+	tm_workspace_remove_source_files(modified_sfs);
+	for (i = 0; i < modified_sfs->len; i++)
+		g_ptr_array_add(data.added_sfs, modified_sfs->pdata[i]);
+	tm_workspace_add_source_files(data.added_sfs);
+	prjorg_file_index_add(s_file_index, data.added_paths);
+
+	prjorg_sidebar_update(TRUE);
+
+	g_ptr_array_free(data.added_sfs, TRUE);
+	g_ptr_array_free(data.added_paths, TRUE);
+	g_ptr_array_free(modified_sfs, TRUE);
+	g_hash_table_destroy(deleted_paths);
+	g_hash_table_destroy(data.visited_paths);
+	free_patterns(data.pattern_list);
+	free_patterns(data.ignored_dirs_list);
+	free_patterns(data.ignored_file_list);
+}
+
+
 void rescan_project(gchar **session_files)
 {
+	GSList *pattern_list, *ignored_dirs_list, *ignored_file_list;
+	GPtrArray *base_dirs;
 	GSList *elem;
-	gint filenum = 0;
 
 	if (!prj_org)
 		return;
 
+	cancel_scan();
+
 	clear_idle_queue(&s_idle_add_funcs);
 	clear_idle_queue(&s_idle_remove_funcs);
 
+	base_dirs = g_ptr_array_new();
 	foreach_slist(elem, prj_org->roots)
-		filenum += prjorg_project_rescan_root(elem->data);
+	{
+		PrjOrgRoot *root = elem->data;
 
-	if (prj_org->generate_tag_prefs == PrjOrgTagYes || (prj_org->generate_tag_prefs == PrjOrgTagAuto && filenum < 1000))
-		g_slist_foreach(prj_org->roots, (GFunc)regenerate_tags, session_files);
+		clear_root(root);
+		g_ptr_array_add(base_dirs, root->base_dir);
+	}
+	g_ptr_array_add(base_dirs, NULL);
+
+	get_scan_patterns(&pattern_list, &ignored_dirs_list, &ignored_file_list);
+
+	/* directories are watched again as the scan finds them */
+	prjorg_watcher_free(s_watcher);
+	s_watcher = prjorg_watcher_new(on_watcher_changes, NULL);
+
+	prjorg_file_index_free(s_file_index);
+	s_file_index = prjorg_file_index_new(((PrjOrgRoot *)prj_org->roots->data)->base_dir);
+
+	s_session_files = g_strdupv(session_files);
+	s_scanned_files_num = 0;
+	s_tags_generated = FALSE;
+	s_last_sidebar_update = g_get_monotonic_time();
+	s_crawler = prjorg_crawler_start((gchar **)base_dirs->pdata, pattern_list,
+		ignored_dirs_list, ignored_file_list, prj_org->show_empty_dirs,
+		on_crawler_batch, on_crawler_done, NULL);
+
+	g_ptr_array_free(base_dirs, TRUE);
 }
 
 
@@ -432,12 +963,7 @@ void prjorg_project_save(GKeyFile * key_file)
 
 static void close_root(PrjOrgRoot *root, gpointer user_data)
 {
-	GPtrArray *source_files;
-
-	source_files = g_ptr_array_new();
-	g_hash_table_foreach(root->file_table, (GHFunc)collect_source_files, source_files);
-	tm_workspace_remove_source_files(source_files);
-	g_ptr_array_free(source_files, TRUE);
+	clear_root(root);
 
 	g_hash_table_destroy(root->file_table);
 	g_free(root->base_dir);
@@ -801,6 +1327,17 @@ void prjorg_project_close(void)
 	if (!prj_org)
 		return;  /* can happen on plugin reload */
 
+	cancel_scan();
+
+	prjorg_watcher_free(s_watcher);
+	s_watcher = NULL;
+
+	prjorg_file_index_free(s_file_index);
+	s_file_index = NULL;
+
+	filetype_matcher_free(s_ft_matcher);
+	s_ft_matcher = NULL;
+
 	clear_idle_queue(&s_idle_add_funcs);
 	clear_idle_queue(&s_idle_remove_funcs);
 
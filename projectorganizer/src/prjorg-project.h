@@ -21,6 +21,8 @@
 
 #include <gtk/gtk.h>
 
+#include "prjorg-file-index.h"
+
 #define PRJORG_PATTERNS_SOURCE "*.c *.C *.cpp *.cxx *.c++ *.cc *.m"
 #define PRJORG_PATTERNS_HEADER "*.h *.H *.hpp *.hxx *.h++ *.hh"
 #define PRJORG_PATTERNS_IGNORED_DIRS ".* CVS"
@@ -63,6 +65,8 @@ void prjorg_project_close(void);
 void prjorg_project_save(GKeyFile * key_file);
 void prjorg_project_read_properties_tab(void);
 void prjorg_project_rescan(void);
+gboolean prjorg_project_is_scanning(void);
+PrjOrgFileIndex *prjorg_project_get_file_index(void);
 
 void prjorg_project_add_external_dir(const gchar *utf8_dirname);
 void prjorg_project_remove_external_dir(const gchar *utf8_dirname);
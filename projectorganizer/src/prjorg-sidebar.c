@@ -59,6 +59,9 @@ typedef struct
 static GdkColor s_external_color;
 static GtkWidget *s_toolbar = NULL;
 static gboolean s_pending_reload = FALSE;
+/* expanded and selected paths from before the project scan started - the tree
+ * is rebuilt several times during the scan and these have to survive it */
+static ExpandData *s_scan_expand_data = NULL;
 
 static GtkWidget *s_file_view_vbox = NULL;
 static GtkWidget *s_file_view = NULL;
@@ -1349,6 +1352,8 @@ static void load_project_root(PrjOrgRoot *root, GtkTreeIter *parent, GSList *hea
 			gtk_widget_set_sensitive(s_project_toolbar.follow, TRUE);
 			gtk_widget_set_sensitive(s_project_toolbar.add, TRUE);
 		}
+		else if (prjorg_project_is_scanning())
+			set_intro_message(_("Scanning project directory..."));
 		else
 			set_intro_message(_("Set file patterns under Project->Properties"));
 	}
@@ -1604,8 +1609,34 @@ void prjorg_sidebar_update_full(gboolean reload, gchar **expanded_paths)
 
 	if (reload)
 	{
-		expand_data->expanded_paths = expanded_paths != NULL ? expanded_paths : prjorg_sidebar_get_expanded_paths();
-		expand_data->selected_path = get_selected_path();
+		if (prjorg_project_is_scanning())
+		{
+			if (!s_scan_expand_data)
+			{
+				s_scan_expand_data = g_new0(ExpandData, 1);
+				s_scan_expand_data->expanded_paths = expanded_paths != NULL ? expanded_paths : prjorg_sidebar_get_expanded_paths();
+				s_scan_expand_data->selected_path = get_selected_path();
+			}
+			else
+				g_strfreev(expanded_paths);
+
+			expand_data->expanded_paths = g_strdupv(s_scan_expand_data->expanded_paths);
+			expand_data->selected_path = g_strdup(s_scan_expand_data->selected_path);
+		}
+		else if (s_scan_expand_data)
+		{
+			/* first reload after the scan finished */
+			g_strfreev(expanded_paths);
+			expand_data->expanded_paths = s_scan_expand_data->expanded_paths;
+			expand_data->selected_path = s_scan_expand_data->selected_path;
+			g_free(s_scan_expand_data);
+			s_scan_expand_data = NULL;
+		}
+		else
+		{
+			expand_data->expanded_paths = expanded_paths != NULL ? expanded_paths : prjorg_sidebar_get_expanded_paths();
+			expand_data->selected_path = get_selected_path();
+		}
 
 		load_project();
 		/* we get color information only after the sidebar is realized -
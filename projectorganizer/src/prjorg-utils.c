@@ -103,6 +103,26 @@ gboolean patterns_match(GSList *patterns, const gchar *str)
 }
 
 
+/* changes whenever the filetype definitions used for filetype detection change */
+guint get_filetypes_signature(void)
+{
+	guint hash = 5381;
+	guint i;
+
+	for (i = 0; i < geany->filetypes_array->len; i++)
+	{
+		GeanyFiletype *ft = filetypes[i];
+		gchar **pattern;
+
+		hash = hash * 33 + g_str_hash(ft->name);
+		foreach_strv(pattern, ft->pattern)
+			hash = hash * 33 + g_str_hash(*pattern);
+	}
+
+	return hash;
+}
+
+
 void open_file(gchar *utf8_name)
 {
 	gchar *name;
@@ -30,6 +30,7 @@ gchar *get_relative_path(const gchar *utf8_parent, const gchar *utf8_descendant)
 
 gboolean patterns_match(GSList *patterns, const gchar *str);
 GSList *get_precompiled_patterns(gchar **patterns);
+guint get_filetypes_signature(void);
 
 void open_file(gchar *utf8_name);
 void close_file(gchar *utf8_name);
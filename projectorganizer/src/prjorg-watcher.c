@@ -0,0 +1,202 @@
+/*
+ * Copyright 2026 The Geany contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Watches project directories for created, deleted and modified files.
+ * Events are collected until no new events arrive for a while (or until
+ * the maximum delay expires) so operations touching many files, like
+ * switching git branches, result in a single update.
+ */
+
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+	#include "config.h"
+#endif
+#include <geanyplugin.h>
+
+#include "prjorg-watcher.h"
+
+extern GeanyPlugin *geany_plugin;
+
+/* time without new events after which the changes are reported (ms) */
+#define COALESCE_DELAY 300
+/* don't postpone reporting changes longer than this under constant events (ms) */
+#define MAX_COALESCE_DELAY 3000
+
+struct PrjOrgWatcher
+{
+	GHashTable *monitors;  /* utf8 dir path -> GFileMonitor */
+	GHashTable *changed_paths;  /* set of utf8 paths */
+	guint report_source;
+	gint64 first_event_time;
+	gint64 last_event_time;
+
+	PrjOrgWatcherFunc changed_cb;
+	gpointer user_data;
+};
+
+
+static void monitor_free(GFileMonitor *monitor)
+{
+	g_file_monitor_cancel(monitor);
+	g_object_unref(monitor);
+}
+
+
+static gboolean report_changes(gpointer user_data)
+{
+	PrjOrgWatcher *watcher = user_data;
+	gint64 now = g_get_monotonic_time();
+	GHashTable *changed_paths;
+
+	if (now - watcher->last_event_time < COALESCE_DELAY * G_TIME_SPAN_MILLISECOND &&
+		now - watcher->first_event_time < MAX_COALESCE_DELAY * G_TIME_SPAN_MILLISECOND)
+	{
+		return G_SOURCE_CONTINUE;
+	}
+
+	watcher->report_source = 0;
+	changed_paths = watcher->changed_paths;
+	watcher->changed_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	/* the watcher may be destroyed by the callback */
+	watcher->changed_cb(changed_paths, watcher->user_data);
+	g_hash_table_destroy(changed_paths);
+
+	return G_SOURCE_REMOVE;
+}
+
+
+static void add_changed_path(PrjOrgWatcher *watcher, GFile *file)
+{
+	gchar *locale_path = file ? g_file_get_path(file) : NULL;
+
+	if (locale_path)
+	{
+		g_hash_table_add(watcher->changed_paths, utils_get_utf8_from_locale(locale_path));
+		g_free(locale_path);
+	}
+}
+
+
+static void on_monitor_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+	GFileMonitorEvent event_type, PrjOrgWatcher *watcher)
+{
+	switch (event_type)
+	{
+		case G_FILE_MONITOR_EVENT_CREATED:
+		case G_FILE_MONITOR_EVENT_DELETED:
+		case G_FILE_MONITOR_EVENT_MOVED_IN:
+		case G_FILE_MONITOR_EVENT_MOVED_OUT:
+		case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+			add_changed_path(watcher, file);
+			break;
+		case G_FILE_MONITOR_EVENT_RENAMED:
+			add_changed_path(watcher, file);
+			add_changed_path(watcher, other_file);
+			break;
+		default:
+			return;
+	}
+
+	watcher->last_event_time = g_get_monotonic_time();
+	if (watcher->report_source == 0)
+	{
+		watcher->first_event_time = watcher->last_event_time;
+		watcher->report_source = plugin_timeout_add(geany_plugin, COALESCE_DELAY,
+			report_changes, watcher);
+	}
+}
+
+
+PrjOrgWatcher *prjorg_watcher_new(PrjOrgWatcherFunc changed_cb, gpointer user_data)
+{
+	PrjOrgWatcher *watcher = g_new0(PrjOrgWatcher, 1);
+
+	watcher->monitors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)monitor_free);
+	watcher->changed_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	watcher->changed_cb = changed_cb;
+	watcher->user_data = user_data;
+
+	return watcher;
+}
+
+
+void prjorg_watcher_free(PrjOrgWatcher *watcher)
+{
+	if (!watcher)
+		return;
+
+	if (watcher->report_source != 0)
+		g_source_remove(watcher->report_source);
+	g_hash_table_destroy(watcher->monitors);
+	g_hash_table_destroy(watcher->changed_paths);
+	g_free(watcher);
+}
+
+
+void prjorg_watcher_add_dir(PrjOrgWatcher *watcher, const gchar *utf8_dir)
+{
+	GFileMonitor *monitor;
+	gchar *locale_dir;
+	GFile *file;
+
+	if (g_hash_table_contains(watcher->monitors, utf8_dir))
+		return;
+
+	locale_dir = utils_get_locale_from_utf8(utf8_dir);
+	file = g_file_new_for_path(locale_dir);
+
+	/* may fail e.g. when running out of inotify watches - the directory
+	 * is then updated only by rescanning the project */
+	monitor = g_file_monitor_directory(file, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+	if (monitor)
+	{
+		g_signal_connect(monitor, "changed", G_CALLBACK(on_monitor_changed), watcher);
+		g_hash_table_insert(watcher->monitors, g_strdup(utf8_dir), monitor);
+	}
+
+	g_object_unref(file);
+	g_free(locale_dir);
+}
+
+
+/* removes also watches of all subdirectories */
+void prjorg_watcher_remove_dir(PrjOrgWatcher *watcher, const gchar *utf8_dir)
+{
+	gchar *prefix = g_strconcat(utf8_dir, G_DIR_SEPARATOR_S, NULL);
+	GHashTableIter iter;
+	gpointer key;
+
+	g_hash_table_iter_init(&iter, watcher->monitors);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+	{
+		if (strcmp(key, utf8_dir) == 0 || g_str_has_prefix(key, prefix))
+			g_hash_table_iter_remove(&iter);
+	}
+
+	g_free(prefix);
+}
+
+
+gboolean prjorg_watcher_is_watched(PrjOrgWatcher *watcher, const gchar *utf8_dir)
+{
+	return g_hash_table_contains(watcher->monitors, utf8_dir);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2026 The Geany contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PRJORG_WATCHER_H__
+#define __PRJORG_WATCHER_H__
+
+#include <glib.h>
+
+typedef struct PrjOrgWatcher PrjOrgWatcher;
+
+/* utf8_paths is a set of paths which were created, deleted or modified
+ * since the last call */
+typedef void (*PrjOrgWatcherFunc)(GHashTable *utf8_paths, gpointer user_data);
+
+PrjOrgWatcher *prjorg_watcher_new(PrjOrgWatcherFunc changed_cb, gpointer user_data);
+void prjorg_watcher_free(PrjOrgWatcher *watcher);
+
+void prjorg_watcher_add_dir(PrjOrgWatcher *watcher, const gchar *utf8_dir);
+void prjorg_watcher_remove_dir(PrjOrgWatcher *watcher, const gchar *utf8_dir);
+gboolean prjorg_watcher_is_watched(PrjOrgWatcher *watcher, const gchar *utf8_dir);
+
+#endif
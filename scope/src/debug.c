@@ -306,6 +306,32 @@ static void debug_parse(char *string, const char *error)
 }
 
 static gboolean leading_receive;  /* FALSE for continuation of a too long / incomplete line */
+static guint refresh_source_id = 0;
+static guint records_parsed;  /* since the last refresh */
+static guint total_records_parsed;
+static guint total_views_refreshed;
+
+/* called once per burst of gdb output instead of after each line */
+static gboolean debug_refresh(G_GNUC_UNUSED gpointer gdata)
+{
+	DebugState state = debug_state();
+	guint views_refreshed = views_refresh_count();
+
+	refresh_source_id = 0;
+
+	if (!commands->len)
+		views_update(state);
+
+	update_state(state);
+
+	views_refreshed = views_refresh_count() - views_refreshed;
+	total_records_parsed += records_parsed;
+	total_views_refreshed += views_refreshed;
+	g_debug("refresh after %u records: %u views updated", records_parsed, views_refreshed);
+	records_parsed = 0;
+
+	return FALSE;
+}
 
 static void receive_output_cb(GString *string, GIOCondition condition,
 	G_GNUC_UNUSED gpointer gdata)
@@ -327,12 +353,11 @@ static void receive_output_cb(GString *string, GIOCondition condition,
 			debug_parse(string->str, error);
 
 		leading_receive = !error;
+		records_parsed++;
 	}
 
-	if (!commands->len)
-		views_update(debug_state());
-
-	update_state(debug_state());
+	if (!refresh_source_id)
+		refresh_source_id = plugin_idle_add(geany_plugin, debug_refresh, NULL);
 }
 
 static void receive_errors_cb(GString *string, GIOCondition condition,
@@ -357,6 +382,15 @@ static void gdb_finalize(void)
 		if (send_source_id)
 			g_source_remove(send_source_id);
 	}
+
+	if (refresh_source_id)
+	{
+		g_source_remove(refresh_source_id);
+		refresh_source_id = 0;
+	}
+
+	g_debug("gdb session: %u records parsed, %u views updated",
+		total_records_parsed + records_parsed, total_views_refreshed);
 }
 
 static void gdb_exit_cb(G_GNUC_UNUSED GPid pid, gint status, G_GNUC_UNUSED gpointer gdata)
@@ -428,6 +462,9 @@ static void load_program(void)
 		wait_prompt = TRUE;
 		g_string_truncate(commands, 0);
 		leading_receive = TRUE;
+		records_parsed = 0;
+		total_records_parsed = 0;
+		total_views_refreshed = 0;
 
 		if (pref_gdb_async_mode)
 			g_string_append(commands, "-gdb-set target-async on\n");
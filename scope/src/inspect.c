@@ -141,21 +141,111 @@ static gint inspect_get_scid(GtkTreeIter *iter)
 	return scid;
 }
 
-static void inspect_expand(GtkTreeIter *iter)
+static void inspect_list_children(GtkTreeIter *iter, gint from, gboolean append)
 {
 	const char *var1;
-	gint scid, start, count, numchild;
+	gint scid, count, numchild;
 	char *s;
 
 	scid = inspect_get_scid(iter);
-	scp_tree_store_get(store, iter, INSPECT_VAR1, &var1, INSPECT_START, &start,
-		INSPECT_COUNT, &count, INSPECT_NUMCHILD, &numchild, -1);
-	s = g_strdup_printf("%d", start);
-	debug_send_format(N, "07%c%d%d-var-list-children 1 %s %d %d", '0' + (int) strlen(s) - 1,
-		start, scid, var1, start, count ? start + count : numchild);
+	scp_tree_store_get(store, iter, INSPECT_VAR1, &var1, INSPECT_COUNT, &count,
+		INSPECT_NUMCHILD, &numchild, -1);
+	s = g_strdup_printf("%d", from);
+	debug_send_format(N, "07%c%c%d%d-var-list-children 1 %s %d %d", '0' + append,
+		'0' + (int) strlen(s) - 1, from, scid, var1, from, count ? from + count : numchild);
 	g_free(s);
 }
 
+static void inspect_expand(GtkTreeIter *iter)
+{
+	gint start;
+
+	scp_tree_store_get(store, iter, INSPECT_START, &start, -1);
+	inspect_list_children(iter, start, FALSE);
+}
+
+/* the stub after a partial list of children holds the index of the next child */
+static void append_more_stub(GtkTreeIter *parent, gint next)
+{
+	scp_tree_store_append_with_values(store, NULL, parent, INSPECT_EXPR, _("..."),
+		INSPECT_START, next, INSPECT_EXPAND, FALSE, -1);
+}
+
+static void inspect_load_more(GtkTreeIter *iter)
+{
+	const char *var1;
+	gint scid, next;
+	gboolean requested;
+
+	scp_tree_store_get(store, iter, INSPECT_VAR1, &var1, INSPECT_SCID, &scid,
+		INSPECT_START, &next, INSPECT_EXPAND, &requested, -1);
+
+	if (!var1 && !scid && next > 0 && !requested)
+	{
+		GtkTreeIter parent;
+
+		scp_tree_store_set(store, iter, INSPECT_EXPR, _("loading..."), INSPECT_EXPAND, TRUE,
+			-1);
+		scp_tree_store_iter_parent(store, &parent, iter);
+		inspect_list_children(&parent, next, TRUE);
+	}
+}
+
+static gboolean tree_path_next_visible(GtkTreePath *path)
+{
+	GtkTreeIter iter;
+
+	if (gtk_tree_view_row_expanded(tree, path))
+	{
+		gtk_tree_path_down(path);
+		return TRUE;
+	}
+
+	for (;;)
+	{
+		gtk_tree_path_next(path);
+		if (scp_tree_store_get_iter(store, &iter, path))
+			return TRUE;
+		if (!gtk_tree_path_up(path) || !gtk_tree_path_get_depth(path))
+			return FALSE;
+	}
+}
+
+static gboolean load_visible_queued = FALSE;
+
+/* fetches the next children pages of the variables whose partial lists end in view */
+static gboolean inspect_load_visible(G_GNUC_UNUSED gpointer gdata)
+{
+	GtkTreePath *path, *end;
+
+	load_visible_queued = FALSE;
+
+	if ((debug_state() & DS_VARIABLE) && gtk_tree_view_get_visible_range(tree, &path, &end))
+	{
+		do
+		{
+			GtkTreeIter iter;
+
+			if (scp_tree_store_get_iter(store, &iter, path))
+				inspect_load_more(&iter);
+		} while (gtk_tree_path_compare(path, end) < 0 && tree_path_next_visible(path));
+
+		gtk_tree_path_free(path);
+		gtk_tree_path_free(end);
+	}
+
+	return FALSE;
+}
+
+static void inspect_queue_load_visible(void)
+{
+	if (!load_visible_queued)
+	{
+		load_visible_queued = TRUE;
+		plugin_idle_add(geany_plugin, inspect_load_visible, NULL);
+	}
+}
+
 static void on_jump_to_menu_item_activate(GtkMenuItem *menuitem, G_GNUC_UNUSED gpointer gdata)
 {
 	GtkTreeIter iter;
@@ -345,7 +435,8 @@ static void inspect_node_append(const ParseNode *node, GtkTreeIter *parent)
 	{
 		GtkTreeIter iter;
 
-		scp_tree_store_append(store, &iter, parent);
+		scp_tree_store_append_with_values(store, &iter, parent, INSPECT_COUNT,
+			option_inspect_count, -1);
 		inspect_variable_store(&iter, &var);
 		scp_tree_store_set(store, &iter, INSPECT_EXPR, var.expr ? var.expr : var.name,
 			INSPECT_HB_MODE, var.hb_mode, INSPECT_FORMAT, FORMAT_NATURAL, -1);
@@ -356,7 +447,7 @@ static void inspect_node_append(const ParseNode *node, GtkTreeIter *parent)
 void on_inspect_children(GArray *nodes)
 {
 	char *token = (char *) parse_grab_token(nodes);
-	size_t size = *token - '0' + 2;
+	size_t size = token[1] - '0' + 3;
 
 	iff (strlen(token) >= size + 1, "bad token")
 	{
@@ -364,21 +455,56 @@ void on_inspect_children(GArray *nodes)
 
 		if (inspect_find(&iter, FALSE, token + size))
 		{
-			gint from;
+			gboolean append = *token == '1';
+			gint from, start;
 			GtkTreePath *path = scp_tree_store_get_path(store, &iter);
 
 			token[size] = '\0';
-			from = atoi(token + 1);
-			scp_tree_store_clear_children(store, &iter, FALSE);
+			from = atoi(token + 2);
+
+			if (append)
+			{
+				/* remove the "loading..." stub, the previous pages stay */
+				GtkTreeIter child;
+				gint n = scp_tree_store_iter_n_children(store, &iter);
+				const char *stub_var1 = NULL;
+				gint stub_scid = 0, stub_next = -1;
+				gboolean requested = FALSE;
+
+				if (n && scp_tree_store_iter_nth_child(store, &child, &iter, n - 1))
+				{
+					scp_tree_store_get(store, &child, INSPECT_VAR1, &stub_var1,
+						INSPECT_SCID, &stub_scid, INSPECT_START, &stub_next,
+						INSPECT_EXPAND, &requested, -1);
+				}
+
+				/* the children were listed again since this page was requested */
+				if (stub_var1 || stub_scid || stub_next != from || !requested)
+				{
+					gtk_tree_path_free(path);
+					return;
+				}
+
+				scp_tree_store_remove(store, &child);
+				scp_tree_store_get(store, &iter, INSPECT_START, &start, -1);
+			}
+			else
+			{
+				scp_tree_store_clear_children(store, &iter, FALSE);
+				start = from;
+			}
 
 			if ((nodes = parse_find_array(nodes, "children")) == NULL)
-				append_stub(&iter, _("no children in range"), FALSE);
+			{
+				if (!append)
+					append_stub(&iter, _("no children in range"), FALSE);
+			}
 			else
 			{
 				gint numchild, end;
 				const char *var1;
 
-				if (from)
+				if (from && !append)
 					append_ellipsis(&iter, FALSE);
 
 				scp_tree_store_get(store, &iter, INSPECT_VAR1, &var1,
@@ -387,18 +513,21 @@ void on_inspect_children(GArray *nodes)
 				parse_foreach(nodes, (GFunc) inspect_node_append, &iter);
 				end = from + nodes->len;
 
-				if (nodes->len && (from || end < numchild))
+				if (nodes->len && (start || end < numchild))
 				{
 					debug_send_format(N, "04-var-set-update-range %s %d %d", var1,
-						from, end);
+						start, end);
 				}
 
-				if (nodes->len ? end < numchild : !from)
+				if (nodes->len && end < numchild)
+					append_more_stub(&iter, end);
+				else if (!nodes->len && !from)
 					append_ellipsis(&iter, FALSE);
 			}
 
 			gtk_tree_view_expand_row(tree, path, FALSE);
 			gtk_tree_path_free(path);
+			inspect_queue_load_visible();
 		}
 	}
 }
@@ -1090,6 +1219,19 @@ static gboolean inspect_test_expand_row(G_GNUC_UNUSED GtkTreeView *tree_view,
 	return TRUE;
 }
 
+static void on_inspect_row_expanded(G_GNUC_UNUSED GtkTreeView *tree_view,
+	G_GNUC_UNUSED GtkTreeIter *iter, G_GNUC_UNUSED GtkTreePath *path,
+	G_GNUC_UNUSED gpointer gdata)
+{
+	inspect_queue_load_visible();
+}
+
+static void on_inspect_scrolled(G_GNUC_UNUSED GtkAdjustment *adjustment,
+	G_GNUC_UNUSED gpointer gdata)
+{
+	inspect_queue_load_visible();
+}
+
 static gboolean on_inspect_key_press(G_GNUC_UNUSED GtkWidget *widget, GdkEventKey *event,
 	G_GNUC_UNUSED gpointer gdata)
 {
@@ -1172,6 +1314,10 @@ void inspect_init(void)
 	tree = view_connect("inspect_view", &store, &selection, inspect_cells, "inspect_window",
 		&inspect_display);
 	g_signal_connect(tree, "test-expand-row", G_CALLBACK(inspect_test_expand_row), NULL);
+	g_signal_connect(tree, "row-expanded", G_CALLBACK(on_inspect_row_expanded), NULL);
+	g_signal_connect(gtk_scrolled_window_get_vadjustment(
+		GTK_SCROLLED_WINDOW(get_widget("inspect_window"))), "value-changed",
+		G_CALLBACK(on_inspect_scrolled), NULL);
 	g_signal_connect(tree, "key-press-event", G_CALLBACK(on_inspect_key_press), NULL);
 	g_signal_connect(tree, "button-press-event", G_CALLBACK(on_inspect_button_press), NULL);
 	g_signal_connect(tree, "drag-motion", G_CALLBACK(on_inspect_drag_motion), NULL);
@@ -1212,4 +1358,5 @@ void inspect_finalize(void)
 	gtk_widget_destroy(inspect_dialog);
 	gtk_widget_destroy(expand_dialog);
 	g_free(jump_to_expr);
+	load_visible_queued = FALSE;
 }
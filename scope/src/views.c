@@ -60,22 +60,31 @@ static ViewInfo views[VIEW_COUNT] =
 	{ FALSE, VC_NONE,  menu_clear,      NULL,             FALSE, 0 }
 };
 
+static guint views_refreshed = 0;
+
 static void view_update_dirty(ViewIndex index, DebugState state)
 {
 	ViewInfo *view = views + index;
 
 	if (view->state & state)
 	{
+		views_refreshed++;
 		if (view->update())
 			view->dirty = FALSE;
 	}
 	else if (view->flush)
 	{
+		views_refreshed++;
 		view->clear();
 		view->dirty = FALSE;
 	}
 }
 
+guint views_refresh_count(void)
+{
+	return views_refreshed;
+}
+
 static void view_update(ViewIndex index, DebugState state)
 {
 	if (views[index].dirty)
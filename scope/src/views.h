@@ -41,6 +41,7 @@ void views_context_dirty(DebugState state, gboolean frame_only);
 #define views_data_dirty(state) views_context_dirty((state), FALSE)
 void views_clear(void);
 void views_update(DebugState state);
+guint views_refresh_count(void);
 gboolean view_stack_update(void);
 #define view_frame_update() (g_strcmp0(frame_id, "0") && view_stack_update())
 void view_local_update(void);
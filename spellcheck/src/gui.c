@@ -47,12 +47,26 @@ typedef struct
 } SpellClickInfo;
 static SpellClickInfo clickinfo;
 
+/* delay after a modification before checking the modified lines (ms) */
+#define CHECK_WHILE_TYPING_DELAY 500
+/* time spent checking lines per idle callback (ms) */
+#define CHECK_TIME_SLICE 10
+/* number of lines checked at once, between checks of the time slice */
+#define CHECK_LINES_CHUNK 16
+
+#define DIRTY_LINES_KEY "spellcheck-dirty-lines"
+
+/* a range of lines (inclusive) */
 typedef struct
 {
-	GeanyDocument *doc;
-	gint line_number;
-	gint line_count;
-	guint check_while_typing_idle_source_id;
+	gint first;
+	gint last;
+} LineRange;
+
+typedef struct
+{
+	guint delay_source_id;
+	guint idle_source_id;
 } CheckLineData;
 static CheckLineData check_line_data;
 
@@ -474,99 +488,224 @@ void sc_gui_update_editor_menu_cb(GObject *obj, const gchar *word, gint pos,
 }
 
 
-static void indicator_clear_on_line(GeanyDocument *doc, gint line_number)
+static void indicator_clear_on_lines(GeanyDocument *doc, gint first_line, gint last_line)
 {
-	gint start_pos, length;
+	gint start_pos, end_pos;
 
 	g_return_if_fail(doc != NULL);
 
-	start_pos = sci_get_position_from_line(doc->editor->sci, line_number);
-	length = sci_get_line_length(doc->editor->sci, line_number);
+	start_pos = sci_get_position_from_line(doc->editor->sci, first_line);
+	end_pos = sci_get_line_end_position(doc->editor->sci, last_line);
 
 	sci_indicator_set(doc->editor->sci, GEANY_INDICATOR_ERROR);
-	sci_indicator_clear(doc->editor->sci, start_pos, length);
+	sci_indicator_clear(doc->editor->sci, start_pos, end_pos - start_pos);
 }
 
 
-static gboolean check_lines(gpointer data)
+/* Returns the sorted, non-overlapping ranges of lines still to be checked in doc */
+static GArray *get_dirty_lines(GeanyDocument *doc, gboolean create)
 {
-	GeanyDocument *doc = check_line_data.doc;
+	GObject *sci = G_OBJECT(doc->editor->sci);
+	GArray *lines = g_object_get_data(sci, DIRTY_LINES_KEY);
 
-	/* since we're in an timeout callback, the document may have been closed */
-	if (DOC_VALID (doc))
+	if (lines == NULL && create)
 	{
-		gint line_number = check_line_data.line_number;
-		gint line_count = check_line_data.line_count;
-		gint i;
+		lines = g_array_new(FALSE, FALSE, sizeof(LineRange));
+		g_object_set_data_full(sci, DIRTY_LINES_KEY, lines, (GDestroyNotify) g_array_unref);
+	}
+	return lines;
+}
+
 
-		for (i = 0; i < line_count; i++)
+static void clear_dirty_lines(GeanyDocument *doc)
+{
+	g_object_set_data(G_OBJECT(doc->editor->sci), DIRTY_LINES_KEY, NULL);
+}
+
+
+/* Moves the dirty lines after line by lines_added and marks the lines from line to
+ * line + lines_added dirty, merging touching ranges */
+static void add_dirty_lines(GeanyDocument *doc, gint line, gint lines_added)
+{
+	GArray *lines = get_dirty_lines(doc, TRUE);
+	LineRange added = { line, line + MAX(0, lines_added) };
+	guint i;
+
+	for (i = 0; i < lines->len; i++)
+	{
+		LineRange *range = &g_array_index(lines, LineRange, i);
+
+		if (range->first > line)
+			range->first = MAX(line, range->first + lines_added);
+		if (range->last > line)
+			range->last = MAX(line, range->last + lines_added);
+	}
+
+	for (i = 0; i < lines->len; i++)
+	{
+		LineRange *range = &g_array_index(lines, LineRange, i);
+
+		if (range->last + 1 < added.first)
+			continue;
+		if (range->first > added.last + 1)
+			break;
+		/* touching or overlapping */
+		added.first = MIN(added.first, range->first);
+		added.last = MAX(added.last, range->last);
+		g_array_remove_index(lines, i);
+		i--;
+	}
+	g_array_insert_val(lines, i, added);
+}
+
+
+/* Removes the lines from first to last from the dirty lines */
+static void remove_dirty_lines(GArray *lines, gint first, gint last)
+{
+	guint i;
+
+	for (i = 0; i < lines->len; i++)
+	{
+		LineRange *range = &g_array_index(lines, LineRange, i);
+
+		if (range->last < first)
+			continue;
+		if (range->first > last)
+			break;
+
+		if (range->first < first && range->last > last)
 		{
-			indicator_clear_on_line(doc, line_number);
-			if (sc_speller_process_line(doc, line_number) != 0)
-			{
-				if (sc_info->use_msgwin)
-					msgwin_switch_tab(MSG_MESSAGE, FALSE);
-			}
-			line_number++;
+			/* split */
+			LineRange tail = { last + 1, range->last };
+
+			range->last = first - 1;
+			g_array_insert_val(lines, i + 1, tail);
+			break;
+		}
+		else if (range->first < first)
+			range->last = first - 1;
+		else if (range->last > last)
+			range->first = last + 1;
+		else
+		{
+			g_array_remove_index(lines, i);
+			i--;
 		}
 	}
-	check_line_data.check_while_typing_idle_source_id = 0;
-	return FALSE;
 }
 
 
-static gboolean need_delay(void)
+/* Checks dirty lines of doc between from and to until the deadline has passed, and returns
+ * whether there is no more dirty line in this range */
+static gboolean check_dirty_lines(GeanyDocument *doc, gint from, gint to, gint64 deadline)
 {
-	static gint64 time_prev = 0; /* time in microseconds */
-	gint64 time_now;
-	GTimeVal t;
-	const gint timeout = 500; /* delay in milliseconds */
-	gboolean ret = FALSE;
+	GArray *lines = get_dirty_lines(doc, FALSE);
+	gint line_count = sci_get_line_count(doc->editor->sci);
 
-	g_get_current_time(&t);
+	to = MIN(to, line_count - 1);
+	while (lines != NULL && lines->len > 0)
+	{
+		gint first = -1;
+		gint last = -1;
+		guint i;
 
-	time_now = ((gint64) t.tv_sec * G_USEC_PER_SEC) + t.tv_usec;
+		for (i = 0; i < lines->len; i++)
+		{
+			LineRange *range = &g_array_index(lines, LineRange, i);
+
+			if (range->first >= line_count)
+			{	/* the lines don't exist anymore */
+				g_array_set_size(lines, i);
+				break;
+			}
+			if (range->last >= from && range->first <= to)
+			{
+				first = MAX(from, range->first);
+				last = MIN(MIN(to, range->last), first + CHECK_LINES_CHUNK - 1);
+				break;
+			}
+		}
+		if (first < 0)
+			return TRUE;
+		if (g_get_monotonic_time() >= deadline)
+			return FALSE;
+
+		remove_dirty_lines(lines, first, last);
+		indicator_clear_on_lines(doc, first, last);
+		if (sc_speller_process_lines(doc, first, last) != 0)
+		{
+			if (sc_info->use_msgwin)
+				msgwin_switch_tab(MSG_MESSAGE, FALSE);
+		}
+	}
+	return TRUE;
+}
 
-	/* delay keypresses for 0.5 seconds */
-	if (time_now < (time_prev + (timeout * 1000)))
-		return TRUE;
 
-	if (check_line_data.check_while_typing_idle_source_id == 0)
+static gboolean check_lines_idle(gpointer data)
+{
+	gint64 deadline = g_get_monotonic_time() + CHECK_TIME_SLICE * 1000;
+	GeanyDocument *doc = document_get_current();
+	gboolean done = TRUE;
+	guint i;
+
+	if (! sc_info->check_while_typing)
+	{
+		foreach_document(i)
+			clear_dirty_lines(documents[i]);
+		check_line_data.idle_source_id = 0;
+		return FALSE;
+	}
+
+	/* visible lines of the current document first */
+	if (doc != NULL)
+	{
+		ScintillaObject *sci = doc->editor->sci;
+		gint first_visible = scintilla_send_message(sci, SCI_GETFIRSTVISIBLELINE, 0, 0);
+		gint lines_on_screen = scintilla_send_message(sci, SCI_LINESONSCREEN, 0, 0);
+		gint first_line = scintilla_send_message(sci, SCI_DOCLINEFROMVISIBLE, first_visible, 0);
+		gint last_line = scintilla_send_message(sci, SCI_DOCLINEFROMVISIBLE,
+			first_visible + lines_on_screen, 0);
+
+		done = check_dirty_lines(doc, first_line, last_line, deadline) &&
+			check_dirty_lines(doc, 0, G_MAXINT, deadline);
+	}
+	foreach_document(i)
 	{
-		check_line_data.check_while_typing_idle_source_id =
-			plugin_timeout_add(geany_plugin, timeout, check_lines, NULL);
-		ret = TRUE;
+		if (! done)
+			break;
+		done = check_dirty_lines(documents[i], 0, G_MAXINT, deadline);
 	}
 
-	/* set current time for the next key press */
-	time_prev = time_now;
+	if (done)
+		check_line_data.idle_source_id = 0;
+	return ! done;
+}
+
 
-	return ret;
+static gboolean check_lines_delayed(gpointer data)
+{
+	check_line_data.delay_source_id = 0;
+	if (check_line_data.idle_source_id == 0)
+		check_line_data.idle_source_id = plugin_idle_add(geany_plugin, check_lines_idle, NULL);
+	return FALSE;
 }
 
 
 static void check_on_text_changed(GeanyDocument *doc, gint position, gint lines_added)
 {
-	gint line_number;
-	gint line_count;
-
-	/* Iterating over all lines which changed as indicated by lines_added. lines_added is 0
-	 * if only one line has changed, in this case set line_count to 1. Otherwise, iterating over all
-	 * new lines makes spell checking work for pasted text. */
-	line_count = MAX(1, lines_added);
+	gint line_number = sci_get_line_from_position(doc->editor->sci, position);
 
-	line_number = sci_get_line_from_position(doc->editor->sci, position);
-	/* TODO: storing these information in the global check_line_data struct isn't that good.
-	 * The data gets overwritten when a new line is inserted and so there is a chance that the
-	 * previous line is not checked to the end. One solution could be to simple maintain a list
-	 * of line numbers which needs to be checked and do this in the timeout handler. */
-	check_line_data.doc = doc;
-	check_line_data.line_number = line_number;
-	check_line_data.line_count = line_count;
+	/* lines_added is 0 if only one line has changed, otherwise checking all the new lines
+	 * makes spell checking work for pasted text */
+	add_dirty_lines(doc, line_number, lines_added);
 
-	/* check only once in a while */
-	if (! need_delay())
-		check_lines(NULL);
+	/* check only once in a while, and let the idle checks continue while typing */
+	if (check_line_data.delay_source_id == 0 && check_line_data.idle_source_id == 0)
+	{
+		check_line_data.delay_source_id = plugin_timeout_add(geany_plugin,
+			CHECK_WHILE_TYPING_DELAY, check_lines_delayed, NULL);
+	}
 }
 
 
@@ -750,8 +889,10 @@ void sc_gui_init(void)
 void sc_gui_free(void)
 {
 	g_free(clickinfo.word);
-	if (check_line_data.check_while_typing_idle_source_id != 0)
-		g_source_remove(check_line_data.check_while_typing_idle_source_id);
+	if (check_line_data.delay_source_id != 0)
+		g_source_remove(check_line_data.delay_source_id);
+	if (check_line_data.idle_source_id != 0)
+		g_source_remove(check_line_data.idle_source_id);
 	if (sc_info->toolbar_button != NULL)
 		gtk_widget_destroy(GTK_WIDGET(sc_info->toolbar_button));
 	free_editor_menu_items();
@@ -38,9 +38,72 @@
 
 
 
+/* Maximum number of words whose verdict is remembered; the cache is simply emptied
+ * when it gets full, which is rare enough since source files use a limited vocabulary */
+#define SC_SPELLER_CACHE_MAX_WORDS 50000
+
+/* values stored in sc_speller_cache, non-NULL to distinguish them from missing entries */
+#define SC_WORD_CORRECT GINT_TO_POINTER(1)
+#define SC_WORD_INCORRECT GINT_TO_POINTER(2)
+
+/* number of words the background checker collects before checking them and passing
+ * the misspelled ones to the main thread */
+#define SC_CHECK_BATCH_WORDS 256
+/* interval in which results of the background checker are applied (ms) */
+#define SC_CHECK_POLL_INTERVAL 50
+/* maximum number of suggestions shown in the messages window */
+#define SC_MAX_SUGGESTIONS 15
+
+
+/* a misspelled word found by the background checker */
+typedef struct
+{
+	gint start_pos;
+	gint end_pos;
+	gint line_number;
+	gchar *word;
+	gchar *message;  /* message window text, or NULL */
+} CheckResult;
+
+/* a whole document (or selection) check running in a background thread */
+typedef struct
+{
+	GeanyDocument *doc;
+	guint doc_id;
+	GThread *thread;
+	gint cancelled;  /* atomic */
+	guint source_id;
+
+	/* snapshot of the checked range, only read by the thread */
+	gchar *styled_text;  /* characters interleaved with their styles */
+	gint length;
+	gint start_pos;
+	gint first_line;
+	gint lexer;
+	gboolean word_chars[256];
+	gboolean use_msgwin;
+
+	/* GArrays of CheckResult pushed by the thread; job itself when it has finished */
+	GAsyncQueue *results;
+	gint suggestions_found;
+} CheckJob;
+
+
 static EnchantBroker *sc_speller_broker = NULL;
 static EnchantDict *sc_speller_dict = NULL;
 
+/* word -> SC_WORD_CORRECT or SC_WORD_INCORRECT for the current dictionary */
+static GHashTable *sc_speller_cache = NULL;
+/* protects sc_speller_dict and sc_speller_cache which are also used by the check thread */
+static GMutex sc_speller_lock;
+/* document ID -> CheckJob running for the document */
+static GHashTable *sc_speller_check_jobs = NULL;
+static guint64 sc_speller_cache_hits = 0;
+static guint64 sc_speller_cache_misses = 0;
+
+
+static gboolean sc_speller_style_is_text(gint lexer, gint style);
+
 
 
 static void dict_describe(const gchar* const lang, const gchar* const name,
@@ -57,75 +120,97 @@ static gboolean is_word_sep(gunichar c)
 }
 
 
+static void cache_log_stats(const gchar *reason)
+{
+	guint64 total = sc_speller_cache_hits + sc_speller_cache_misses;
+
+	if (total == 0)
+		return;
+
+	g_debug("Word cache %s: %u words, %" G_GUINT64_FORMAT " lookups, %.1f%% hits",
+		reason, g_hash_table_size(sc_speller_cache), total,
+		100.0 * sc_speller_cache_hits / total);
+}
+
+
+/* Forgets all verdicts, e.g. when the dictionary changed */
+static void cache_clear(void)
+{
+	g_hash_table_remove_all(sc_speller_cache);
+}
+
+
+/* Returns whether word is spelled correctly, asking the dictionary only for words
+ * not seen before */
+static gboolean cache_check_word(const gchar *word)
+{
+	gpointer verdict;
+	gint result;
+
+	verdict = g_hash_table_lookup(sc_speller_cache, word);
+	if (verdict != NULL)
+	{
+		sc_speller_cache_hits++;
+		return verdict == SC_WORD_CORRECT;
+	}
+	sc_speller_cache_misses++;
+
+	result = enchant_dict_check(sc_speller_dict, word, -1);
+	/* don't remember errors, the word might be checkable later */
+	if (result < 0)
+		return FALSE;
+
+	if (g_hash_table_size(sc_speller_cache) >= SC_SPELLER_CACHE_MAX_WORDS)
+	{
+		cache_log_stats("full");
+		cache_clear();
+	}
+	g_hash_table_insert(sc_speller_cache, g_strdup(word),
+		result == 0 ? SC_WORD_CORRECT : SC_WORD_INCORRECT);
+
+	return result == 0;
+}
+
+
 /* Strip punctuation and white space, more or less Unicode-safe.
- * The offset of the start of the word is stored in offset if non-NULL. */
-static gchar *strip_word(const gchar *word_to_check, gint *result_offset)
+ * The word is stripped in-place, the start of the stripped word inside of word is returned. */
+static gchar *strip_word(gchar *word)
 {
-	gunichar c;
-	gchar *word = g_strdup(word_to_check);
-	gchar *word_start = word;
 	gchar *word_end;
-	gint offset = 0;
-	gint word_len;
-	gint new_word_len;
+	gunichar c;
 
 	/* strip from the left */
-	do
+	while (*word != '\0')
 	{
 		c = g_utf8_get_char_validated(word, -1);
-		if (is_word_sep(c))
-		{	/* skip this character */
-			word = g_utf8_next_char(word);
-		}
-		else
+		if (c == (gunichar) -1 || c == (gunichar) -2 || ! is_word_sep(c))
 			break;
-	} while (c != (gunichar) -1 && c != 0 && *word != '\0');
-	word_len = strlen(word_to_check);
-	offset = word - word_start;
-	new_word_len = word_len - offset;
-
-	if (new_word_len <= 0)
-	{	/* empty or only punctuation in input string */
-		*result_offset = 0;
-		g_free(word_start);
-		return NULL;
-	}
-	/* move the string in-place and truncate it */
-	memmove(word_start, word, new_word_len);
-	word = word_start;
-	word[new_word_len] = '\0';
-	if (EMPTY(word))
-	{
-		g_free(word);
-		return NULL;
+		word = g_utf8_next_char(word);
 	}
 	/* strip from the right */
 	word_end = word + strlen(word);
-	do
+	while (word_end > word)
 	{
-		word_end = g_utf8_prev_char(word_end);
-		c = g_utf8_get_char_validated(word_end, -1);
-		if (is_word_sep(c))
-		{	/* skip this character */
-			*word_end = '\0';
-		}
-		else
-			break;
-	} while (c != (gunichar) -1 && word_end >= word);
+		gchar *prev = g_utf8_prev_char(word_end);
 
-	if (result_offset != NULL)
-		*result_offset = offset;
+		c = g_utf8_get_char_validated(prev, word_end - prev);
+		if (c == (gunichar) -1 || c == (gunichar) -2 || ! is_word_sep(c))
+			break;
+		word_end = prev;
+	}
+	*word_end = '\0';
 
 	return word;
 }
 
 
-static gint sc_speller_check_word(GeanyDocument *doc, gint line_number, const gchar *word,
+/* word gets modified */
+static gint sc_speller_check_word(GeanyDocument *doc, gint line_number, gchar *word,
 						   gint start_pos, gint end_pos)
 {
 	gsize n_suggs = 0;
 	gchar *word_to_check;
-	gint offset;
+	gboolean correct;
 
 	g_return_val_if_fail(sc_speller_dict != NULL, 0);
 	g_return_val_if_fail(doc != NULL, 0);
@@ -144,23 +229,20 @@ static gint sc_speller_check_word(GeanyDocument *doc, gint line_number, const gc
 		return 0;
 
 	/* strip punctuation and white space */
-	word_to_check = strip_word(word, &offset);
+	word_to_check = strip_word(word);
 	if (EMPTY(word_to_check))
-	{
-		g_free(word_to_check);
 		return 0;
-	}
 
 	/* recalculate start_pos and end_pos */
-	start_pos += offset;
+	start_pos += word_to_check - word;
 	end_pos = start_pos + strlen(word_to_check);
 
 	/* early out if the word is spelled correctly */
-	if (enchant_dict_check(sc_speller_dict, word_to_check, -1) == 0)
-	{
-		g_free(word_to_check);
+	g_mutex_lock(&sc_speller_lock);
+	correct = cache_check_word(word_to_check);
+	g_mutex_unlock(&sc_speller_lock);
+	if (correct)
 		return 0;
-	}
 
 	editor_indicator_set_on_range(doc->editor, GEANY_INDICATOR_ERROR, start_pos, end_pos);
 
@@ -170,6 +252,7 @@ static gint sc_speller_check_word(GeanyDocument *doc, gint line_number, const gc
 		gchar **suggs;
 		GString *str;
 
+		g_mutex_lock(&sc_speller_lock);
 		str = g_string_sized_new(256);
 		suggs = enchant_dict_suggest(sc_speller_dict, word_to_check, -1, &n_suggs);
 		if (suggs != NULL)
@@ -179,7 +262,7 @@ static gint sc_speller_check_word(GeanyDocument *doc, gint line_number, const gc
 			g_string_append(str, _("Try: "));
 
 			/* Now find the misspellings in the line, limit suggestions to a maximum of 15 (for now) */
-			for (j = 0; j < MIN(n_suggs, 15); j++)
+			for (j = 0; j < MIN(n_suggs, SC_MAX_SUGGESTIONS); j++)
 			{
 				g_string_append(str, suggs[j]);
 				g_string_append_c(str, ' ');
@@ -190,10 +273,10 @@ static gint sc_speller_check_word(GeanyDocument *doc, gint line_number, const gc
 			if (suggs != NULL && n_suggs > 0)
 				enchant_dict_free_string_list(sc_speller_dict, suggs);
 		}
+		g_mutex_unlock(&sc_speller_lock);
 		g_string_free(str, TRUE);
 	}
 
-	g_free(word_to_check);
 	return n_suggs;
 }
 
@@ -212,9 +295,18 @@ static gchar *get_chars(ScintillaObject *sci, unsigned int message, gint extra_a
 
 
 gint sc_speller_process_line(GeanyDocument *doc, gint line_number)
+{
+	return sc_speller_process_lines(doc, line_number, line_number);
+}
+
+
+/* Checks the lines from first_line to last_line (inclusive), changing the word characters
+ * of the document only once for all of them */
+gint sc_speller_process_lines(GeanyDocument *doc, gint first_line, gint last_line)
 {
 	gint pos_start, pos_end;
 	gint wstart, wend;
+	gint line_number;
 	gint suggestions_found = 0;
 	gint wordchars_len;
 	gchar *wordchars;
@@ -254,25 +346,28 @@ gint sc_speller_process_line(GeanyDocument *doc, gint line_number)
 		/* apply previously changed WORDCHARS setting */
 		scintilla_send_message(doc->editor->sci, SCI_SETWORDCHARS, 0, (sptr_t)wordchars);
 	}
-	pos_start = sci_get_position_from_line(doc->editor->sci, line_number);
-	pos_end = sci_get_position_from_line(doc->editor->sci, line_number + 1);
-
-	while (pos_start < pos_end)
+	for (line_number = first_line; line_number <= last_line; line_number++)
 	{
-		gchar *word;
+		pos_start = sci_get_position_from_line(doc->editor->sci, line_number);
+		pos_end = sci_get_position_from_line(doc->editor->sci, line_number + 1);
 
-		wstart = scintilla_send_message(doc->editor->sci, SCI_WORDSTARTPOSITION, pos_start, TRUE);
-		wend = scintilla_send_message(doc->editor->sci, SCI_WORDENDPOSITION, wstart, FALSE);
-		if (wstart == wend)
-			break;
+		while (pos_start < pos_end)
+		{
+			gchar *word;
+
+			wstart = scintilla_send_message(doc->editor->sci, SCI_WORDSTARTPOSITION, pos_start, TRUE);
+			wend = scintilla_send_message(doc->editor->sci, SCI_WORDENDPOSITION, wstart, FALSE);
+			if (wstart == wend)
+				break;
 
-		word = sci_get_contents_range(doc->editor->sci, wstart, wend);
+			word = sci_get_contents_range(doc->editor->sci, wstart, wend);
 
-		suggestions_found += sc_speller_check_word(doc, line_number, word, wstart, wend);
+			suggestions_found += sc_speller_check_word(doc, line_number, word, wstart, wend);
 
-		pos_start = wend + 1;
+			pos_start = wend + 1;
 
-		g_free(word);
+			g_free(word);
+		}
 	}
 
 	if (wordchars_modified)
@@ -293,26 +388,336 @@ gint sc_speller_process_line(GeanyDocument *doc, gint line_number)
 }
 
 
+static void check_result_clear(gpointer data)
+{
+	CheckResult *result = data;
+
+	g_free(result->word);
+	g_free(result->message);
+}
+
+
+static GArray *check_results_new(void)
+{
+	GArray *results = g_array_new(FALSE, FALSE, sizeof(CheckResult));
+
+	g_array_set_clear_func(results, check_result_clear);
+	return results;
+}
+
+
+/* Returns the message window text for the misspelled word, NULL if there are no
+ * suggestions. Called in the check thread, the lock is held for the single word only. */
+static gchar *check_job_get_message(CheckResult *word, gsize *n_suggs)
+{
+	gchar **suggs;
+	GString *str;
+	gsize j;
+
+	g_mutex_lock(&sc_speller_lock);
+	suggs = enchant_dict_suggest(sc_speller_dict, word->word, -1, n_suggs);
+	g_mutex_unlock(&sc_speller_lock);
+	if (suggs == NULL)
+		return NULL;
+
+	str = g_string_sized_new(256);
+	g_string_append_printf(str, "line %d: %s | ", word->line_number + 1, word->word);
+	g_string_append(str, _("Try: "));
+	for (j = 0; j < MIN(*n_suggs, SC_MAX_SUGGESTIONS); j++)
+	{
+		g_string_append(str, suggs[j]);
+		g_string_append_c(str, ' ');
+	}
+
+	if (*n_suggs > 0)
+	{
+		g_mutex_lock(&sc_speller_lock);
+		enchant_dict_free_string_list(sc_speller_dict, suggs);
+		g_mutex_unlock(&sc_speller_lock);
+	}
+
+	return g_string_free(str, FALSE);
+}
+
+
+/* Checks the words collected in words, adding the misspelled ones to results.
+ * The lock is only held while checking a single word so the main thread doesn't have to
+ * wait for the whole batch. Called in the check thread. */
+static void check_job_check_words(CheckJob *job, GArray *words, GArray *results)
+{
+	guint i;
+
+	for (i = 0; i < words->len; i++)
+	{
+		CheckResult *word = &g_array_index(words, CheckResult, i);
+		gboolean correct;
+
+		if (g_atomic_int_get(&job->cancelled))
+		{
+			g_free(word->word);
+			continue;
+		}
+
+		g_mutex_lock(&sc_speller_lock);
+		correct = cache_check_word(word->word);
+		g_mutex_unlock(&sc_speller_lock);
+		if (correct)
+		{
+			g_free(word->word);
+			continue;
+		}
+
+		if (job->use_msgwin)
+		{
+			gsize n_suggs = 0;
+
+			word->message = check_job_get_message(word, &n_suggs);
+			job->suggestions_found += n_suggs;
+		}
+		g_array_append_val(results, *word);
+	}
+
+	g_array_set_size(words, 0);
+}
+
+
+/* Splits the snapshot into words like sc_speller_process_line() but using the word
+ * characters table of the job, checks them in batches and streams the misspelled ones
+ * back to the main thread. */
+static gpointer check_job_thread(gpointer data)
+{
+	CheckJob *job = data;
+	GArray *words = g_array_sized_new(FALSE, FALSE, sizeof(CheckResult), SC_CHECK_BATCH_WORDS);
+	GString *word = g_string_new(NULL);
+	gint line_number = job->first_line;
+	gint i = 0;
+
+	while (i < job->length && ! g_atomic_int_get(&job->cancelled))
+	{
+		guchar c = job->styled_text[i * 2];
+		gint style = (guchar) job->styled_text[i * 2 + 1];
+		gint word_start = i;
+		gchar *word_to_check;
+
+		if (! job->word_chars[c])
+		{
+			if (c == '\n' || (c == '\r' && (i + 1 >= job->length || job->styled_text[i * 2 + 2] != '\n')))
+				line_number++;
+			i++;
+			continue;
+		}
+
+		g_string_truncate(word, 0);
+		while (i < job->length && job->word_chars[(guchar) job->styled_text[i * 2]])
+		{
+			g_string_append_c(word, job->styled_text[i * 2]);
+			i++;
+		}
+
+		/* ignore numbers or words starting with digits and non-text */
+		if (isdigit(c) || ! sc_speller_style_is_text(job->lexer, style))
+			continue;
+
+		word_to_check = strip_word(word->str);
+		if (! EMPTY(word_to_check))
+		{
+			CheckResult result;
+
+			result.start_pos = job->start_pos + word_start + (word_to_check - word->str);
+			result.end_pos = result.start_pos + strlen(word_to_check);
+			result.line_number = line_number;
+			result.word = g_strdup(word_to_check);
+			result.message = NULL;
+			g_array_append_val(words, result);
+		}
+
+		if (words->len >= SC_CHECK_BATCH_WORDS)
+		{
+			GArray *results = check_results_new();
+
+			check_job_check_words(job, words, results);
+			if (results->len > 0)
+				g_async_queue_push(job->results, results);
+			else
+				g_array_free(results, TRUE);
+		}
+	}
+
+	if (words->len > 0)
+	{
+		GArray *results = check_results_new();
+
+		check_job_check_words(job, words, results);
+		g_async_queue_push(job->results, results);
+	}
+	g_array_free(words, TRUE);
+	g_string_free(word, TRUE);
+
+	g_async_queue_push(job->results, job);
+
+	return NULL;
+}
+
+
+static void check_job_free(CheckJob *job)
+{
+	gpointer item;
+
+	if (job->source_id != 0)
+		g_source_remove(job->source_id);
+	g_thread_join(job->thread);
+
+	while ((item = g_async_queue_try_pop(job->results)) != NULL)
+	{
+		if (item != job)
+			g_array_free(item, TRUE);
+	}
+	g_async_queue_unref(job->results);
+	g_free(job->styled_text);
+	g_free(job);
+}
+
+
+/* Stops a running background check */
+static void check_job_cancel(CheckJob *job)
+{
+	g_atomic_int_set(&job->cancelled, TRUE);
+	g_hash_table_remove(sc_speller_check_jobs, GUINT_TO_POINTER(job->doc_id));
+	check_job_free(job);
+	if (g_hash_table_size(sc_speller_check_jobs) == 0)
+		ui_progress_bar_stop();
+}
+
+
+/* Stops the background check of the document with the given ID, if any */
+static void check_job_cancel_doc(guint doc_id)
+{
+	CheckJob *job = g_hash_table_lookup(sc_speller_check_jobs, GUINT_TO_POINTER(doc_id));
+
+	if (job != NULL)
+		check_job_cancel(job);
+}
+
+
+/* Stops all running background checks */
+static void check_job_cancel_all(void)
+{
+	GList *jobs = g_hash_table_get_values(sc_speller_check_jobs);
+	GList *node;
+
+	for (node = jobs; node != NULL; node = node->next)
+		check_job_cancel(node->data);
+	g_list_free(jobs);
+}
+
+
+static void check_job_apply_results(CheckJob *job, GArray *results)
+{
+	ScintillaObject *sci = job->doc->editor->sci;
+	guint i;
+
+	for (i = 0; i < results->len; i++)
+	{
+		CheckResult *result = &g_array_index(results, CheckResult, i);
+		gchar *current;
+
+		if (result->end_pos > sci_get_length(sci))
+			continue;
+
+		/* the text might have been edited since the snapshot was taken, in which case
+		 * the edited lines get checked while typing anyway */
+		current = sci_get_contents_range(sci, result->start_pos, result->end_pos);
+		if (strcmp(current, result->word) == 0)
+		{
+			editor_indicator_set_on_range(job->doc->editor, GEANY_INDICATOR_ERROR,
+				result->start_pos, result->end_pos);
+			if (result->message != NULL)
+				msgwin_msg_add(COLOR_RED, result->line_number + 1, job->doc, "%s", result->message);
+		}
+		g_free(current);
+	}
+}
+
+
+static gboolean check_job_poll(gpointer data)
+{
+	CheckJob *job = data;
+	gpointer item;
+
+	/* the document might have been closed, and its structure reused for another one */
+	if (! DOC_VALID(job->doc) || job->doc->id != job->doc_id)
+	{
+		job->source_id = 0;
+		check_job_cancel(job);
+		return FALSE;
+	}
+
+	while ((item = g_async_queue_try_pop(job->results)) != NULL)
+	{
+		if (item == job)
+		{
+			if (job->suggestions_found == 0 && job->use_msgwin)
+				msgwin_msg_add(COLOR_BLUE, -1, NULL, _("The checked text is spelled correctly."));
+			cache_log_stats("statistics");
+
+			job->source_id = 0;
+			check_job_cancel(job);
+			return FALSE;
+		}
+		check_job_apply_results(job, item);
+		g_array_free(item, TRUE);
+	}
+
+	return TRUE;
+}
+
+
+/* Fills word_chars like sc_speller_process_line() temporarily modifies the document's
+ * word characters: with "'" added and "_" removed. SCI_GETWORDCHARS only lists ASCII
+ * characters while Scintilla treats all bytes of UTF-8 sequences as word characters,
+ * so they are added too. */
+static void get_word_chars(ScintillaObject *sci, gboolean *word_chars)
+{
+	gchar *chars = get_chars(sci, SCI_GETWORDCHARS, 0, NULL);
+	const gchar *p;
+	guint c;
+
+	memset(word_chars, 0, 256 * sizeof *word_chars);
+	for (p = chars; *p != '\0'; p++)
+		word_chars[(guchar) *p] = TRUE;
+	for (c = 0x80; c < 256; c++)
+		word_chars[c] = TRUE;
+	word_chars['\''] = TRUE;
+	word_chars['_'] = FALSE;
+
+	g_free(chars);
+}
+
+
 void sc_speller_check_document(GeanyDocument *doc)
 {
-	gint i;
+	ScintillaObject *sci;
+	struct Sci_TextRange range;
 	gint first_line, last_line;
+	gint end_pos;
 	gchar *dict_string = NULL;
-	gint suggestions_found = 0;
+	CheckJob *job;
 
 	g_return_if_fail(sc_speller_dict != NULL);
 	g_return_if_fail(doc != NULL);
 
+	/* checks of other documents keep running */
+	check_job_cancel_doc(doc->id);
+	sci = doc->editor->sci;
+
 	ui_progress_bar_start(_("Checking"));
 
 	enchant_dict_describe(sc_speller_dict, dict_describe, &dict_string);
 
-	if (sci_has_selection(doc->editor->sci))
+	if (sci_has_selection(sci))
 	{
-		first_line = sci_get_line_from_position(
-			doc->editor->sci, sci_get_selection_start(doc->editor->sci));
-		last_line = sci_get_line_from_position(
-			doc->editor->sci, sci_get_selection_end(doc->editor->sci));
+		first_line = sci_get_line_from_position(sci, sci_get_selection_start(sci));
+		last_line = sci_get_line_from_position(sci, sci_get_selection_end(sci));
 
 		if (sc_info->use_msgwin)
 			msgwin_msg_add(COLOR_BLUE, -1, NULL,
@@ -324,7 +729,7 @@ void sc_speller_check_document(GeanyDocument *doc)
 	else
 	{
 		first_line = 0;
-		last_line = sci_get_line_count(doc->editor->sci);
+		last_line = sci_get_line_count(sci);
 		if (sc_info->use_msgwin)
 			msgwin_msg_add(COLOR_BLUE, -1, NULL, _("Checking file \"%s\" (using %s):"),
 				DOC_FILENAME(doc), dict_string);
@@ -332,29 +737,36 @@ void sc_speller_check_document(GeanyDocument *doc)
 	}
 	g_free(dict_string);
 
+	/* a selection within a single line checks that line, otherwise the last line is excluded
+	 * as it was always the case */
 	if (first_line == last_line)
-	{
-		suggestions_found += sc_speller_process_line(doc, first_line);
-	}
-	else
-	{
-		for (i = first_line; i < last_line; i++)
-		{
-			if (! DOC_VALID(doc))
-			{	/* current document has been closed (might happen while checking large files) */
-				ui_progress_bar_stop();
-				return;
-			}
-			suggestions_found += sc_speller_process_line(doc, i);
-
-			/* process other GTK events to keep the GUI being responsive */
-			while (g_main_context_iteration(NULL, FALSE));
-		}
-	}
-	if (suggestions_found == 0 && sc_info->use_msgwin)
-		msgwin_msg_add(COLOR_BLUE, -1, NULL, _("The checked text is spelled correctly."));
-
-	ui_progress_bar_stop();
+		last_line++;
+	end_pos = sci_get_position_from_line(sci, last_line);
+	if (last_line >= sci_get_line_count(sci))
+		end_pos = sci_get_length(sci);
+
+	job = g_new0(CheckJob, 1);
+	job->doc = doc;
+	job->doc_id = doc->id;
+	job->start_pos = sci_get_position_from_line(sci, first_line);
+	job->first_line = first_line;
+	job->length = MAX(0, end_pos - job->start_pos);
+	job->lexer = scintilla_send_message(sci, SCI_GETLEXER, 0, 0);
+	job->use_msgwin = sc_info->use_msgwin;
+	get_word_chars(sci, job->word_chars);
+
+	/* make sure the styles used to skip non-text are up to date */
+	scintilla_send_message(sci, SCI_COLOURISE, job->start_pos, end_pos);
+	job->styled_text = g_malloc(job->length * 2 + 2);
+	range.chrg.cpMin = job->start_pos;
+	range.chrg.cpMax = job->start_pos + job->length;
+	range.lpstrText = job->styled_text;
+	scintilla_send_message(sci, SCI_GETSTYLEDTEXT, 0, (sptr_t) &range);
+
+	job->results = g_async_queue_new();
+	job->thread = g_thread_new("spellcheck", check_job_thread, job);
+	job->source_id = plugin_timeout_add(geany_plugin, SC_CHECK_POLL_INTERVAL, check_job_poll, job);
+	g_hash_table_insert(sc_speller_check_jobs, GUINT_TO_POINTER(job->doc_id), job);
 }
 
 
@@ -481,7 +893,9 @@ void sc_speller_dict_free_string_list(gchar **tmp_suggs)
 {
 	g_return_if_fail(sc_speller_dict != NULL);
 
+	g_mutex_lock(&sc_speller_lock);
 	enchant_dict_free_string_list(sc_speller_dict, tmp_suggs);
+	g_mutex_unlock(&sc_speller_lock);
 }
 
 
@@ -490,29 +904,44 @@ void sc_speller_add_word(const gchar *word)
 	g_return_if_fail(sc_speller_dict != NULL);
 	g_return_if_fail(word != NULL);
 
+	g_mutex_lock(&sc_speller_lock);
 #ifdef HAVE_ENCHANT_1_5
 	/* enchant_dict_add() is available since Enchant 1.4 */
 	enchant_dict_add(sc_speller_dict, word, -1);
 #else
 	enchant_dict_add_to_pwl(sc_speller_dict, word, -1);
 #endif
+	g_hash_table_remove(sc_speller_cache, word);
+	g_mutex_unlock(&sc_speller_lock);
 }
 
 gboolean sc_speller_dict_check(const gchar *word)
 {
+	gboolean correct;
+
 	g_return_val_if_fail(sc_speller_dict != NULL, FALSE);
 	g_return_val_if_fail(word != NULL, FALSE);
 
-	return enchant_dict_check(sc_speller_dict, word, -1);
+	g_mutex_lock(&sc_speller_lock);
+	correct = cache_check_word(word);
+	g_mutex_unlock(&sc_speller_lock);
+
+	return ! correct;
 }
 
 
 gchar **sc_speller_dict_suggest(const gchar *word, gsize *n_suggs)
 {
+	gchar **suggs;
+
 	g_return_val_if_fail(sc_speller_dict != NULL, NULL);
 	g_return_val_if_fail(word != NULL, NULL);
 
-	return enchant_dict_suggest(sc_speller_dict, word, -1, n_suggs);
+	g_mutex_lock(&sc_speller_lock);
+	suggs = enchant_dict_suggest(sc_speller_dict, word, -1, n_suggs);
+	g_mutex_unlock(&sc_speller_lock);
+
+	return suggs;
 }
 
 
@@ -521,7 +950,10 @@ void sc_speller_add_word_to_session(const gchar *word)
 	g_return_if_fail(sc_speller_dict != NULL);
 	g_return_if_fail(word != NULL);
 
+	g_mutex_lock(&sc_speller_lock);
 	enchant_dict_add_to_session(sc_speller_dict, word, -1);
+	g_hash_table_remove(sc_speller_cache, word);
+	g_mutex_unlock(&sc_speller_lock);
 }
 
 
@@ -531,7 +963,9 @@ void sc_speller_store_replacement(const gchar *old_word, const gchar *new_word)
 	g_return_if_fail(old_word != NULL);
 	g_return_if_fail(new_word != NULL);
 
+	g_mutex_lock(&sc_speller_lock);
 	enchant_dict_store_replacement(sc_speller_dict, old_word, -1, new_word, -1);
+	g_mutex_unlock(&sc_speller_lock);
 }
 
 
@@ -539,9 +973,13 @@ void sc_speller_reinit_enchant_dict(void)
 {
 	const gchar *lang = sc_info->default_language;
 
+	/* the check threads must not use the dict object anymore */
+	check_job_cancel_all();
+
 	/* Release a previous dict object */
 	if (sc_speller_dict != NULL)
 		enchant_broker_free_dict(sc_speller_broker, sc_speller_dict);
+	cache_clear();
 
 #ifdef HAVE_ENCHANT_2_0
 	#define ENCHANT_CONFIG_ENV_NAME "ENCHANT_CONFIG_DIR"
@@ -621,6 +1059,8 @@ void sc_speller_init(void)
 {
 	log_enchant_version();
 	sc_speller_broker = enchant_broker_init();
+	sc_speller_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	sc_speller_check_jobs = g_hash_table_new(g_direct_hash, g_direct_equal);
 
 	sc_speller_reinit_enchant_dict();
 }
@@ -628,6 +1068,15 @@ void sc_speller_init(void)
 
 void sc_speller_free(void)
 {
+	check_job_cancel_all();
+	g_hash_table_destroy(sc_speller_check_jobs);
+	sc_speller_check_jobs = NULL;
+	cache_log_stats("statistics");
+	g_hash_table_destroy(sc_speller_cache);
+	sc_speller_cache = NULL;
+	sc_speller_cache_hits = 0;
+	sc_speller_cache_misses = 0;
+
 	sc_speller_dicts_free();
 	if (sc_speller_dict != NULL)
 		enchant_broker_free_dict(sc_speller_broker, sc_speller_dict);
@@ -648,6 +1097,16 @@ gboolean sc_speller_is_text(GeanyDocument *doc, gint pos)
 		return TRUE;
 
 	lexer = scintilla_send_message(doc->editor->sci, SCI_GETLEXER, 0, 0);
+	return sc_speller_style_is_text(lexer, style);
+}
+
+
+/* Thread-safe as it doesn't access the document */
+static gboolean sc_speller_style_is_text(gint lexer, gint style)
+{
+	if (style == STYLE_DEFAULT)
+		return TRUE;
+
 	switch (lexer)
 	{
 		case SCLEX_ABAQUS:
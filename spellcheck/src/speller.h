@@ -29,6 +29,8 @@
 
 gint sc_speller_process_line(GeanyDocument *doc, gint line_number);
 
+gint sc_speller_process_lines(GeanyDocument *doc, gint first_line, gint last_line);
+
 void sc_speller_check_document(GeanyDocument *doc);
 
 void sc_speller_reinit_enchant_dict(void);